@@ -0,0 +1,56 @@
+#include <string.h>
+#include <time.h>
+#include "access_log.h"
+
+AccessLog* AccessLog::get_instance()
+{
+    static AccessLog instance;
+    return &instance;
+}
+
+bool AccessLog::init(const char* file_name)
+{
+    if (!file_name || file_name[0] == '\0') return false;
+    access_log_header header;
+    memcpy(header.m_magic, ACCESS_LOG_MAGIC, 4);
+    header.m_version = ACCESS_LOG_VERSION;
+    return m_writer.open(file_name, &header, sizeof(header));
+}
+
+// 由发送完应答的线程调用，只做一次定长拷贝，不做任何格式化
+void AccessLog::record(int method, const char* url, const char* query, int status, uint64_t bytes, uint32_t latency_us,
+                       uint32_t client_ip, uint16_t client_port, uint64_t conn_id)
+{
+    if (!url) url = "";
+    size_t url_len = strlen(url);
+    if (url_len > MAX_URL) url_len = MAX_URL;
+    // 有查询串时把路径和查询串拼在一起，一起截断到 MAX_URL
+    char full[MAX_URL];
+    if (query && url_len < MAX_URL)
+    {
+        memcpy(full, url, url_len);
+        full[url_len++] = '?';
+        size_t query_len = strnlen(query, MAX_URL - url_len);
+        memcpy(full + url_len, query, query_len);
+        url_len += query_len;
+        url = full;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    access_record rec;
+    rec.m_size = sizeof(rec) + url_len;
+    rec.m_method = method;
+    rec.m_flags = 0;
+    rec.m_status = status;
+    rec.m_url_len = url_len;
+    rec.m_client_ip = client_ip;
+    rec.m_client_port = client_port;
+    rec.m_reserved = 0;
+    rec.m_latency_us = latency_us;
+    rec.m_ts_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    rec.m_conn_id = conn_id;
+    rec.m_bytes = bytes;
+    m_writer.append(&rec, sizeof(rec), url, url_len);
+}
@@ -0,0 +1,56 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdint.h>
+#include "async_writer.h"
+
+// 二进制访问日志的文件格式：
+//   文件头 access_log_header，之后是连续的 access_record，每条记录后紧跟 m_url_len 字节的 URL（路径和查询串）
+// 所有整数为小端序，客户端地址和端口保持网络字节序
+#define ACCESS_LOG_MAGIC "WSAL"
+#define ACCESS_LOG_VERSION 1
+
+struct access_log_header{
+    char m_magic[4];
+    uint32_t m_version;
+};
+
+struct __attribute__((packed)) access_record{
+    uint16_t m_size;        // 整条记录的长度（含 URL）
+    uint8_t m_method;       // http_conn::METHOD
+    uint8_t m_flags;        // 保留
+    uint16_t m_status;
+    uint16_t m_url_len;
+    uint32_t m_client_ip;   // 网络字节序
+    uint16_t m_client_port; // 网络字节序
+    uint16_t m_reserved;
+    uint32_t m_latency_us;  // 从读到请求的第一个字节到应答全部发送完成
+    uint64_t m_ts_us;       // 应答完成时的 unix 时间（微秒）
+    uint64_t m_conn_id;
+    uint64_t m_bytes;       // 应答的字节数
+};
+
+class AccessLog{
+public:
+    static const int MAX_URL = 1024; // 超出的部分被截断
+
+    static AccessLog* get_instance();
+
+    bool init(const char* file_name);
+    void stop() { m_writer.close(); }
+    bool enabled() const { return m_writer.is_open(); }
+
+    // query 是不含 '?' 的查询串，没有时为 NULL
+    void record(int method, const char* url, const char* query, int status, uint64_t bytes, uint32_t latency_us,
+                uint32_t client_ip, uint16_t client_port, uint64_t conn_id);
+
+    uint64_t dropped() const { return m_writer.dropped(); }
+
+private:
+    AccessLog() {}
+    ~AccessLog() {}
+
+    async_writer m_writer;
+};
+
+#endif
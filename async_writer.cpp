@@ -0,0 +1,179 @@
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "async_writer.h"
+
+static std::atomic<int> g_writer_count(0);
+static __thread spsc_ring* t_rings[async_writer::MAX_WRITERS];
+
+async_writer::async_writer() : m_running(false), m_stop(false), m_dropped(0), m_written(0),
+m_ring_count(0), m_shared_ring(NULL), m_ring_size(0), m_fd(-1), m_flush_interval_ms(20), m_batch(NULL), m_batch_len(0)
+{
+    m_id = g_writer_count.fetch_add(1);
+    if (m_id >= MAX_WRITERS)
+    {
+        throw std::exception();
+    }
+}
+
+async_writer::~async_writer()
+{
+    close();
+    // 各线程的缓冲区不释放：分离的工作线程在进程退出时可能仍持有它们
+    delete[] m_batch;
+}
+
+bool async_writer::open(const char* path, const void* header, uint32_t header_len,
+                        uint32_t ring_size, int flush_interval_ms)
+{
+    if (is_open()) return false;
+
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) return false;
+    if (header && lseek(m_fd, 0, SEEK_END) == 0)
+    {
+        write_out((const char*)header, header_len);
+    }
+
+    m_ring_size = ring_size;
+    m_flush_interval_ms = flush_interval_ms > 0 ? flush_interval_ms : 1;
+    if (!m_shared_ring) m_shared_ring = new spsc_ring(ring_size);
+    if (!m_batch) m_batch = new char[BATCH_SIZE];
+
+    m_stop.store(false);
+    if (pthread_create(&m_thread, NULL, flush_worker, this) != 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_running.store(true, std::memory_order_release);
+    return true;
+}
+
+void async_writer::close()
+{
+    if (!m_running.exchange(false)) return;
+    m_stop.store(true);
+    pthread_join(m_thread, NULL);
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+spsc_ring* async_writer::thread_ring()
+{
+    spsc_ring* ring = t_rings[m_id];
+    if (ring) return ring;
+
+    m_locker.lock();
+    int idx = m_ring_count.load(std::memory_order_relaxed);
+    if (idx < MAX_THREADS)
+    {
+        ring = new spsc_ring(m_ring_size);
+        m_rings[idx] = ring;
+        m_ring_count.store(idx + 1, std::memory_order_release);
+        t_rings[m_id] = ring;
+    }
+    m_locker.unlock();
+    return ring;
+}
+
+bool async_writer::append(const void* hdr, uint32_t hlen, const void* data, uint32_t dlen)
+{
+    if (!is_open()) return false;
+    // 超长的记录同样计入丢弃数，否则读取方无从知道少了记录
+    if (hlen + dlen > MAX_RECORD)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool ok;
+    spsc_ring* ring = thread_ring();
+    if (ring)
+    {
+        ok = ring->push(hdr, hlen, data, dlen);
+    }
+    else
+    {
+        m_locker.lock();
+        ok = m_shared_ring->push(hdr, hlen, data, dlen);
+        m_locker.unlock();
+    }
+    if (!ok)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ok;
+}
+
+void* async_writer::flush_worker(void* arg)
+{
+    async_writer* writer = (async_writer*)arg;
+    writer->flush_loop();
+    return NULL;
+}
+
+void async_writer::flush_loop()
+{
+    struct timespec interval;
+    interval.tv_sec = m_flush_interval_ms / 1000;
+    interval.tv_nsec = (m_flush_interval_ms % 1000) * 1000000L;
+
+    while (!m_stop.load(std::memory_order_acquire))
+    {
+        // 定期批量写出，缓冲区中没有数据时才休眠
+        if (!drain())
+        {
+            nanosleep(&interval, NULL);
+        }
+    }
+    while (drain()) {}
+}
+
+// 把所有缓冲区中的记录拼接到批量缓冲区，满了就写一次文件
+bool async_writer::drain()
+{
+    bool got = false;
+    int count = m_ring_count.load(std::memory_order_acquire);
+    for (int i = 0; i <= count; ++i)
+    {
+        spsc_ring* ring = (i < count) ? m_rings[i] : m_shared_ring;
+        while (true)
+        {
+            if (BATCH_SIZE - m_batch_len < MAX_RECORD)
+            {
+                write_out(m_batch, m_batch_len);
+                m_batch_len = 0;
+            }
+            uint32_t len = ring->pop(m_batch + m_batch_len, BATCH_SIZE - m_batch_len);
+            if (len == 0) break;
+            m_batch_len += len;
+            got = true;
+        }
+    }
+    if (m_batch_len > 0)
+    {
+        write_out(m_batch, m_batch_len);
+        m_batch_len = 0;
+    }
+    return got;
+}
+
+void async_writer::write_out(const char* buf, int len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(m_fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+        m_written.fetch_add(n, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "locker.h"
+#include "ring_buffer.h"
+
+// 异步二进制文件写入器
+// 每个线程把记录写入自己的无锁环形缓冲区，后台线程定期把所有缓冲区中的记录
+// 按原样拼成大块，以 O_APPEND 方式批量写入文件。记录本身需要自带长度信息
+class async_writer{
+public:
+    static const int MAX_WRITERS = 8;    // 进程中最多有几个 async_writer 实例
+    static const int MAX_THREADS = 256;  // 每个实例最多有多少个线程拥有自己的缓冲区
+    static const int BATCH_SIZE = 256 * 1024;
+    static const int MAX_RECORD = 64 * 1024;
+
+    async_writer();
+    ~async_writer();
+
+    // header 不为空时，若文件是新建的（长度为 0）则先写入该文件头
+    bool open(const char* path, const void* header, uint32_t header_len,
+              uint32_t ring_size = 1024 * 1024, int flush_interval_ms = 20);
+    void close();
+    bool is_open() const { return m_running.load(std::memory_order_acquire); }
+
+    // 写入一条由 hdr + data 两段拼成的记录，超过 MAX_RECORD 或缓冲区满时丢弃（计入 dropped）并返回 false，从不阻塞
+    bool append(const void* hdr, uint32_t hlen, const void* data, uint32_t dlen);
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t written() const { return m_written.load(std::memory_order_relaxed); }
+
+private:
+    static void* flush_worker(void* arg);
+    void flush_loop();
+    bool drain();
+    void write_out(const char* buf, int len);
+    spsc_ring* thread_ring();
+
+private:
+    int m_id; // 本实例在线程局部缓冲区表中的下标
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_written;
+
+    spsc_ring* m_rings[MAX_THREADS];
+    std::atomic<int> m_ring_count;
+    spsc_ring* m_shared_ring; // 线程数超出 MAX_THREADS 时共用，需要加锁
+    locker m_locker;
+    uint32_t m_ring_size;
+
+    pthread_t m_thread;
+    int m_fd;
+    int m_flush_interval_ms;
+    char* m_batch;
+    int m_batch_len;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+// 一次测量的上下文：被测函数执行 m_iters 次操作。
+// 默认计时覆盖整个函数调用；函数内调用 pause()/resume() 可以把准备数据等工作排除在计时之外
+class bench_ctx{
+public:
+    bench_ctx(uint64_t iters, int arg) : m_iters(iters), m_arg(arg), m_elapsed_ns(0), m_start_ns(0) {}
+
+    static uint64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    void resume() { m_start_ns = now_ns(); }
+    void pause() { m_elapsed_ns += now_ns() - m_start_ns; }
+
+    uint64_t iters() const { return m_iters; }
+    int arg() const { return m_arg; }
+    uint64_t elapsed_ns() const { return m_elapsed_ns; }
+
+private:
+    uint64_t m_iters;
+    int m_arg;
+    uint64_t m_elapsed_ns;
+    uint64_t m_start_ns;
+};
+
+typedef void (*bench_fn)(bench_ctx& ctx);
+
+// 注册一个基准测试，名字为 name/arg_name，arg 传给被测函数
+int bench_register(const char* name, const char* arg_name, bench_fn fn, int arg);
+
+// 防止编译器把没有使用的结果优化掉
+template <typename T>
+inline void bench_keep(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+#define BENCH_ARG(fn, arg_name, arg) \
+    static int BENCH_CONCAT(bench_reg_, __LINE__) = bench_register(#fn, arg_name, fn, arg)
+#define BENCH(fn) BENCH_ARG(fn, "", 0)
+
+#endif
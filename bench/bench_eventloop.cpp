@@ -0,0 +1,111 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "bench.h"
+#include "../webserver.h"
+#include "../loopback_transport.h"
+
+// 完整的请求处理路径（epoll 事件分发、读、解析、线程池、写）在 loopback_transport 上的开销，
+// 不经过内核协议栈，测得的是服务器自身每个请求消耗的 CPU 时间。
+// CONN_NUM 个 keep-alive 连接各发一个请求，全部收到应答后再发下一轮；
+// 结果取决于 doc_root 下是否存在请求的文件，只适合在同一台机器上对比
+
+static const int CONN_NUM = 16;
+static const char request[] = "GET /index.html HTTP/1.1\r\nHost: bench\r\nConnection: keep-alive\r\n\r\n";
+
+struct eventloop_case{
+    int m_actor;      // 0 Proactor, 1 Reactor
+    int m_trig;       // 同 Webserver::init 的 TrigMode
+    int m_max_read;
+    int m_read_eagain;
+    int m_max_write;
+    int m_write_eagain;
+};
+
+static const eventloop_case cases[] = {
+    { 0, 0, 0, 0, 0, 0 },   // LT
+    { 0, 3, 0, 0, 0, 0 },   // ET
+    { 1, 0, 0, 0, 0, 0 },   // Reactor LT
+    { 0, 3, 7, 3, 0, 0 },   // ET，请求分成 7 字节的小段到达，每 3 次读插入一次 EAGAIN
+    { 0, 0, 0, 0, 64, 4 },  // LT，每次最多写 64 字节，每 4 次写插入一次 EAGAIN
+};
+
+// 驱动事件循环直到条件满足，防止服务器出错时基准测试卡死
+template <typename F>
+static void run_until(Webserver* server, F done)
+{
+    for (int rounds = 0; !done(); ++rounds)
+    {
+        if (rounds > 1000000)
+        {
+            fprintf(stderr, "bench_eventloop: server stopped making progress\n");
+            exit(1);
+        }
+        server->run_once(10);
+    }
+}
+
+static void bench_eventloop(bench_ctx& ctx)
+{
+    ctx.pause();
+    const eventloop_case& c = cases[ctx.arg()];
+    loopback_transport lb;
+    loopback_pattern pattern;
+    pattern.m_max_read = c.m_max_read;
+    pattern.m_read_eagain = c.m_read_eagain;
+    pattern.m_max_write = c.m_max_write;
+    pattern.m_write_eagain = c.m_write_eagain;
+    lb.set_pattern(pattern);
+    transport::set_current(&lb);
+
+    Webserver* server = new Webserver();
+    server->init(0, c.m_actor, c.m_trig);
+    server->thread_pool();
+    if (!server->eventlisten())
+    {
+        fprintf(stderr, "eventlisten failed\n");
+        exit(1);
+    }
+
+    std::vector<loopback_transport::conn*> conns;
+    for (int i = 0; i < CONN_NUM; ++i) conns.push_back(lb.connect());
+    ctx.resume();
+
+    // 每轮 CONN_NUM 个请求，最后一轮只发剩余的数量
+    uint64_t sent = 0;
+    while (sent < ctx.iters())
+    {
+        int n = ctx.iters() - sent < (uint64_t)CONN_NUM ? ctx.iters() - sent : CONN_NUM;
+        for (int i = 0; i < n; ++i) lb.send(conns[i], request, sizeof(request) - 1);
+        uint64_t expect = sent / CONN_NUM + 1;
+        run_until(server, [&]() {
+            for (int i = 0; i < n; ++i)
+            {
+                if (lb.responses(conns[i]) < expect) return false;
+            }
+            return true;
+        });
+        sent += n;
+    }
+
+    ctx.pause();
+    for (int i = 0; i < CONN_NUM; ++i) lb.shutdown(conns[i]);
+    run_until(server, [&]() {
+        for (int i = 0; i < CONN_NUM; ++i)
+        {
+            if (!lb.closed(conns[i])) return false;
+        }
+        return true;
+    });
+    for (int i = 0; i < CONN_NUM; ++i) lb.release(conns[i]);
+    delete server;
+    transport::set_current(socket_transport::get_instance());
+    ctx.resume();
+}
+
+BENCH_ARG(bench_eventloop, "LT", 0);
+BENCH_ARG(bench_eventloop, "ET", 1);
+BENCH_ARG(bench_eventloop, "reactor", 2);
+BENCH_ARG(bench_eventloop, "ET/partial-read", 3);
+BENCH_ARG(bench_eventloop, "LT/short-write", 4);
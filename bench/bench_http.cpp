@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include "bench.h"
+#include "../http_conn.h"
+#include "../router.h"
+
+// http_conn 的解析与应答构造。请求样本来自 corpus/ 下录制的原始报文，
+// 每个文件包含若干个以空行结尾的 GET 请求，测量时依次循环使用
+
+#ifndef BENCH_CORPUS_DIR
+#define BENCH_CORPUS_DIR "corpus"
+#endif
+
+enum BENCH_CORPUS { CORPUS_CURL = 0, CORPUS_BROWSER, CORPUS_WEBBENCH, CORPUS_NUM };
+
+static const char* corpus_names[CORPUS_NUM] = { "curl", "browser", "webbench" };
+
+static const std::vector<std::string>& corpus(int id)
+{
+    static std::vector<std::string> loaded[CORPUS_NUM];
+    std::vector<std::string>& reqs = loaded[id];
+    if (!reqs.empty()) return reqs;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.http", BENCH_CORPUS_DIR, corpus_names[id]);
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open corpus %s\n", path);
+        exit(1);
+    }
+    std::string data;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) data.append(buf, n);
+    fclose(fp);
+
+    size_t pos = 0, end;
+    while ((end = data.find("\r\n\r\n", pos)) != std::string::npos)
+    {
+        reqs.push_back(data.substr(pos, end + 4 - pos));
+        pos = end + 4;
+    }
+    if (reqs.empty())
+    {
+        fprintf(stderr, "corpus %s has no complete request\n", path);
+        exit(1);
+    }
+    return reqs;
+}
+
+// 通过友元直接调用 http_conn 的私有成员，不经过 socket 和 epoll
+class http_conn_bench{
+public:
+    // 模拟 read() 之后的状态：只重置解析相关的字段
+    static void load(http_conn& c, const std::string& req)
+    {
+        http_conn::init_routes(0);
+        c.alloc_buffers();
+        memcpy(c.m_read_buf, req.data(), req.size());
+        c.m_read_idx = req.size();
+        c.m_checked_idx = 0;
+        c.m_start_line = 0;
+        c.m_check_state = http_conn::CHECK_STATE_REQUESTLINE;
+        c.m_url = 0;
+        c.m_version = 0;
+        c.m_host = 0;
+        c.m_linger = false;
+        c.m_content_length = 0;
+        c.m_route = NULL;
+    }
+
+    // keep-alive 连接上每个请求结束后的重置
+    static void reset(http_conn& c)
+    {
+        c.init();
+    }
+
+    // 只切分行
+    static int split_lines(http_conn& c)
+    {
+        int lines = 0;
+        while (c.parse_line() == http_conn::LINE_OK)
+        {
+            c.m_start_line = c.m_checked_idx;
+            ++lines;
+        }
+        return lines;
+    }
+
+    // 与 process_read() 相同的状态机，但在得到完整请求时停下，不调用 do_request()
+    static http_conn::HTTP_CODE parse(http_conn& c)
+    {
+        http_conn::HTTP_CODE ret = http_conn::NO_REQUEST;
+        while (c.parse_line() == http_conn::LINE_OK)
+        {
+            char* text = c.get_line();
+            c.m_start_line = c.m_checked_idx;
+            if (c.m_check_state == http_conn::CHECK_STATE_REQUESTLINE) ret = c.parse_request_line(text);
+            else ret = c.parse_headers(text);
+            if (ret != http_conn::NO_REQUEST) break;
+        }
+        return ret;
+    }
+
+    // 完整的 process_read()，包含 do_request() 中的 stat/open/mmap
+    static http_conn::HTTP_CODE process_read(http_conn& c)
+    {
+        http_conn::HTTP_CODE ret = c.process_read();
+        c.unmap();
+        return ret;
+    }
+
+    // 应答构造所需的请求状态：文件内容不会被读取，只需要地址和长度
+    static void prepare_write(http_conn& c)
+    {
+        static char body[4096];
+        static char version[] = "HTTP/1.1";
+        c.alloc_buffers();
+        c.m_version = version;
+        c.m_linger = true;
+        c.m_content_type = "text/html";
+        c.m_file_address = body;
+        c.m_file_mapped = false;
+        memset(&c.m_file_stat, 0, sizeof(c.m_file_stat));
+        c.m_file_stat.st_size = sizeof(body);
+    }
+
+    static bool process_write(http_conn& c, http_conn::HTTP_CODE code)
+    {
+        c.m_write_idx = 0;
+        return c.process_write(code);
+    }
+
+    static bool status_line(http_conn& c)
+    {
+        c.m_write_idx = 0;
+        return c.add_status_line(200, "OK");
+    }
+
+    static bool normalize_url(char* url)
+    {
+        return http_conn::normalize_url(url);
+    }
+};
+
+static http_conn conn;
+
+static void bench_parse_line(bench_ctx& ctx)
+{
+    const std::vector<std::string>& reqs = corpus(ctx.arg());
+    int lines = 0;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        http_conn_bench::load(conn, reqs[i % reqs.size()]);
+        lines += http_conn_bench::split_lines(conn);
+    }
+    bench_keep(lines);
+}
+BENCH_ARG(bench_parse_line, "curl", CORPUS_CURL);
+BENCH_ARG(bench_parse_line, "browser", CORPUS_BROWSER);
+BENCH_ARG(bench_parse_line, "webbench", CORPUS_WEBBENCH);
+
+static void bench_parse(bench_ctx& ctx)
+{
+    const std::vector<std::string>& reqs = corpus(ctx.arg());
+    int ok = 0;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        http_conn_bench::load(conn, reqs[i % reqs.size()]);
+        ok += http_conn_bench::parse(conn) == http_conn::GET_REQUEST;
+    }
+    bench_keep(ok);
+}
+BENCH_ARG(bench_parse, "curl", CORPUS_CURL);
+BENCH_ARG(bench_parse, "browser", CORPUS_BROWSER);
+BENCH_ARG(bench_parse, "webbench", CORPUS_WEBBENCH);
+
+// keep-alive 连接两个请求之间的重置开销
+static void bench_reset(bench_ctx& ctx)
+{
+    http_conn_bench::prepare_write(conn);
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        http_conn_bench::reset(conn);
+    }
+    bench_keep(conn.idle());
+}
+BENCH(bench_reset);
+
+// 请求路径的规范化，每次先把原始路径复制到缓冲区（规范化是原地进行的）
+static const char* url_samples[] = {
+    "/images/logo.png",
+    "/static/./js/../css//site%2Ecss?v=20240101",
+};
+
+static void bench_normalize_url(bench_ctx& ctx)
+{
+    const char* sample = url_samples[ctx.arg()];
+    size_t len = strlen(sample) + 1;
+    char url[256];
+    bool ok = true;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        memcpy(url, sample, len);
+        ok &= http_conn_bench::normalize_url(url);
+    }
+    bench_keep(ok);
+}
+BENCH_ARG(bench_normalize_url, "plain", 0);
+BENCH_ARG(bench_normalize_url, "dirty", 1);
+
+// 路由匹配：静态路由，以及回溯到 /*path 的静态文件路径
+static const char* route_samples[] = {
+    "/metrics",
+    "/images/logo.png",
+};
+
+static void bench_route(bench_ctx& ctx)
+{
+    http_conn::init_routes(0);
+    const char* path = route_samples[ctx.arg()];
+    size_t len = strlen(path);
+    route_params params;
+    int found = 0;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        found += Router::match(path, len, params) != NULL;
+    }
+    bench_keep(found);
+}
+BENCH_ARG(bench_route, "static", 0);
+BENCH_ARG(bench_route, "file", 1);
+
+// 结果取决于 doc_root 下是否存在对应的文件，只适合在同一台机器上对比
+static void bench_process_read(bench_ctx& ctx)
+{
+    const std::vector<std::string>& reqs = corpus(ctx.arg());
+    int ret = 0;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        http_conn_bench::load(conn, reqs[i % reqs.size()]);
+        ret += http_conn_bench::process_read(conn);
+    }
+    bench_keep(ret);
+}
+BENCH_ARG(bench_process_read, "curl", CORPUS_CURL);
+BENCH_ARG(bench_process_read, "browser", CORPUS_BROWSER);
+
+static void bench_add_status_line(bench_ctx& ctx)
+{
+    http_conn_bench::prepare_write(conn);
+    bool ok = true;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        ok &= http_conn_bench::status_line(conn);
+    }
+    bench_keep(ok);
+}
+BENCH(bench_add_status_line);
+
+static void bench_process_write(bench_ctx& ctx)
+{
+    http_conn_bench::prepare_write(conn);
+    http_conn::HTTP_CODE code = (http_conn::HTTP_CODE)ctx.arg();
+    bool ok = true;
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        ok &= http_conn_bench::process_write(conn, code);
+    }
+    bench_keep(ok);
+}
+BENCH_ARG(bench_process_write, "200", http_conn::FILE_REQUEST);
+BENCH_ARG(bench_process_write, "404", http_conn::NO_RESOURCE);
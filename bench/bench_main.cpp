@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include "bench.h"
+#include "../log.h"
+
+// 微基准测试的驱动程序：
+//   1. 先用逐渐增大的迭代次数试跑（同时起到预热作用），直到一轮耗时超过 -t 指定的时间
+//   2. 以确定的迭代次数重复测量 -r 轮，报告每次操作耗时的中位数、最小值和离散程度
+//   3. -o 保存结果，-b 与之前保存的结果对比，变化超过噪声范围的项会被标记出来
+// 需要在提交之间对比时，建议固定 CPU（-c）并关闭频率调节
+
+struct bench_case{
+    std::string m_name;
+    bench_fn m_fn;
+    int m_arg;
+};
+
+struct bench_result{
+    double m_median;
+    double m_min;
+    double m_spread; // 中位数绝对偏差 / 中位数
+};
+
+static std::vector<bench_case>& cases()
+{
+    static std::vector<bench_case> all;
+    return all;
+}
+
+int bench_register(const char* name, const char* arg_name, bench_fn fn, int arg)
+{
+    bench_case c;
+    c.m_name = name;
+    if (arg_name && arg_name[0])
+    {
+        c.m_name += "/";
+        c.m_name += arg_name;
+    }
+    c.m_fn = fn;
+    c.m_arg = arg;
+    cases().push_back(c);
+    return 0;
+}
+
+static uint64_t run_once(const bench_case& c, uint64_t iters)
+{
+    bench_ctx ctx(iters, c.m_arg);
+    ctx.resume();
+    c.m_fn(ctx);
+    ctx.pause();
+    return ctx.elapsed_ns();
+}
+
+static bench_result measure(const bench_case& c, int repeat, uint64_t min_ns, uint64_t& iters)
+{
+    // 试跑确定迭代次数
+    iters = 1;
+    while (true)
+    {
+        uint64_t elapsed = run_once(c, iters);
+        if (elapsed >= min_ns) break;
+        uint64_t next = elapsed > 0 ? (uint64_t)(iters * 1.2 * min_ns / elapsed) : iters * 100;
+        if (next > iters * 100) next = iters * 100;
+        if (next < iters * 2) next = iters * 2;
+        iters = next;
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < repeat; ++i)
+    {
+        samples.push_back((double)run_once(c, iters) / iters);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    bench_result r;
+    r.m_median = samples[samples.size() / 2];
+    r.m_min = samples[0];
+    std::vector<double> dev;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        dev.push_back(fabs(samples[i] - r.m_median));
+    }
+    std::sort(dev.begin(), dev.end());
+    r.m_spread = r.m_median > 0 ? dev[dev.size() / 2] / r.m_median : 0;
+    return r;
+}
+
+static void load_baseline(const char* path, std::map<std::string, bench_result>& out)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        exit(1);
+    }
+    char name[256];
+    bench_result r;
+    while (fscanf(fp, "%255s %lf %lf %lf", name, &r.m_median, &r.m_min, &r.m_spread) == 4)
+    {
+        out[name] = r;
+    }
+    fclose(fp);
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "usage: %s [-l] [-f filter] [-r repeat] [-t min_ms] [-c cpu] [-o save_file] [-b baseline_file]\n"
+        "  -l  list benchmarks\n"
+        "  -f  only run benchmarks whose name contains filter\n"
+        "  -r  measured repetitions per benchmark (default 7)\n"
+        "  -t  minimum duration of one repetition in ms (default 100)\n"
+        "  -c  pin the benchmark thread to a cpu\n"
+        "  -o  save results for later comparison\n"
+        "  -b  compare with results saved by -o\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* filter = NULL;
+    const char* save_file = NULL;
+    const char* base_file = NULL;
+    int repeat = 7;
+    int min_ms = 100;
+    int cpu = -1;
+    bool list = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "lf:r:t:c:o:b:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': list = true; break;
+            case 'f': filter = optarg; break;
+            case 'r': repeat = atoi(optarg); break;
+            case 't': min_ms = atoi(optarg); break;
+            case 'c': cpu = atoi(optarg); break;
+            case 'o': save_file = optarg; break;
+            case 'b': base_file = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (repeat <= 0 || min_ms <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (list)
+    {
+        for (size_t i = 0; i < cases().size(); ++i) printf("%s\n", cases()[i].m_name.c_str());
+        return 0;
+    }
+
+    // 线程池等组件会打印 INFO 日志，测量时只保留警告以上
+    Log::get_instance()->set_level(Log::WARN);
+
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        {
+            perror("sched_setaffinity");
+            return 1;
+        }
+    }
+
+    std::map<std::string, bench_result> baseline;
+    if (base_file) load_baseline(base_file, baseline);
+
+    FILE* save = NULL;
+    if (save_file)
+    {
+        save = fopen(save_file, "w");
+        if (!save)
+        {
+            perror("fopen");
+            return 1;
+        }
+    }
+
+    printf("%-36s %12s %12s %12s %8s %14s%s\n", "benchmark", "iters", "median ns", "min ns", "+/-", "ops/s",
+           base_file ? "   vs base" : "");
+    for (size_t i = 0; i < cases().size(); ++i)
+    {
+        const bench_case& c = cases()[i];
+        if (filter && !strstr(c.m_name.c_str(), filter)) continue;
+
+        uint64_t iters = 0;
+        bench_result r = measure(c, repeat, (uint64_t)min_ms * 1000000, iters);
+        printf("%-36s %12llu %12.1f %12.1f %7.1f%% %14.0f", c.m_name.c_str(), (unsigned long long)iters,
+               r.m_median, r.m_min, r.m_spread * 100, r.m_median > 0 ? 1e9 / r.m_median : 0);
+
+        std::map<std::string, bench_result>::iterator it = baseline.find(c.m_name);
+        if (it != baseline.end() && it->second.m_median > 0)
+        {
+            const bench_result& b = it->second;
+            double delta = (r.m_median - b.m_median) / b.m_median;
+            // 变化在噪声范围内（两次测量离散程度之和的 3 倍，至少 2%）视为没有变化
+            double noise = std::max(0.02, 3 * (r.m_spread + b.m_spread));
+            printf("   %+6.1f%%%s", delta * 100, fabs(delta) <= noise ? "" : (delta > 0 ? " slower" : " faster"));
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if (save) fprintf(save, "%s %.3f %.3f %.5f\n", c.m_name.c_str(), r.m_median, r.m_min, r.m_spread);
+    }
+    if (save) fclose(save);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <sched.h>
+#include <atomic>
+#include "bench.h"
+#include "../threadpool.h"
+
+// threadpool<T> 的入队/出队吞吐：主线程不断 append，工作线程取出后只做一次计数，
+// 测得的是每个任务经过队列（加锁、信号量、指标记录）的平均开销
+
+// 满足 threadpool 对任务类型要求的最小实现
+struct bench_task{
+    int m_state;
+    int m_finish;
+    int m_timerflag;
+    uint64_t m_enqueue_ns;
+    uint64_t m_conn_id;
+    bool m_traced;
+
+    bench_task() : m_state(0), m_finish(0), m_timerflag(0), m_enqueue_ns(0), m_conn_id(0), m_traced(false) {}
+    bool read() { return true; }
+    bool write() { return true; }
+    bool has_pending() const { return false; }
+    void process();
+};
+
+static std::atomic<uint64_t> processed(0);
+
+void bench_task::process()
+{
+    processed.fetch_add(1, std::memory_order_relaxed);
+}
+
+// append 会写入任务的入队时间，轮流使用多个任务对象，减少主线程与工作线程争用同一条缓存行
+static const int TASK_NUM = 64;
+static bench_task tasks[TASK_NUM];
+
+static void bench_threadpool(bench_ctx& ctx)
+{
+    ctx.pause();
+    threadpool<bench_task>* pool = new threadpool<bench_task>(0, ctx.arg(), 10000);
+    processed.store(0);
+    ctx.resume();
+
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        // 队列满时等待工作线程消费
+        while (!pool->append(&tasks[i % TASK_NUM])) sched_yield();
+    }
+    while (processed.load(std::memory_order_relaxed) < ctx.iters()) sched_yield();
+
+    ctx.pause();
+    delete pool;
+    ctx.resume();
+}
+
+BENCH_ARG(bench_threadpool, "1", 1);
+BENCH_ARG(bench_threadpool, "2", 2);
+BENCH_ARG(bench_threadpool, "4", 4);
+BENCH_ARG(bench_threadpool, "8", 8);
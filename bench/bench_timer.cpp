@@ -0,0 +1,124 @@
+#include <vector>
+#include <algorithm>
+#include "bench.h"
+#include "../lst_timer.h"
+
+// sort_timer_lst 的添加、调整与到期处理。定时器按打乱的顺序链入链表，
+// 模拟连接随机活跃时链表节点在内存中分散的情况，规模越大越能体现缓存未命中的代价
+
+static uint64_t expired_count = 0;
+
+static void count_expired(http_conn*)
+{
+    ++expired_count;
+}
+
+// 预先分配 n 个定时器，返回打乱后的访问顺序
+static void make_timers(std::vector<util_timer>& timers, std::vector<util_timer*>& order, int n, time_t expire)
+{
+    timers.assign(n, util_timer());
+    order.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        timers[i].m_expire = expire;
+        timers[i].m_cbfunc = count_expired;
+        timers[i].m_user_data = NULL;
+        order[i] = &timers[i];
+    }
+    uint32_t seed = 2463534242u;
+    for (int i = n - 1; i > 0; --i)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        std::swap(order[i], order[seed % (i + 1)]);
+    }
+}
+
+// 链表析构时会 delete 其中的节点，定时器属于 vector，结束前需要全部摘下
+static void unlink_all(sort_timer_lst& lst, std::vector<util_timer*>& order)
+{
+    for (size_t i = 0; i < order.size(); ++i) lst.del_timer(order[i]);
+}
+
+// 向已有 n 个定时器的链表中添加再删除
+static void bench_timer_add(bench_ctx& ctx)
+{
+    ctx.pause();
+    int n = ctx.arg();
+    std::vector<util_timer> timers;
+    std::vector<util_timer*> order;
+    make_timers(timers, order, n + 1, time(NULL) + 3600);
+    sort_timer_lst lst;
+    for (int i = 0; i < n; ++i) lst.push_back(order[i]);
+    util_timer* extra = order[n];
+    ctx.resume();
+
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        lst.push_back(extra);
+        lst.del_timer(extra);
+    }
+
+    ctx.pause();
+    order.pop_back();
+    unlink_all(lst, order);
+    ctx.resume();
+}
+
+// 连接有数据到达时把定时器挪到末尾，目标在 n 个定时器中随机选取
+static void bench_timer_adjust(bench_ctx& ctx)
+{
+    ctx.pause();
+    int n = ctx.arg();
+    std::vector<util_timer> timers;
+    std::vector<util_timer*> order;
+    make_timers(timers, order, n, time(NULL) + 3600);
+    sort_timer_lst lst;
+    for (int i = 0; i < n; ++i) lst.push_back(order[i]);
+    uint32_t seed = 88172645u;
+    ctx.resume();
+
+    for (uint64_t i = 0; i < ctx.iters(); ++i)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        lst.adjust_timer(&timers[seed % n]);
+    }
+
+    ctx.pause();
+    unlink_all(lst, order);
+    ctx.resume();
+}
+
+// tick() 处理全部到期的 n 个定时器，每次操作为一个定时器
+static void bench_timer_tick(bench_ctx& ctx)
+{
+    ctx.pause();
+    int n = ctx.arg();
+    std::vector<util_timer> timers;
+    std::vector<util_timer*> order;
+    make_timers(timers, order, n, 0);
+    sort_timer_lst lst;
+    uint64_t done = 0;
+    while (done < ctx.iters())
+    {
+        int batch = (int)std::min<uint64_t>(n, ctx.iters() - done);
+        for (int i = 0; i < batch; ++i) lst.push_back(order[i]);
+        ctx.resume();
+        done += lst.tick();
+        ctx.pause();
+    }
+    ctx.resume();
+    bench_keep(expired_count);
+}
+
+BENCH_ARG(bench_timer_add, "10k", 10000);
+BENCH_ARG(bench_timer_add, "1M", 1000000);
+BENCH_ARG(bench_timer_adjust, "10k", 10000);
+BENCH_ARG(bench_timer_adjust, "100k", 100000);
+BENCH_ARG(bench_timer_adjust, "1M", 1000000);
+BENCH_ARG(bench_timer_tick, "10k", 10000);
+BENCH_ARG(bench_timer_tick, "100k", 100000);
+BENCH_ARG(bench_timer_tick, "1M", 1000000);
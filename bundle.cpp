@@ -0,0 +1,125 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bundle.h"
+#include "log.h"
+
+char* Bundle::m_base = NULL;
+uint64_t Bundle::m_size = 0;
+const bundle_entry* Bundle::m_index = NULL;
+uint32_t Bundle::m_count = 0;
+
+static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+// 复制到开启透明大页的匿名内存中，文件映射的页缓存一般不能使用大页
+static char* load_huge(int fd, uint64_t size)
+{
+    size_t len = (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    // 多映射一个大页，从中取出按 2MB 对齐的部分
+    char* raw = (char*)mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    char* base = (char*)(((uintptr_t)raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+    if (base > raw) munmap(raw, base - raw);
+    munmap(base + len, raw + HUGE_PAGE - base);
+    if (madvise(base, len, MADV_HUGEPAGE) != 0)
+    {
+        LOG_WARN("madvise(MADV_HUGEPAGE) failed, errno is %d", errno);
+    }
+    uint64_t off = 0;
+    while (off < size)
+    {
+        ssize_t n = pread(fd, base + off, size - off, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            munmap(base, len);
+            return NULL;
+        }
+        off += n;
+    }
+    mprotect(base, len, PROT_READ);
+    return base;
+}
+
+bool Bundle::open(const char* path, bool populate, bool hugepages)
+{
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(bundle_header))
+    {
+        close(fd);
+        return false;
+    }
+    uint64_t size = st.st_size;
+    size_t maplen = (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    char* base = hugepages ? load_huge(fd, size) : NULL;
+    if (!base)
+    {
+        maplen = size;
+        if (hugepages) LOG_WARN("load %s into huge pages failed, fall back to mmap", path);
+        base = (char*)mmap(NULL, size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        if (populate) madvise(base, size, MADV_WILLNEED);
+    }
+    close(fd);
+    if (!check(base, size))
+    {
+        munmap(base, maplen);
+        return false;
+    }
+    // 启动时只加载一次，进程退出前不释放
+    m_base = base;
+    m_size = size;
+    m_index = (const bundle_entry*)(base + sizeof(bundle_header));
+    m_count = ((const bundle_header*)base)->m_count;
+    return true;
+}
+
+// 检查文件头和每一项的偏移都在资源包内，查找和发送时不再检查
+bool Bundle::check(const char* base, uint64_t size)
+{
+    const bundle_header* h = (const bundle_header*)base;
+    if (memcmp(h->m_magic, BUNDLE_MAGIC, 4) != 0 || h->m_version != BUNDLE_VERSION || h->m_size != size)
+    {
+        return false;
+    }
+    if (sizeof(bundle_header) + (uint64_t)h->m_count * sizeof(bundle_entry) > size) return false;
+    const bundle_entry* index = (const bundle_entry*)(base + sizeof(bundle_header));
+    for (uint32_t i = 0; i < h->m_count; i++)
+    {
+        const bundle_entry& e = index[i];
+        if (e.m_data_off > size || e.m_data_len > size - e.m_data_off ||
+            (uint64_t)e.m_path_off + e.m_path_len > size ||
+            (uint64_t)e.m_head_off + e.m_head_len > size ||
+            (uint64_t)e.m_etag_off + e.m_etag_len > size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const bundle_entry* Bundle::find(const char* path, size_t len)
+{
+    uint32_t lo = 0, hi = m_count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const bundle_entry& e = m_index[mid];
+        size_t n = e.m_path_len < len ? e.m_path_len : len;
+        int cmp = memcmp(m_base + e.m_path_off, path, n);
+        if (cmp == 0) cmp = e.m_path_len < len ? -1 : (e.m_path_len > len ? 1 : 0);
+        if (cmp == 0) return &e;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 静态资源包的格式，由 tools/mkbundle 从文档根目录生成，服务器启动时整体映射到内存：
+//   bundle_header
+//   bundle_entry[m_count]        按路径的字节序升序排列，查找时二分
+//   字符串区                     路径、预先生成的应答头和 ETag，不以 '\0' 结尾
+//   文件内容                     每个文件的起始位置按 BUNDLE_ALIGN 对齐
+// 所有偏移都相对于文件开头。应答头包含 Content-Length、Content-Type 和 ETag 三行，
+// 状态行和 Connection 取决于请求，仍由服务器生成
+#define BUNDLE_MAGIC "WSBN"
+#define BUNDLE_VERSION 1
+#define BUNDLE_ALIGN 4096
+
+struct bundle_header{
+    char m_magic[4];
+    uint32_t m_version;
+    uint32_t m_count;       // 文件数
+    uint32_t m_reserved;
+    uint64_t m_size;        // 整个资源包的长度，用于检查文件是否完整
+};
+
+struct bundle_entry{
+    uint64_t m_data_off;
+    uint64_t m_data_len;
+    uint32_t m_path_off;    // 请求路径，以 '/' 开头，例如 /index.html
+    uint32_t m_path_len;
+    uint32_t m_head_off;
+    uint32_t m_head_len;
+    uint32_t m_etag_off;    // 带引号的 ETag，例如 "3f2a..."，与 If-None-Match 直接比较
+    uint32_t m_etag_len;
+};
+
+// 服务器使用的资源包，启动时加载一次，之后只读，工作线程并发查找不需要加锁
+class Bundle{
+public:
+    // 映射资源包并检查格式。populate 时用 MAP_POPULATE 和 MADV_WILLNEED 在启动时读入全部内容；
+    // hugepages 时把资源包复制到按 2MB 对齐、开启透明大页的匿名内存中，减少 TLB 缺失
+    static bool open(const char* path, bool populate, bool hugepages);
+    static bool loaded() { return m_base != NULL; }
+    static uint32_t count() { return m_count; }
+
+    // 按请求路径查找，没有时返回 NULL。只访问映射的内存，不调用任何系统调用
+    static const bundle_entry* find(const char* path, size_t len);
+    static const char* at(uint64_t off) { return m_base + off; }
+
+private:
+    static bool check(const char* base, uint64_t size);
+
+    static char* m_base;
+    static uint64_t m_size;
+    static const bundle_entry* m_index;
+    static uint32_t m_count;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include <string.h>
+#include <sys/stat.h>
+#include "capture.h"
+#include "metrics.h"
+
+Capture* Capture::get_instance()
+{
+    static Capture instance;
+    return &instance;
+}
+
+bool Capture::init(const char* file_name)
+{
+    if (!file_name || file_name[0] == '\0') return false;
+    struct stat st;
+    if (stat(file_name, &st) == 0 && st.st_size > 0) return false;
+
+    capture_header header;
+    memcpy(header.m_magic, CAPTURE_MAGIC, 4);
+    header.m_version = CAPTURE_VERSION;
+    header.m_start_ns = Metrics::now_ns();
+    // 录制的数据量比访问日志大得多，缓冲区也相应放大
+    return m_writer.open(file_name, &header, sizeof(header), 4 * 1024 * 1024);
+}
+
+// 由处理该连接的线程调用，数据原样拷贝进缓冲区。读缓冲区可以大于一条记录的上限，
+// 这时按上限拆成几条 CAP_DATA，每条的 m_bytes 是它自己的数据长度
+void Capture::record(int type, uint64_t conn_id, uint32_t& seq, int status, uint32_t bytes,
+                     const void* data, uint32_t len)
+{
+    const uint32_t max_piece = async_writer::MAX_RECORD - sizeof(capture_record);
+    capture_record rec;
+    rec.m_type = type;
+    rec.m_reserved = 0;
+    rec.m_status = status;
+    rec.m_ts_ns = Metrics::now_ns();
+    rec.m_conn_id = conn_id;
+    const char* p = (const char*)data;
+    do
+    {
+        uint32_t piece = len > max_piece ? max_piece : len;
+        rec.m_size = sizeof(rec) + piece;
+        rec.m_seq = seq++;
+        rec.m_bytes = type == CAP_DATA ? piece : bytes;
+        m_writer.append(&rec, sizeof(rec), p, piece);
+        p += piece;
+        len -= piece;
+    } while (len > 0);
+}
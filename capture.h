@@ -0,0 +1,61 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include "async_writer.h"
+
+// 流量录制文件的格式：
+//   文件头 capture_header，之后是连续的 capture_record，CAP_DATA 记录后紧跟 m_bytes 字节收到的原始数据
+// 不同线程写入的记录在文件中不保证按时间排列，回放前需要按连接编号分组、按 m_seq 排序。
+// 每个连接的 m_seq 从 0 开始连续递增，出现空缺说明缓冲区满丢了记录，这个连接无法准确回放
+#define CAPTURE_MAGIC "WSCP"
+#define CAPTURE_VERSION 1
+
+enum CAPTURE_EVENT {
+    CAP_OPEN = 1,   // 连接建立
+    CAP_DATA,       // 一次 recv 收到的数据，保留了客户端的发送边界（流水线中的多个请求可能在同一条记录里）。
+                    // 超过 async_writer::MAX_RECORD 的数据拆成几条连续的记录
+    CAP_RESPONSE,   // 一个应答发送完成，m_status 为状态码，m_bytes 为应答字节数
+    CAP_CLOSE       // 连接关闭
+};
+
+struct capture_header{
+    char m_magic[4];
+    uint32_t m_version;
+    uint64_t m_start_ns;    // 开始录制时的 CLOCK_MONOTONIC 时间
+};
+
+struct __attribute__((packed)) capture_record{
+    uint32_t m_size;        // 整条记录的长度（含数据）
+    uint8_t m_type;         // CAPTURE_EVENT
+    uint8_t m_reserved;
+    uint16_t m_status;
+    uint32_t m_seq;         // 该连接上的第几条记录
+    uint32_t m_bytes;
+    uint64_t m_ts_ns;       // CLOCK_MONOTONIC 时间
+    uint64_t m_conn_id;
+};
+
+class Capture{
+public:
+    static Capture* get_instance();
+
+    // 为了不把两次运行的录制混在一起，文件已存在且不为空时拒绝录制
+    bool init(const char* file_name);
+    void stop() { m_writer.close(); }
+    bool enabled() const { return m_writer.is_open(); }
+
+    // seq 是该连接下一条记录的序号，写入几条记录就增加几
+    void record(int type, uint64_t conn_id, uint32_t& seq, int status, uint32_t bytes,
+                const void* data = NULL, uint32_t len = 0);
+
+    uint64_t dropped() const { return m_writer.dropped(); }
+
+private:
+    Capture() {}
+    ~Capture() {}
+
+    async_writer m_writer;
+};
+
+#endif
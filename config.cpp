@@ -1,18 +1,172 @@
 #include <stdio.h>
 #include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdlib.h>
 #include <string>
+#include <string.h>
 #include"config.h"
 
+// 配置文件中的整数项及其取值范围
+struct int_option{
+    const char* m_name;
+    int Config::* m_field;
+    int m_min;
+    int m_max;
+};
+
+static const int_option int_options[] = {
+    { "port",              &Config::PORT,            1,    65535 },
+    { "actor_mode",        &Config::ActorMode,       0,    1 },
+    { "trig_mode",         &Config::TrigMode,        0,    3 },
+    { "log_level",         &Config::LogLevel,        0,    4 },
+    { "trace_sample",      &Config::TraceSample,     0,    1 << 30 },
+    { "thread_num",        &Config::ThreadNum,       1,    1024 },
+    { "max_requests",      &Config::MaxRequests,     1,    1 << 24 },
+    { "io_threads",        &Config::IoThreads,       0,    256 },
+    { "max_conns",         &Config::MaxConns,        16,   1 << 20 },
+    { "max_events",        &Config::MaxEvents,       1,    1 << 20 },
+    { "max_idle_conns",    &Config::MaxIdleConns,    0,    1 << 20 },
+    { "backlog",           &Config::Backlog,         1,    1 << 16 },
+    { "accept_batch",      &Config::AcceptBatch,     1,    1 << 16 },
+    { "defer_accept",      &Config::DeferAccept,     0,    3600 },
+    { "fastopen",          &Config::FastOpen,        0,    1 << 16 },
+    { "timeslot",          &Config::Timeslot,        1,    3600 },
+    { "conn_timeout",      &Config::ConnTimeout,     1,    86400 },
+    { "header_timeout",    &Config::HeaderTimeout,   1,    3600 },
+    { "body_timeout",      &Config::BodyTimeout,     1,    3600 },
+    { "min_body_rate",     &Config::MinBodyRate,     0,    1 << 30 },
+    { "send_timeout",      &Config::SendTimeout,     1,    3600 },
+    { "min_send_rate",     &Config::MinSendRate,     0,    1 << 30 },
+    { "max_body_size",     &Config::MaxBodySize,     0,    1 << 30 },
+    { "body_splice",       &Config::BodySplice,      0,    1 },
+    { "micro_cache_entries",  &Config::MicroCacheEntries, 0, 1 << 20 },
+    { "micro_cache_stale_ms", &Config::MicroCacheStaleMs, 0, 60000 },
+    { "metrics_cache_ms",     &Config::MetricsCacheMs,    0, 60000 },
+    // 写缓冲区要能放下完整的响应头
+    { "read_buffer_size",  &Config::ReadBufferSize,  256,  1 << 20 },
+    { "write_buffer_size", &Config::WriteBufferSize, 256,  1 << 20 },
+    { "stream_chunk_size", &Config::StreamChunkSize, 1024, 1 << 20 },
+    { "drain_timeout",     &Config::DrainTimeout,    1,    3600 },
+    { "ip_rate",           &Config::IpRate,          0,    1 << 20 },
+    { "ip_burst",          &Config::IpBurst,         0,    1 << 20 },
+    { "ip_max_conns",      &Config::IpMaxConns,      0,    1 << 20 },
+    { "subnet_rate",       &Config::SubnetRate,      0,    1 << 20 },
+    { "subnet_burst",      &Config::SubnetBurst,     0,    1 << 20 },
+    { "subnet_max_conns",  &Config::SubnetMaxConns,  0,    1 << 20 },
+    { "subnet_prefix",     &Config::SubnetPrefix,    0,    32 },
+    { "rate_table_bits",   &Config::RateTableBits,   8,    24 },
+    { "bundle_populate",   &Config::BundlePopulate,  0,    1 },
+    { "path_index",        &Config::PathIndex,       0,    1 },
+    { "path_index_max",    &Config::PathIndexMax,    1,    1 << 24 },
+    { "bundle_hugepages",  &Config::BundleHugePages, 0,    1 },
+};
+
+// 配置文件中的字符串项
+struct str_option{
+    const char* m_name;
+    char (Config::* m_field)[256];
+};
+
+static const str_option str_options[] = {
+    { "log_file",       &Config::LogFile },
+    { "access_log",     &Config::AccessLogFile },
+    { "capture_file",   &Config::CaptureFile },
+    { "doc_root",       &Config::DocRoot },
+    { "spool_dir",      &Config::SpoolDir },
+    { "bundle_file",    &Config::BundleFile },
+    { "upgrade_socket", &Config::UpgradeSocket },
+};
+
+static void copy_str(char (&dst)[256], const char* src){
+    strncpy(dst, src, sizeof(dst) - 1);
+    dst[sizeof(dst) - 1] = '\0';
+}
+
 Config::Config(){
     PORT = 10000;
     ActorMode = 0;
     TrigMode = 0;
+    LogLevel = 1;
+    LogFile[0] = '\0';
+    AccessLogFile[0] = '\0';
+    CaptureFile[0] = '\0';
+    TraceSample = 0;
+    ConfigFile[0] = '\0';
+    ThreadNum = 8;
+    MaxRequests = 10000;
+    IoThreads = 2;
+    MaxConns = 65536;
+    MaxEvents = 10000;
+    MaxIdleConns = 16384;
+    Backlog = 1024;
+    AcceptBatch = 64;
+    DeferAccept = 1;
+    FastOpen = 0;
+    Timeslot = 5;
+    ConnTimeout = 15;
+    HeaderTimeout = 10;
+    BodyTimeout = 10;
+    MinBodyRate = 1024;
+    SendTimeout = 10;
+    MinSendRate = 1024;
+    ReadBufferSize = 2048;
+    WriteBufferSize = 2048;
+    StreamChunkSize = 16384;
+    copy_str(DocRoot, "/home/yueyue/webserver/resources");
+    MaxBodySize = 64 * 1024 * 1024;
+    copy_str(SpoolDir, "/tmp");
+    BodySplice = 1;
+    MicroCacheEntries = 1024;
+    MicroCacheStaleMs = 1000;
+    MetricsCacheMs = 1000;
+    PathIndex = 1;
+    PathIndexMax = 262144;
+    BundleFile[0] = '\0';
+    BundlePopulate = 1;
+    BundleHugePages = 0;
+    UpgradeSocket[0] = '\0';
+    DrainTimeout = 30;
+    IpRate = 0;
+    IpBurst = 0;
+    IpMaxConns = 0;
+    SubnetRate = 0;
+    SubnetBurst = 0;
+    SubnetMaxConns = 0;
+    SubnetPrefix = 24;
+    RateTableBits = 16;
+    m_argc = 0;
+    m_argv = NULL;
+    m_error[0] = '\0';
+}
+
+bool Config::parse_arg(int argc, char* argv[]){
+    m_argc = argc;
+    m_argv = argv;
+    apply_args();
+    if (ConfigFile[0] == '\0') return true;
+    // 命令行参数优先，读完文件后再应用一次
+    if (!load_file(ConfigFile)) return false;
+    apply_args();
+    return true;
 }
 
-void Config::parse_arg(int argc, char* argv[]){
+bool Config::reload(){
+    Config next;
+    if (!next.parse_arg(m_argc, m_argv))
+    {
+        memcpy(m_error, next.m_error, sizeof(m_error));
+        return false;
+    }
+    *this = next;
+    return true;
+}
+
+bool Config::apply_args(){
     int opt;
-    const char *str = "p:m:a:";
-    while ((opt = getopt(argc, argv, str)) != -1)
+    const char *str = "p:m:a:l:f:A:C:t:c:U:";
+    optind = 0; // 重新加载时需要让 getopt 从头开始
+    while ((opt = getopt(m_argc, m_argv, str)) != -1)
     {
         switch (opt)
         {
@@ -31,8 +185,124 @@ void Config::parse_arg(int argc, char* argv[]){
             ActorMode = atoi(optarg);
             break;
         }
+        case 'l':
+        {
+            LogLevel = atoi(optarg);
+            break;
+        }
+        case 'f':
+        {
+            copy_str(LogFile, optarg);
+            break;
+        }
+        case 't':
+        {
+            TraceSample = atoi(optarg);
+            break;
+        }
+        case 'A':
+        {
+            copy_str(AccessLogFile, optarg);
+            break;
+        }
+        case 'C':
+        {
+            copy_str(CaptureFile, optarg);
+            break;
+        }
+        case 'c':
+        {
+            copy_str(ConfigFile, optarg);
+            break;
+        }
+        case 'U':
+        {
+            copy_str(UpgradeSocket, optarg);
+            break;
+        }
         default:
             break;
         }
     }
-}
\ No newline at end of file
+    return true;
+}
+
+bool Config::set_value(const char* key, const char* value){
+    for (size_t i = 0; i < sizeof(int_options) / sizeof(int_options[0]); ++i)
+    {
+        const int_option& o = int_options[i];
+        if (strcmp(key, o.m_name) != 0) continue;
+        char* end;
+        errno = 0;
+        long v = strtol(value, &end, 10);
+        if (errno != 0 || end == value || *end != '\0' || v < o.m_min || v > o.m_max)
+        {
+            snprintf(m_error, sizeof(m_error), "%s must be an integer in [%d, %d]", key, o.m_min, o.m_max);
+            return false;
+        }
+        this->*o.m_field = v;
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(str_options) / sizeof(str_options[0]); ++i)
+    {
+        const str_option& o = str_options[i];
+        if (strcmp(key, o.m_name) != 0) continue;
+        if (strlen(value) >= sizeof(this->*o.m_field))
+        {
+            snprintf(m_error, sizeof(m_error), "%s is too long", key);
+            return false;
+        }
+        copy_str(this->*o.m_field, value);
+        return true;
+    }
+    snprintf(m_error, sizeof(m_error), "unknown key %s", key);
+    return false;
+}
+
+// 去掉首尾空白，返回新的起始位置
+static char* trim(char* s){
+    while (isspace((unsigned char)*s)) ++s;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) --end;
+    *end = '\0';
+    return s;
+}
+
+bool Config::load_file(const char* path){
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+    {
+        snprintf(m_error, sizeof(m_error), "open %s: %s", path, strerror(errno));
+        return false;
+    }
+    char line[1024];
+    int lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), fp))
+    {
+        ++lineno;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char* text = trim(line);
+        if (*text == '\0') continue;
+
+        char* eq = strchr(text, '=');
+        if (!eq)
+        {
+            snprintf(m_error, sizeof(m_error), "%s:%d: expected key = value", path, lineno);
+            ok = false;
+            break;
+        }
+        *eq = '\0';
+        char* key = trim(text);
+        char* value = trim(eq + 1);
+        if (!set_value(key, value))
+        {
+            std::string reason = m_error;
+            snprintf(m_error, sizeof(m_error), "%s:%d: %s", path, lineno, reason.c_str());
+            ok = false;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
@@ -1,13 +1,20 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-// 用于解析shell的命令行参数
+// 服务器配置：默认值 -> 配置文件（-c）-> 命令行参数，后面的覆盖前面的。
+// 配置文件每行一个 "key = value"，# 开头为注释，可用的 key 见 webserver.conf。
+// 收到 SIGHUP 时重新读取配置文件，标注"可重新加载"的项立即生效，其余项需要重启
 class Config{
 public:
     Config();
     ~Config(){};
 
-    void parse_arg(int argc, char* argv[]);
+    // 解析命令行参数；指定了配置文件时先读取文件，再让命令行参数覆盖文件中的值
+    bool parse_arg(int argc, char* argv[]);
+    // 用启动时的命令行参数重新读取配置文件，失败时保持原值不变
+    bool reload();
+    // 最近一次失败的原因
+    const char* error() const { return m_error; }
 
     int PORT;
 
@@ -16,6 +23,138 @@ public:
 
     // 组合触发模式
     int TrigMode;
+
+    // 日志级别，0:DEBUG 1:INFO 2:WARN 3:ERROR 4:关闭（可重新加载）
+    int LogLevel;
+
+    // 日志文件，为空时输出到标准输出
+    char LogFile[256];
+
+    // 二进制访问日志文件，为空时不记录
+    char AccessLogFile[256];
+
+    // 流量录制文件，为空时不录制，供 tools/replay 回放
+    char CaptureFile[256];
+
+    // 追踪采样率，每 N 个连接追踪一个，0 表示关闭
+    int TraceSample;
+
+    // 配置文件，为空时只使用默认值和命令行参数
+    char ConfigFile[256];
+
+    // 工作线程数（可重新加载）
+    int ThreadNum;
+
+    // 请求队列的最大长度，队列满时新请求被丢弃（可重新加载）
+    int MaxRequests;
+
+    // 预读冷文件的 I/O 线程数，0 表示不预读，不在页缓存中的文件在发送时缺页读盘
+    int IoThreads;
+
+    // 最多同时服务的连接数
+    int MaxConns;
+
+    // 空闲 keep-alive 连接的上限，超出时关闭空闲最久的，0 表示只受 MaxConns 限制（可重新加载）
+    int MaxIdleConns;
+
+    // 每次 epoll_wait 最多返回的事件数
+    int MaxEvents;
+
+    // listen 的全连接队列长度，实际上限受 net.core.somaxconn 限制
+    int Backlog;
+
+    // 每次监听 socket 可读时最多 accept 的连接数（可重新加载）
+    int AcceptBatch;
+
+    // TCP_DEFER_ACCEPT 秒数：连接收到第一段数据后才交给 accept，0 表示关闭
+    int DeferAccept;
+
+    // TCP Fast Open 的队列长度，0 表示关闭
+    int FastOpen;
+
+    // 定时器检查间隔，秒（可重新加载）
+    int Timeslot;
+
+    // 空闲 keep-alive 连接的超时，秒（可重新加载）
+    int ConnTimeout;
+
+    // 以下是请求各阶段的绝对期限，涓流式发送的字节不会延长期限（可重新加载）
+    // 从新连接建立或请求的第一个字节开始，必须在 HeaderTimeout 秒内收全请求头
+    int HeaderTimeout;
+    // 请求体：BodyTimeout 秒的宽限期，之后平均速率不能低于 MinBodyRate 字节/秒，
+    // 速率为 0 时不检查速率，每次收到数据都重新计算宽限期
+    int BodyTimeout;
+    int MinBodyRate;
+    // 发送应答：SendTimeout 秒的宽限期，之后客户端接收的平均速率不能低于 MinSendRate 字节/秒，速率为 0 时同上
+    int SendTimeout;
+    int MinSendRate;
+
+    // 每个连接的读/写缓冲区大小，字节（可重新加载，对之后建立的连接生效）
+    int ReadBufferSize;
+    int WriteBufferSize;
+    // 流式应答每次向处理函数要的数据量，也是每个连接缓存的流式应答数据的上限，字节（可重新加载）
+    int StreamChunkSize;
+
+    // 静态文件的根目录（可重新加载）
+    char DocRoot[256];
+
+    // 请求体的大小上限，字节，超出时返回 413（可重新加载）
+    int MaxBodySize;
+    // 放不进读缓冲区的 POST/PUT 请求体边收边写入这个目录下的匿名临时文件（可重新加载）
+    char SpoolDir[256];
+    // 按 Content-Length 接收、放不进读缓冲区的 POST/PUT 请求体，剩余部分用 splice 从套接字经管道直接写入暂存文件。
+    // 录制流量时不使用
+    int BodySplice;
+
+    // 处理函数应答缓存（MicroCache）最多缓存的应答数，0 表示不缓存（可重新加载）
+    int MicroCacheEntries;
+    // 缓存的应答过期之后还能使用的毫秒数，这段时间内由一个请求重新生成，其余请求使用旧的应答（可重新加载）
+    int MicroCacheStaleMs;
+    // /metrics 的应答缓存的毫秒数，0 表示不缓存
+    int MetricsCacheMs;
+
+    // 启动时建立文档根目录的文件树索引并用 inotify 跟踪变化，不存在的路径不需要 stat 就能返回 404
+    int PathIndex;
+    // 索引最多记录的路径数，超出时不使用索引
+    int PathIndexMax;
+
+    // tools/mkbundle 生成的资源包，为空时不使用。其中的文件直接从内存发送，其余的仍在 DocRoot 中查找
+    char BundleFile[256];
+    // 启动时把资源包全部读入内存
+    int BundlePopulate;
+    // 把资源包放在透明大页中
+    int BundleHugePages;
+
+    // 不停机升级的控制 socket 路径，为空时不启用
+    char UpgradeSocket[256];
+
+    // 交出监听 socket 后等待进行中的请求完成的最长时间，秒（可重新加载）
+    int DrainTimeout;
+
+    // 每个 IP 每秒的请求数和令牌桶容量，0 表示不限制；容量为 0 时等于每秒请求数（可重新加载）
+    int IpRate;
+    int IpBurst;
+    // 每个 IP 的并发连接数上限，0 表示不限制（可重新加载）
+    int IpMaxConns;
+
+    // 同一子网内所有 IP 合计的限制，含义同上（可重新加载）
+    int SubnetRate;
+    int SubnetBurst;
+    int SubnetMaxConns;
+    // 子网掩码长度
+    int SubnetPrefix;
+
+    // 限流哈希表的大小为 2^RateTableBits 项，IP 和子网各一张，冲突的客户端共用一项
+    int RateTableBits;
+
+private:
+    bool apply_args();
+    bool load_file(const char* path);
+    bool set_value(const char* key, const char* value);
+
+    int m_argc;
+    char** m_argv;
+    char m_error[512];
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -0,0 +1,121 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "handoff.h"
+#include "log.h"
+
+const char Handoff::MAGIC[4] = { 'W', 'S', 'L', 'H' };
+
+static bool make_addr(const char* path, sockaddr_un& addr)
+{
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        LOG_ERROR("upgrade socket path %s is too long", path);
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+int Handoff::receive_listener(const char* path)
+{
+    sockaddr_un addr;
+    if (!make_addr(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    // 路径不存在或没有进程在监听，说明这是第一次启动
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    // 旧进程卡住时不能让新进程一直等
+    struct timeval tv = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char magic[sizeof(MAGIC)];
+    struct iovec iov = { magic, sizeof(magic) };
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    close(fd);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != (ssize_t)sizeof(magic) || memcmp(magic, MAGIC, sizeof(magic)) != 0 || !cmsg ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        LOG_ERROR("listener handoff from %s failed (errno %d)", path, errno);
+        return -1;
+    }
+    int listenfd;
+    memcpy(&listenfd, CMSG_DATA(cmsg), sizeof(int));
+
+    int accepting = 0;
+    socklen_t len = sizeof(accepting);
+    if (getsockopt(listenfd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) < 0 || !accepting)
+    {
+        LOG_ERROR("descriptor received from %s is not a listening socket", path);
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+int Handoff::open_control(const char* path)
+{
+    sockaddr_un addr;
+    if (!make_addr(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+    {
+        LOG_ERROR("open upgrade socket %s failed, errno is %d", path, errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool Handoff::send_listener(int controlfd, int listenfd)
+{
+    int fd = accept4(controlfd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return false;
+
+    char magic[sizeof(MAGIC)];
+    memcpy(magic, MAGIC, sizeof(magic));
+    struct iovec iov = { magic, sizeof(magic) };
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &listenfd, sizeof(int));
+
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    close(fd);
+    if (n != (ssize_t)sizeof(magic))
+    {
+        LOG_ERROR("send listener to new process failed, errno is %d", errno);
+        return false;
+    }
+    return true;
+}
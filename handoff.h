@@ -0,0 +1,23 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+// 不停机升级：新进程通过 Unix socket 向正在运行的旧进程要监听 socket（SCM_RIGHTS），
+// 两个进程共享同一个全连接队列，队列中的连接不会丢失。
+// 旧进程交出之后停止 accept，关闭空闲的 keep-alive 连接，处理完进行中的请求后退出。
+// 控制 socket 的路径由配置项 upgrade_socket 指定，为空时不启用
+class Handoff{
+public:
+    // 新进程：连接旧进程并取得监听 socket，没有旧进程或交接失败返回 -1
+    static int receive_listener(const char* path);
+
+    // 创建控制 socket，等待下一次升级。旧进程的控制 socket 在交接后已无用，路径会被覆盖
+    static int open_control(const char* path);
+
+    // 旧进程：控制 socket 可读时调用，把监听 socket 发给连接上来的新进程
+    static bool send_listener(int controlfd, int listenfd);
+
+private:
+    static const char MAGIC[4];
+};
+
+#endif
@@ -1,4 +1,17 @@
 #include "http_conn.h"
+#include "log.h"
+#include "metrics.h"
+#include "access_log.h"
+#include "capture.h"
+#include "transport.h"
+#include "trace.h"
+#include "probes.h"
+#include "rate_limit.h"
+#include "io_pool.h"
+#include "bundle.h"
+#include "path_index.h"
+#include "router.h"
+#include "micro_cache.h"
 
 // 定义HTTP响应的一些信息
 const char* ok_200_title = "OK";
@@ -8,15 +21,70 @@ const char* error_403_title = "Forbidden";
 const char* error_403_form = "You do not have permission to get file from this server.\n";
 const char*error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
+const char* error_405_title = "Method Not Allowed";
+const char* error_405_form = "The requested method is not supported for this resource.\n";
+const char* error_413_title = "Payload Too Large";
+const char* error_413_form = "The request body is larger than the server is willing to accept.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
 
-// 定义服务器的根目录
-const char* doc_root = "/home/yueyue/webserver/resources";
+// 处理函数生成的应答可以使用的状态码
+static const char* status_title(int status)
+{
+    switch (status)
+    {
+        case 200: return ok_200_title;
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 400: return error_400_title;
+        case 403: return error_403_title;
+        case 404: return error_404_title;
+        case 405: return error_405_title;
+        case 409: return "Conflict";
+        case 413: return error_413_title;
+        case 500: return error_500_title;
+        default: return "Unknown";
+    }
+}
 
 //初始化静态成员
 int http_conn::m_user_count = 0;
 int http_conn::m_epollfd = -1;
+std::atomic<uint64_t> http_conn::m_conn_seq(0);
+std::atomic<int> http_conn::m_read_buffer_size(2048);
+std::atomic<int> http_conn::m_write_buffer_size(2048);
+std::atomic<int> http_conn::m_stream_chunk_size(16384);
+std::atomic<const char*> http_conn::m_doc_root("/home/yueyue/webserver/resources");
+std::atomic<int> http_conn::m_max_body_size(64 * 1024 * 1024);
+std::atomic<const char*> http_conn::m_spool_dir("/tmp");
+std::atomic<bool> http_conn::m_draining(false);
+io_pool* http_conn::m_io_pool = NULL;
+bool http_conn::m_splice_body_enabled = false;
+
+void http_conn::set_buffer_size(int read_size, int write_size, int stream_chunk)
+{
+    m_read_buffer_size.store(read_size, std::memory_order_relaxed);
+    m_write_buffer_size.store(write_size, std::memory_order_relaxed);
+    m_stream_chunk_size.store(stream_chunk, std::memory_order_relaxed);
+}
+
+// 旧的根目录不释放，可能还有工作线程正在使用；重新加载很少发生，泄漏的内存可以忽略
+void http_conn::set_doc_root(const char* doc_root)
+{
+    const char* old = m_doc_root.load();
+    if (strcmp(old, doc_root) == 0) return;
+    m_doc_root.store(strdup(doc_root));
+}
+
+// 与 set_doc_root 相同，旧的目录名不释放
+void http_conn::set_body_limits(int max_body_size, const char* spool_dir)
+{
+    m_max_body_size.store(max_body_size, std::memory_order_relaxed);
+    const char* old = m_spool_dir.load();
+    if (strcmp(old, spool_dir) == 0) return;
+    m_spool_dir.store(strdup(spool_dir));
+}
 
 //对文件描述符设置非阻塞
 int setnonblocking(int fd)
@@ -27,7 +95,7 @@ int setnonblocking(int fd)
     return old_option;
 }
 
-// 向epoll中添加需要监听的文件描述符
+// 向epoll中添加需要监听的文件描述符，fd 需要已经是非阻塞的
 void addfd( int epollfd, int fd, bool one_shot, int TRIGMODE) {
     epoll_event event;
     event.data.fd = fd;
@@ -39,14 +107,13 @@ void addfd( int epollfd, int fd, bool one_shot, int TRIGMODE) {
     if(one_shot) // 防止同一个通信被不同的线程处理
         event.events |= EPOLLONESHOT;
     
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);    
-    setnonblocking(fd);
+    transport::current()->poll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
 }
 
 // 从epoll中移除监听的文件描述符
 void removefd( int epollfd, int fd ) {
-    epoll_ctl( epollfd, EPOLL_CTL_DEL, fd, 0 );
-    close(fd);
+    transport::current()->poll_ctl( epollfd, EPOLL_CTL_DEL, fd, 0 );
+    transport::current()->close(fd);
 }
 
 // 修改文件描述符，重置socket上的EPOLLONESHOT事件，以确保下一次可读时，EPOLLIN事件能被触发
@@ -57,7 +124,24 @@ void modfd(int epollfd, int fd, int ev, int TRIGMODE) {
         event.events = ev | EPOLLONESHOT | EPOLLRDHUP | EPOLLET;
     else // LT模式
         event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
-    epoll_ctl( epollfd, EPOLL_CTL_MOD, fd, &event );
+    transport::current()->poll_ctl( epollfd, EPOLL_CTL_MOD, fd, &event );
+}
+
+// 主线程在交给工作线程之前调用，此时连接不在任何工作线程中。
+// 请求头的空行可能紧跟在已解析的位置之前，往前多看 3 个字节
+bool http_conn::request_incomplete() const
+{
+    if (m_read_idx >= m_read_buf_size) return false;
+    if (m_check_state == CHECK_STATE_CONTENT)
+    {
+        if (m_splice_body) return m_body_len < m_content_length;
+        // chunked 的结尾只有解码时才知道，每次读到数据都交给工作线程；
+        // 按长度接收时等到剩余部分到齐或者缓冲区读满，再一次性处理
+        if (m_chunked) return false;
+        return m_read_idx - m_checked_idx < m_content_length - m_body_len;
+    }
+    int from = m_checked_idx >= 3 ? m_checked_idx - 3 : 0;
+    return memmem(m_read_buf + from, m_read_idx - from, "\r\n\r\n", 4) == NULL;
 }
 
 //关闭一个链接, 取消I/O监听，客户数-1
@@ -65,10 +149,20 @@ void http_conn::close_conn()
 {
     if (m_sockfd != -1)
     {
-        printf("close %d\n", m_sockfd);
+        LOG_DEBUG("close %d", m_sockfd);
+        if (m_traced) Trace::instant(TR_CLOSE, m_conn_id);
+        WS_PROBE2(conn_close, m_sockfd, m_conn_id);
+        capture(CAP_CLOSE);
         removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
         m_user_count--;
+        if (m_body_fd >= 0)
+        {
+            close(m_body_fd);
+            m_body_fd = -1;
+        }
+        RateLimit::release_conn(client_ip());
+        Metrics::inc(CNT_CONN_CLOSED);
     }
 }
 
@@ -77,18 +171,47 @@ void http_conn::init(int sockfd, const sockaddr_in& addr, int TRIGMODE )
 {
     m_sockaddr = addr;
     m_sockfd = sockfd;
-    //设置端口复用
-    int reuse = 1;
-    setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    m_conn_id = ++m_conn_seq;
+    m_traced = Trace::sample();
+    WS_PROBE4(conn_accept, sockfd, m_conn_id, addr.sin_addr.s_addr, addr.sin_port);
+    m_capture_seq = 0;
+    capture(CAP_OPEN);
+    m_TRIGMode = TRIGMODE;
+    m_wait_next = false;
+    alloc_buffers();
+    init();
+
     addfd( m_epollfd, sockfd, true, m_TRIGMode ); // 注册读事件
     m_user_count++;
+}
 
-    m_TRIGMode = TRIGMODE;
-
-    init();
+// 配置的大小变化后，连接复用时重新分配
+void http_conn::alloc_buffers()
+{
+    int read_size = m_read_buffer_size.load(std::memory_order_relaxed);
+    int write_size = m_write_buffer_size.load(std::memory_order_relaxed);
+    if (m_read_buf_size != read_size)
+    {
+        delete[] m_read_buf;
+        m_read_buf_size = read_size;
+        // 多一个字节：请求正好填满缓冲区时，末尾仍可以写入结束符
+        m_read_buf = new char[m_read_buf_size + 1];
+    }
+    if (m_write_buf_size != write_size)
+    {
+        delete[] m_write_buf;
+        m_write_buf_size = write_size;
+        m_write_buf = new char[m_write_buf_size];
+    }
 }
 
+// 解析只访问 [0, m_read_idx) 内的数据，每一行都由 parse_line() 写入结束符，不需要清零缓冲区
 void http_conn::init()
+{
+    reset_request();
+}
+
+void http_conn::reset_request()
 {
     m_check_state = CHECK_STATE_REQUESTLINE; //初始化为正在读取请求行
     m_checked_idx = 0;
@@ -98,53 +221,89 @@ void http_conn::init()
 
     //初始化请求行信息
     m_url = 0;
+    m_query = NULL;
+    m_query_len = 0;
     m_version = 0;
     m_method = GET;
 
     //初始化头部信息
     m_host = 0;
+    m_if_none_match = 0;
     m_content_length = 0;
     m_linger = false;
+    m_body_len = 0;
+    m_chunked = false;
+    m_has_length = false;
+    m_body_streaming = false;
+    m_spool_body = false;
+    m_splice_body = false;
+    m_body = 0;
+    if (m_body_fd >= 0)
+    {
+        close(m_body_fd);
+        m_body_fd = -1;
+    }
 
     bytes_to_send = 0;
     bytes_have_send = 0;
+    m_stream = NULL;
+    m_sent_before = 0;
+    m_write_start_ns = 0;
+    m_request_ns = 0;
+    m_req_start_ns = 0;
+    m_status = 0;
 
-    //    
-    int m_state = 0; 
-    int m_finish = 0; 
-    int m_timerflag = 0;
-
-    bzero(m_read_buf, READ_BUFFER_SIZE);
-    bzero(m_write_buf, WRITE_BUFFER_SIZE);
-    bzero(m_real_file, FILENAME_LEN);
+    m_file_address = 0;
+    m_file_mapped = false;
+    m_cold_fd = -1;
+    m_content_type = "text/html";
+    m_bundle = NULL;
+    m_route = NULL;
 }
 
 //一次性将所有socketfd中的数据读取到m_read_buf缓冲区中
 bool http_conn::read()
 {
     // 如果当前需要读取的下一个字节的偏移量已经超过缓冲区大小，返回 false
-    if (m_read_idx > READ_BUFFER_SIZE) return false;
+    if (m_read_idx > m_read_buf_size) return false;
+    if (m_splice_body) return splice_body();
+    // 缓冲区已满（接收请求体时）：先交给工作线程处理，腾出空间后再读，剩余的数据留在套接字中
+    if (m_read_idx == m_read_buf_size) return true;
 
     int bytes_read = 0;
+    if (m_read_idx == 0)
+    {
+        m_req_start_ns = Metrics::now_ns();
+        WS_PROBE2(request_start, m_sockfd, m_conn_id);
+    }
     //LT读取数据
     if (m_TRIGMode == 0)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
-
+        uint64_t start = m_traced ? Metrics::now_ns() : 0;
+        bytes_read = transport::current()->recv(m_sockfd, m_read_buf + m_read_idx, m_read_buf_size - m_read_idx);
+        if (m_traced) Trace::span(TR_READ, m_conn_id, start, Metrics::now_ns(), bytes_read);
+        if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true; // 虚假的可读事件，继续等待
+        }
         if (bytes_read <= 0)
         {
             return false;
         }
+        m_read_idx += bytes_read;
+        Metrics::inc(CNT_BYTES_READ, bytes_read);
+        capture(CAP_DATA, m_read_buf + m_read_idx - bytes_read, bytes_read);
 
         return true;
     }
     //ET读数据
     else
     {
-        while (true)
+        while (m_read_idx < m_read_buf_size)
         {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            uint64_t start = m_traced ? Metrics::now_ns() : 0;
+            bytes_read = transport::current()->recv(m_sockfd, m_read_buf + m_read_idx, m_read_buf_size - m_read_idx);
+            if (m_traced) Trace::span(TR_READ, m_conn_id, start, Metrics::now_ns(), bytes_read);
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -155,7 +314,9 @@ bool http_conn::read()
             {
                 return false; // 对方断开了连接
             }
+            capture(CAP_DATA, m_read_buf + m_read_idx, bytes_read);
             m_read_idx += bytes_read;
+            Metrics::inc(CNT_BYTES_READ, bytes_read);
         }
         return true;
     }
@@ -205,6 +366,16 @@ http_conn::HTTP_CODE http_conn :: parse_request_line( char* text ){
     char* method = text;
     if ( strcasecmp(method, "GET") == 0 ) { // 忽略大小写比较
         m_method = GET;
+    } else if ( strcasecmp(method, "HEAD") == 0 ) {
+        m_method = HEAD;
+    } else if ( strcasecmp(method, "POST") == 0 ) {
+        m_method = POST;
+    } else if ( strcasecmp(method, "PUT") == 0 ) {
+        m_method = PUT;
+    } else if ( strcasecmp(method, "DELETE") == 0 ) {
+        m_method = DELETE;
+    } else if ( strcasecmp(method, "OPTIONS") == 0 ) {
+        m_method = OPTIONS;
     } else {
         return BAD_REQUEST;
     }
@@ -226,21 +397,99 @@ http_conn::HTTP_CODE http_conn :: parse_request_line( char* text ){
         // 在参数 str 所指向的字符串中搜索第一次出现字符 c（一个无符号字符）的位置。
         m_url = strchr( m_url, '/' );
     }
+    // OPTIONS * 询问服务器本身支持的方法，不对应任何路径
+    if ( m_method == OPTIONS && m_url && strcmp( m_url, "*" ) == 0 ) {
+        m_check_state = CHECK_STATE_HEADER;
+        return NO_REQUEST;
+    }
     if ( !m_url || m_url[0] != '/' ) {
         return BAD_REQUEST;
     }
+    // 查询串原样保留给处理函数（不解码），只规范化路径。片段本不应该发给服务器，直接去掉
+    char* fragment = strchr( m_url, '#' );
+    if ( fragment ) *fragment = '\0';
+    char* query = strchr( m_url, '?' );
+    if ( query ) {
+        *query++ = '\0';
+        m_query = query;
+        m_query_len = strlen( query );
+    }
+    if ( !normalize_url( m_url ) ) {
+        return BAD_REQUEST;
+    }
     m_check_state = CHECK_STATE_HEADER; // 检查状态变成检查头
     return NO_REQUEST; // 请求数据不完整，还需要继续获取客户端数据
 }
 
+static int hex_value(char c){
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 一遍扫描完成：遇到查询串和片段时结束（调用者已经把它们分出去），解码 %XX，合并连续的 '/'，去掉 "." 段，".." 段删除前一段。
+// 结果不会比原串长，直接写回请求缓冲区。".." 越过根目录、%XX 不合法或解码出 '\0' 时返回 false。
+// %2F 解码后与 '/' 一样作为分隔符处理，结果中不会再出现 "." 和 ".." 段
+bool http_conn::normalize_url( char* url ){
+    char* out = url + 1; // url[0] 一定是 '/'
+    const char* in = url + 1;
+    while (true)
+    {
+        char c = *in;
+        bool end = c == '\0' || c == '?' || c == '#';
+        if (c == '%' && !end)
+        {
+            int hi = hex_value(in[1]);
+            int lo = hex_value(in[2]);
+            if (hi < 0 || lo < 0) return false;
+            c = (char)(hi << 4 | lo);
+            if (c == '\0') return false;
+            in += 3;
+        }
+        else if (!end)
+        {
+            in++;
+        }
+        if (end || c == '/')
+        {
+            // 当前段是 out 中最后一个 '/' 之后的部分
+            char* seg = out;
+            while (seg[-1] != '/') seg--;
+            int seg_len = out - seg;
+            if (seg_len == 1 && seg[0] == '.')
+            {
+                out = seg;
+            }
+            else if (seg_len == 2 && seg[0] == '.' && seg[1] == '.')
+            {
+                if (seg - 1 == url) return false;
+                out = seg - 1;
+                while (out[-1] != '/') out--;
+            }
+            else if (seg_len > 0 && !end)
+            {
+                *out++ = '/';
+            }
+            if (end) break;
+            continue;
+        }
+        *out++ = c;
+    }
+    *out = '\0';
+    return true;
+}
+
 http_conn::HTTP_CODE http_conn :: parse_headers( char* text ){
     if (text[0] == '\0') //如果遇到空行，说明头部解析完毕
     {
-        //如果body部分有内容，则需要将当前状态改为解析body，并返回headers的解析结果
-        if (m_content_length != 0)
+        // 先确定由哪个处理函数处理，不支持的方法不必接收请求体
+        HTTP_CODE ret = route_request();
+        if (ret != NO_REQUEST) return ret;
+        //如果有请求体，则需要将当前状态改为解析body，并返回headers的解析结果
+        if (m_chunked || m_content_length != 0)
         {
-            m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST; //未解析完
+            return begin_body();
         }
         return GET_REQUEST; //如果没有body，返回已经解析完
     }
@@ -257,7 +506,24 @@ http_conn::HTTP_CODE http_conn :: parse_headers( char* text ){
     {
         text += 15;
         text += strspn(text, " \t");
-        m_content_length = atol(text); //将char转化为long
+        // 只接受十进制数字，负数、溢出和多余的字符都可能让前后两方对请求的边界理解不一致
+        if (text[0] < '0' || text[0] > '9') return BAD_REQUEST;
+        char* end;
+        errno = 0;
+        int64_t length = strtoll(text, &end, 10);
+        if (errno == ERANGE || end[strspn(end, " \t")] != '\0') return BAD_REQUEST;
+        // 重复的 Content-Length 只有值相同时才接受（RFC 9112 6.3），否则无法确定以哪个为准
+        if (m_has_length && length != m_content_length) return BAD_REQUEST;
+        m_content_length = length;
+        m_has_length = true;
+    }
+    else if (strncasecmp(text, "Transfer-Encoding:", 18) == 0)
+    {
+        text += 18;
+        text += strspn(text, " \t");
+        // 只支持 chunked，其余编码无法确定请求体在哪里结束
+        if (strncasecmp(text, "chunked", 7) != 0 || text[7 + strspn(text + 7, " \t")] != '\0') return BAD_REQUEST;
+        m_chunked = true;
     }
     else if (strncasecmp(text, "Host:", 5) == 0)
     {
@@ -265,18 +531,257 @@ http_conn::HTTP_CODE http_conn :: parse_headers( char* text ){
         text += strspn(text, " \t");
         m_host = text; //将char转化为long
     }
-    else printf("oop! unknow header %s\n", text);
+    else if (strncasecmp(text, "If-None-Match:", 14) == 0)
+    {
+        text += 14;
+        text += strspn(text, " \t");
+        m_if_none_match = text;
+    }
+    else LOG_DEBUG("oop! unknow header %s", text);
+    return NO_REQUEST;
+}
+
+// 路径上的路由都不支持该方法时返回 405，Allow 中列出它们支持的方法。OPTIONS 不调用处理函数
+http_conn::HTTP_CODE http_conn::route_request()
+{
+    const unsigned OPTIONS_BIT = ROUTE_METHOD(OPTIONS);
+    if (m_method == OPTIONS && strcmp(m_url, "*") == 0)
+    {
+        m_allow = Router::methods() | OPTIONS_BIT;
+        return OPTIONS_REQUEST;
+    }
+    const route* r = Router::match(m_url, strlen(m_url), m_params);
+    if (!r) return NO_RESOURCE;
+    unsigned allow = OPTIONS_BIT;
+    for (; r; r = Router::next(r))
+    {
+        if (r->m_methods & ROUTE_METHOD(m_method)) m_route = r;
+        allow |= r->m_methods;
+    }
+    m_allow = allow;
+    if (m_method == OPTIONS) return OPTIONS_REQUEST;
+    return m_route ? NO_REQUEST : NOT_ALLOWED;
+}
+
+// 请求头之后至少要留出这么多空间接收请求体，chunked 的块大小行也不能超过它
+static const int MIN_BODY_ROOM = 256;
+
+// 请求头解析完毕。能整个放进读缓冲区的请求体留在缓冲区中，否则边收边处理：
+// 每次把收到的部分写入暂存文件（POST/PUT）或丢弃，再把未处理的数据移回请求头之后，
+// 请求体再大占用的内存也只有读缓冲区
+http_conn::HTTP_CODE http_conn::begin_body()
+{
+    // 同时出现时（即使 Content-Length 为 0）前面的代理可能按 Content-Length 切分，无法确定请求的边界（RFC 9112 6.1）
+    if (m_chunked && m_has_length) return BAD_REQUEST;
+    if (m_content_length > m_max_body_size.load(std::memory_order_relaxed)) return TOO_LARGE;
+    m_check_state = CHECK_STATE_CONTENT;
+    m_body_start = m_checked_idx;
+    m_body_streaming = m_chunked || m_content_length > m_read_buf_size - m_body_start;
+    m_spool_body = m_method == POST || m_method == PUT;
+    m_chunk_state = CHUNK_SIZE;
+    if (m_body_streaming && m_read_buf_size - m_body_start < MIN_BODY_ROOM) return BAD_REQUEST;
     return NO_REQUEST;
 }
 
-http_conn::HTTP_CODE http_conn :: parse_content( char* text ){
-    if (m_checked_idx + m_content_length <= m_read_idx)
+// 请求体暂存在已经删除的文件中，连接关闭或请求结束时自动释放。
+// 文件系统不支持 O_TMPFILE 时创建后立即删除
+static int open_spool(const char* dir)
+{
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) return fd;
+    char path[http_conn::FILENAME_LEN];
+    snprintf(path, sizeof(path), "%s/ws-body-XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) unlink(path);
+    return fd;
+}
+
+bool http_conn::open_body_file(){
+    if (m_body_fd >= 0) return true;
+    m_body_fd = open_spool(m_spool_dir.load(std::memory_order_acquire));
+    if (m_body_fd < 0) LOG_ERROR("create body spool file failed, errno is %d", errno);
+    return m_body_fd >= 0;
+}
+
+http_conn::HTTP_CODE http_conn::consume_body( const char* data, int len ){
+    if (m_body_len + len > m_max_body_size.load(std::memory_order_relaxed)) return TOO_LARGE;
+    m_body_len += len;
+    if (!m_spool_body) return NO_REQUEST;
+    if (!open_body_file()) return INTERNAL_ERROR;
+    while (len > 0)
     {
-        text[m_content_length] = '\0';
+        ssize_t n = ::write(m_body_fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0)
+        {
+            LOG_ERROR("write body spool file failed, errno is %d", errno);
+            return INTERNAL_ERROR;
+        }
+        data += n;
+        len -= n;
+    }
+    return NO_REQUEST;
+}
+
+void http_conn::compact_body(){
+    int left = m_read_idx - m_checked_idx;
+    if (m_checked_idx == m_body_start) return;
+    memmove(m_read_buf + m_body_start, m_read_buf + m_checked_idx, left);
+    m_checked_idx = m_body_start;
+    m_start_line = m_body_start;
+    m_read_idx = m_body_start + left;
+}
+
+http_conn::HTTP_CODE http_conn::parse_content(){
+    if (m_chunked) return parse_chunked();
+    int avail = m_read_idx - m_checked_idx;
+    int64_t left = m_content_length - m_body_len;
+    if (!m_body_streaming)
+    {
+        if (avail < left) return NO_REQUEST;
+        m_body = m_read_buf + m_checked_idx;
+        m_body_len = m_content_length;
+        m_checked_idx += m_content_length; // 跳过请求体，后面可能是流水线中的下一个请求
         return GET_REQUEST;
     }
-    //否则，说明缓冲区中的报文不完整
-    else return NO_REQUEST;
+    int n = avail < left ? avail : (int)left;
+    HTTP_CODE ret = consume_body(m_read_buf + m_checked_idx, n);
+    if (ret != NO_REQUEST) return ret;
+    m_checked_idx += n;
+    if (m_body_len == m_content_length) return GET_REQUEST;
+    compact_body();
+    // 缓冲区中的部分已经写入暂存文件，剩余部分不再经过读缓冲区
+    if (m_spool_body && m_splice_body_enabled && !m_splice_body)
+    {
+        if (!open_body_file()) return INTERNAL_ERROR;
+        m_splice_body = true;
+    }
+    return NO_REQUEST;
+}
+
+// 每一步最多搬运的字节数，也是管道的容量
+static const int SPLICE_STEP = 64 * 1024;
+// ET 模式下一次可读事件最多搬运的字节数，超过后重新注册 EPOLLIN，让其它连接也能得到处理
+static const int SPLICE_BUDGET = 1024 * 1024;
+
+// 每个线程一个管道，每一步结束时管道都是空的，不需要每个连接占用两个描述符
+static thread_local int t_pipe[2] = { -1, -1 };
+
+static bool splice_pipe()
+{
+    if (t_pipe[0] >= 0) return true;
+    if (pipe2(t_pipe, O_CLOEXEC | O_NONBLOCK) < 0) return false;
+    fcntl(t_pipe[1], F_SETPIPE_SZ, SPLICE_STEP);
+    return true;
+}
+
+// 出错后管道中可能留有数据，关闭后下次重新创建
+static void drop_pipe()
+{
+    close(t_pipe[0]);
+    close(t_pipe[1]);
+    t_pipe[0] = t_pipe[1] = -1;
+}
+
+// 套接字 -> 管道 -> 暂存文件，数据不复制到用户态。每次只读到请求体结束为止，
+// 流水线中的下一个请求留在套接字中。LT 模式每个事件搬运一步，ET 模式搬运到 EAGAIN 或用完 SPLICE_BUDGET，
+// 两种情况下调用者都会重新注册 EPOLLIN。返回 false 时关闭连接
+bool http_conn::splice_body()
+{
+    if (!splice_pipe())
+    {
+        LOG_ERROR("create splice pipe failed, errno is %d", errno);
+        return false;
+    }
+    int budget = m_TRIGMode == 0 ? SPLICE_STEP : SPLICE_BUDGET;
+    while (m_body_len < m_content_length && budget > 0)
+    {
+        int64_t left = m_content_length - m_body_len;
+        size_t want = left < SPLICE_STEP ? left : SPLICE_STEP;
+        ssize_t n = splice(m_sockfd, NULL, t_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return false; // 对方断开或出错
+        for (ssize_t done = 0; done < n; )
+        {
+            ssize_t m = splice(t_pipe[0], NULL, m_body_fd, NULL, n - done, SPLICE_F_MOVE);
+            if (m < 0 && errno == EINTR) continue;
+            if (m <= 0)
+            {
+                LOG_ERROR("splice to body spool file failed, errno is %d", errno);
+                drop_pipe();
+                return false;
+            }
+            done += m;
+        }
+        m_body_len += n;
+        budget -= n;
+        Metrics::inc(CNT_BYTES_READ, n);
+    }
+    return true;
+}
+
+// chunked 解码：块大小行（十六进制，可以带 ;扩展）、块数据、\r\n，大小为 0 的块之后是 trailer，以空行结束。
+// trailer 中的头部忽略
+http_conn::HTTP_CODE http_conn::parse_chunked(){
+    while (true)
+    {
+        char* p = m_read_buf + m_checked_idx;
+        int avail = m_read_idx - m_checked_idx;
+        if (m_chunk_state == CHUNK_DATA)
+        {
+            if (avail == 0) break;
+            int n = avail < m_chunk_left ? avail : (int)m_chunk_left;
+            HTTP_CODE ret = consume_body(p, n);
+            if (ret != NO_REQUEST) return ret;
+            m_checked_idx += n;
+            m_chunk_left -= n;
+            if (m_chunk_left == 0) m_chunk_state = CHUNK_DATA_END;
+            continue;
+        }
+        if (m_chunk_state == CHUNK_DATA_END)
+        {
+            if (avail < 2) break;
+            if (p[0] != '\r' || p[1] != '\n') return BAD_REQUEST;
+            m_checked_idx += 2;
+            m_chunk_state = CHUNK_SIZE;
+            continue;
+        }
+        char* nl = (char*)memchr(p, '\n', avail);
+        if (!nl)
+        {
+            if (avail >= MIN_BODY_ROOM) return BAD_REQUEST;
+            break;
+        }
+        int len = nl - p;
+        if (len == 0 || p[len - 1] != '\r') return BAD_REQUEST;
+        len--;
+        m_checked_idx += nl - p + 1;
+        if (m_chunk_state == CHUNK_TRAILER)
+        {
+            if (len == 0) return GET_REQUEST;
+            continue;
+        }
+        int64_t size = 0;
+        int i = 0;
+        for (; i < len && hex_value(p[i]) >= 0; i++)
+        {
+            if (i >= 15) return BAD_REQUEST; // 超过 60 位，早已超过 max_body_size
+            size = size << 4 | hex_value(p[i]);
+        }
+        if (i == 0 || (i < len && p[i] != ';' && p[i] != ' ' && p[i] != '\t')) return BAD_REQUEST;
+        if (size == 0)
+        {
+            m_chunk_state = CHUNK_TRAILER;
+        }
+        else
+        {
+            m_chunk_left = size;
+            m_chunk_state = CHUNK_DATA;
+        }
+    }
+    compact_body();
+    return NO_REQUEST;
 }
 
 //主状态机，解析请求
@@ -284,11 +789,23 @@ http_conn::HTTP_CODE http_conn::process_read(){
     LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
     char* text = 0;
-    while(((m_check_state == CHECK_STATE_CONTENT) && line_status == LINE_OK) || ((line_status = parse_line()) == LINE_OK))
+    while (true)
     {
+        // 请求体不按行解析
+        if (m_check_state == CHECK_STATE_CONTENT)
+        {
+            ret = parse_content();
+            break;
+        }
+        if ((line_status = parse_line()) != LINE_OK)
+        {
+            // 缓冲区已满仍没有读完请求头
+            if (m_read_idx >= m_read_buf_size) ret = BAD_REQUEST;
+            break;
+        }
         text = get_line(); //获取一行数据
         m_start_line = m_checked_idx;
-        printf("got 1 http line : %s\n", text);
+        LOG_DEBUG("got 1 http line : %s", text);
 
         switch ( m_check_state ) //以下内容没有考虑所有情况，简单版本
         {
@@ -299,22 +816,75 @@ http_conn::HTTP_CODE http_conn::process_read(){
             }
             case CHECK_STATE_HEADER:{
                 ret = parse_headers( text );
-                if (ret == BAD_REQUEST) return BAD_REQUEST;
-                else if (ret == GET_REQUEST) return do_request(); //如果获取到了完整的客户端请求，解析具体请求信息
-                break;
-            }
-            case CHECK_STATE_CONTENT:{
-                ret = parse_content( text ); // 用于解析POST请求 
-                if (ret == GET_REQUEST) return do_request();
-                line_status = LINE_OPEN; // 解析完消息体即完成报文解析，防止再次进入循环
                 break;
             }
             default:{
                 return INTERNAL_ERROR;
             }
         }
+        if (ret != NO_REQUEST) break;
     }
-    return NO_REQUEST;
+    if (ret == GET_REQUEST) return timed_request(); //如果获取到了完整的客户端请求，交给路由的处理函数
+    // 请求头或请求体有错，或者没有接收请求体就应答时，无法确定下一个请求从哪里开始，应答后关闭连接
+    if (ret != NO_REQUEST &&
+        (ret == BAD_REQUEST || ret == TOO_LARGE || ret == INTERNAL_ERROR || m_chunked || m_content_length != 0))
+    {
+        m_linger = false;
+    }
+    return ret;
+}
+
+// 调用处理函数并记录耗时
+http_conn::HTTP_CODE http_conn::timed_request()
+{
+    uint64_t start = Metrics::now_ns();
+    HTTP_CODE ret = m_route->m_cache_ms > 0 && (m_method == GET || m_method == HEAD) ?
+        cached_request() : m_route->m_handler(*this);
+    uint64_t end = Metrics::now_ns();
+    m_request_ns = end - start;
+    if (m_traced) Trace::span(TR_REQUEST, m_conn_id, start, end, ret);
+    return ret;
+}
+
+// 缓存的键：方法、是否来自本机（处理函数可能按它返回 403）、Host、规范化之后的路径和查询串
+static thread_local std::string t_cache_key;
+
+// 命中时把缓存的应答复制到连接自己的缓冲区，之后的发送与处理函数生成的应答相同
+http_conn::HTTP_CODE http_conn::cached_request()
+{
+    std::string& key = t_cache_key;
+    key.assign(1, (char)('0' + m_method));
+    key += from_loopback() ? 'L' : 'R';
+    key += m_host ? m_host : "";
+    key += ' ';
+    key += m_url;
+    if (m_query)
+    {
+        key += '?';
+        key.append(m_query, m_query_len);
+    }
+
+    std::shared_ptr<const cache_value> value;
+    MicroCache::RESULT r = MicroCache::lookup(key, value);
+    if (r == MicroCache::CACHE_HIT)
+    {
+        begin_reply().assign(value->m_body);
+        return reply(value->m_status, value->m_type);
+    }
+    HTTP_CODE ret = m_route->m_handler(*this);
+    if (r == MicroCache::CACHE_FILL)
+    {
+        std::shared_ptr<cache_value> fresh;
+        if (ret == DYNAMIC_REQUEST)
+        {
+            fresh = std::make_shared<cache_value>();
+            fresh->m_body = m_dynamic;
+            fresh->m_type = m_content_type;
+            fresh->m_status = m_reply_status;
+        }
+        MicroCache::fill(key, m_route->m_cache_ms, fresh);
+    }
+    return ret;
 }
 
 // 如果得到了一个完整的，正确的HTTP请求，则分析目标文件的属性
@@ -322,10 +892,26 @@ http_conn::HTTP_CODE http_conn::process_read(){
 // 则使用mmap将其映射到内存地址m_file_address处，并告知调用者获取文件成功(FILE_REQUEST)
 http_conn::HTTP_CODE http_conn::do_request()
 {
+    int url_len = strlen(m_url);
+    // 资源包中的文件直接从内存发送，不访问文件系统
+    if (Bundle::loaded())
+    {
+        const bundle_entry* e = Bundle::find(m_url, url_len);
+        if (e) return bundle_request(e);
+    }
+    // 文件树索引中没有的路径直接返回 404
+    if (PathIndex::lookup(m_url, url_len) == PathIndex::PATH_MISSING)
+    {
+        return NO_RESOURCE;
+    }
+
     //m_real_file = "/home/yueyue/webserver/resources" + "/index.html"
-    strcpy(m_real_file, doc_root);
+    const char* doc_root = m_doc_root.load(std::memory_order_acquire);
     int len = strlen( doc_root );
-    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1); //strncpy(dest, src, n) 最多有n个src中的字符被复制了
+    // 拼接后放不下的路径不截断（截断后可能指向另一个文件），当作不存在
+    if (len + url_len >= FILENAME_LEN) return NO_RESOURCE;
+    memcpy(m_real_file, doc_root, len);
+    memcpy(m_real_file + len, m_url, url_len + 1);
 
     //stat函数获取m_real_file文件的统计信息，并传给m_file_stat。成功返回0，失败返回-1
     if ( stat(m_real_file, &m_file_stat) < 0) 
@@ -345,24 +931,177 @@ http_conn::HTTP_CODE http_conn::do_request()
         return BAD_REQUEST;
     }
 
+    // HEAD 只需要文件大小
+    if (m_method == HEAD) return FILE_REQUEST;
+
     //以只读方式打开文件，将文件映射到内存中
     int fd = open(m_real_file, O_RDONLY);
     m_file_address = (char*)mmap(NULL, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    m_file_mapped = true;
+    // 文件不完全在页缓存中时，发送前先交给 I/O 线程读入，避免在 writev 中缺页阻塞
+    if (m_io_pool && m_file_address != MAP_FAILED && !io_pool::resident(m_file_address, m_file_stat.st_size))
+    {
+        m_cold_fd = fd;
+    }
+    else
+    {
+        close(fd);
+    }
     return FILE_REQUEST; //获取文件成功
 }
 
+void http_conn::init_routes(int metrics_cache_ms)
+{
+    if (Router::compiled()) return;
+    Router::add(ROUTE_GET, "/metrics", serve_metrics, metrics_cache_ms);
+    Router::add(ROUTE_GET, "/debug/trace", serve_trace);
+    Router::add(ROUTE_GET, "/healthz", serve_health);
+    Router::add(ROUTE_GET, "/*path", serve_file);
+    Router::compile();
+}
+
+const char* http_conn::param( const char* name, size_t* len ) const
+{
+    for (int i = 0; i < m_params.m_count; ++i)
+    {
+        if (m_route->m_params[i] == name)
+        {
+            *len = m_params.m_len[i];
+            return m_url + m_params.m_off[i];
+        }
+    }
+    return NULL;
+}
+
+http_conn::HTTP_CODE http_conn::reply( int status, const char* content_type )
+{
+    m_reply_status = status;
+    m_content_type = content_type;
+    m_file_address = m_dynamic.empty() ? NULL : &m_dynamic[0];
+    m_file_stat.st_size = m_dynamic.size();
+    return DYNAMIC_REQUEST;
+}
+
+http_conn::HTTP_CODE http_conn::reply_stream( int status, const char* content_type, stream_producer producer )
+{
+    m_reply_status = status;
+    m_content_type = content_type;
+    m_stream = producer;
+    memset(&m_cursor, 0, sizeof(m_cursor));
+    return STREAM_REQUEST;
+}
+
+// 块大小固定写成 8 位十六进制（允许前导 0），先占位再回填，生成的数据直接追加在后面不需要移动。
+// 生成函数结束（或者没有生成数据）时在同一块后面加上结尾的 0 块
+void http_conn::next_chunk()
+{
+    m_dynamic.assign("00000000\r\n");
+    bool more = m_stream(*this, m_cursor, m_dynamic, m_stream_chunk_size.load(std::memory_order_relaxed));
+    m_cursor.m_calls++;
+    size_t n = m_dynamic.size() - 10;
+    if (n > 0)
+    {
+        char size[16];
+        snprintf(size, sizeof(size), "%08x", (unsigned)n);
+        memcpy(&m_dynamic[0], size, 8);
+        m_dynamic.append("\r\n");
+    }
+    else
+    {
+        m_dynamic.clear();
+    }
+    if (!more || n == 0)
+    {
+        m_dynamic.append("0\r\n\r\n");
+        m_stream = NULL;
+    }
+    m_file_address = &m_dynamic[0];
+    m_iv[1].iov_base = m_file_address;
+    m_iv[1].iov_len = m_dynamic.size();
+    m_iv_count = 2;
+    bytes_to_send += m_dynamic.size();
+}
+
+http_conn::HTTP_CODE http_conn::serve_file( http_conn& conn )
+{
+    return conn.do_request();
+}
+
+// 以 Prometheus 文本格式输出服务器指标，只允许本机访问
+http_conn::HTTP_CODE http_conn::serve_metrics( http_conn& conn )
+{
+    if (!conn.from_loopback())
+    {
+        return FORBIDDEN_REQUEST;
+    }
+    Metrics::render(conn.begin_reply());
+    return conn.reply(200, "text/plain; version=0.0.4");
+}
+
+// 存活检查，负载均衡器用来判断进程是否还能处理请求
+http_conn::HTTP_CODE http_conn::serve_health( http_conn& conn )
+{
+    conn.begin_reply().append("ok\n");
+    return conn.reply(200, "text/plain");
+}
+
+// 资源包常驻内存，不需要 munmap。If-None-Match 可能是用逗号分隔的多个 ETag 或 *，
+// 资源包中的 ETag 带引号，在其中查找即可（弱比较，忽略 W/ 前缀）
+http_conn::HTTP_CODE http_conn::bundle_request( const bundle_entry* e )
+{
+    m_bundle = e;
+    if (m_if_none_match)
+    {
+        if (strcmp(m_if_none_match, "*") == 0 ||
+            memmem(m_if_none_match, strlen(m_if_none_match), Bundle::at(e->m_etag_off), e->m_etag_len))
+        {
+            return NOT_MODIFIED;
+        }
+    }
+    m_file_address = (char*)Bundle::at(e->m_data_off);
+    m_file_stat.st_size = e->m_data_len;
+    return FILE_REQUEST;
+}
+
+// 以 Chrome trace-event JSON 导出追踪记录，只允许本机访问
+http_conn::HTTP_CODE http_conn::serve_trace( http_conn& conn )
+{
+    if (!conn.from_loopback())
+    {
+        return FORBIDDEN_REQUEST;
+    }
+    if (!Trace::enabled())
+    {
+        return NO_RESOURCE;
+    }
+    return conn.reply_stream(200, "application/json", stream_trace);
+}
+
+// 记录可能有上百万条，分块导出，不需要一次生成整个 JSON
+bool http_conn::stream_trace( http_conn& conn, stream_cursor& cursor, std::string& out, size_t budget )
+{
+    if (cursor.m_calls == 0)
+    {
+        Trace::dump_begin(out, cursor.m_pos, cursor.m_end);
+    }
+    cursor.m_pos = Trace::dump_records(out, cursor.m_pos, cursor.m_end, budget);
+    if (cursor.m_pos < cursor.m_end) return true;
+    Trace::dump_end(out);
+    return false;
+}
+
 void http_conn::unmap(){
-    if ( m_file_address ){
+    if ( m_file_address && m_file_mapped ){
         munmap( m_file_address, m_file_stat.st_size );
-        m_file_address = 0;
     }
+    m_file_address = 0;
+    m_file_mapped = false;
 }
 
 //将要添加的内容写入到write_buf中
 bool http_conn::add_response( const char* format, ... ){
     //如果写入内容超出m_write_buf大小则报错
-    if (m_write_idx >= WRITE_BUFFER_SIZE) return false;
+    if (m_write_idx >= m_write_buf_size) return false;
 
     //定义可变参数列表
     va_list arg_list; 
@@ -371,10 +1110,10 @@ bool http_conn::add_response( const char* format, ... ){
     va_start( arg_list, format );
 
     //将数据format从可变参数列表写入写缓冲区，返回写入数据的长度
-    int len = vsnprintf( m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - m_write_idx - 1, format, arg_list);
+    int len = vsnprintf( m_write_buf + m_write_idx, m_write_buf_size - m_write_idx - 1, format, arg_list);
     
     //如果写入的数据长度超过缓冲区剩余空间，则报错
-    if (len >= (WRITE_BUFFER_SIZE - m_write_idx - 1)){
+    if (len >= (m_write_buf_size - m_write_idx - 1)){
         return false;
     }
     //更新m_write_idx位置
@@ -400,20 +1139,40 @@ bool http_conn::add_content_length( int content_length ){
     return add_response("Content-length: %d\r\n", content_length);
 }
 
+bool http_conn::add_bundle_headers(){
+    return add_response("%.*s", (int)m_bundle->m_head_len, Bundle::at(m_bundle->m_head_off)) &&
+    add_linger() && add_blank_line();
+}
 bool http_conn::add_content_type(){
-    return add_response("Content-Type: %s\r\n", "text/html");
+    return add_response("Content-Type: %s\r\n", m_content_type);
 }
 
 bool http_conn::add_linger(){
+    // 进程即将退出，发完这个应答就关闭连接，客户端会重新连接到新进程
+    if (m_draining.load(std::memory_order_relaxed)) m_linger = false;
     return add_response("Connection: %s\r\n", (m_linger == true) ? "keep-alive":"close");
 }
 
+bool http_conn::add_allow(){
+    static const char* names[] = { "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT" };
+    if (!add_response("%s", "Allow:")) return false;
+    const char* sep = " ";
+    for (int m = 0; m < (int)(sizeof(names) / sizeof(names[0])); ++m)
+    {
+        if (!(m_allow & ROUTE_METHOD(m))) continue;
+        if (!add_response("%s%s", sep, names[m])) return false;
+        sep = ", ";
+    }
+    return add_response("%s", "\r\n");
+}
+
 bool http_conn::add_blank_line(){
     return add_response("%s", "\r\n");
 }
 
-//帮助打印错误信息
+//帮助打印错误信息，HEAD 请求的应答没有消息体
 bool http_conn::add_content( const char* content ){
+    if (m_method == HEAD) return true;
     return add_response("%s", content);
 }
 
@@ -425,6 +1184,8 @@ bool http_conn::process_write(HTTP_CODE ret)
     switch(ret)
     {
         case INTERNAL_ERROR:{
+            m_status = 500;
+            Metrics::count_status(500);
             add_status_line( 500, error_500_title );
             add_headers( strlen( error_500_form ));
             if (!add_content( error_500_form ))
@@ -434,12 +1195,16 @@ bool http_conn::process_write(HTTP_CODE ret)
             break;
         }
         case NO_RESOURCE:{
+            m_status = 404;
+            Metrics::count_status(404);
             add_status_line( 404, error_404_title );
             add_headers( strlen( error_404_form ));
             if (! add_content( error_404_form )) return false;
             break;
         }
         case BAD_REQUEST:{
+            m_status = 400;
+            Metrics::count_status(400);
             add_status_line( 400, error_400_title );
             add_headers( strlen( error_400_form ));
             if (!add_content( error_400_form ))
@@ -448,7 +1213,42 @@ bool http_conn::process_write(HTTP_CODE ret)
             }
             break;
         }
+        case NOT_ALLOWED:{
+            m_status = 405;
+            Metrics::count_status(405);
+            add_status_line( 405, error_405_title );
+            add_allow();
+            add_headers( strlen( error_405_form ));
+            if (!add_content( error_405_form ))
+            {
+                return false;
+            }
+            break;
+        }
+        case TOO_LARGE:{
+            m_status = 413;
+            Metrics::count_status(413);
+            add_status_line( 413, error_413_title );
+            add_headers( strlen( error_413_form ));
+            if (!add_content( error_413_form ))
+            {
+                return false;
+            }
+            break;
+        }
+        case OPTIONS_REQUEST:{
+            m_status = 200;
+            Metrics::count_status(200);
+            add_status_line( 200, ok_200_title );
+            if (!add_allow() || !add_headers( 0 ))
+            {
+                return false;
+            }
+            break;
+        }
         case FORBIDDEN_REQUEST:{
+            m_status = 403;
+            Metrics::count_status(403);
             add_status_line( 403, error_403_title );
             add_headers( strlen( error_403_form ));
             if (!add_content( error_403_form ))
@@ -457,12 +1257,17 @@ bool http_conn::process_write(HTTP_CODE ret)
             }
             break;
         }
-        case FILE_REQUEST:{
-            add_status_line( 200, ok_200_title );
+        case FILE_REQUEST:
+        case DYNAMIC_REQUEST:{
+            m_status = ret == DYNAMIC_REQUEST ? m_reply_status : 200;
+            Metrics::count_status(m_status);
+            add_status_line( m_status, status_title( m_status ) );
             if (m_file_stat.st_size != 0)
             {
                 // 初始化 m_iv 信息，以及 bytes_to_send 的值 
-                add_headers(m_file_stat.st_size);
+                if (m_bundle) add_bundle_headers();
+                else add_headers(m_file_stat.st_size);
+                if (m_method == HEAD) break; // 只发送头部
                 m_iv[0].iov_base = m_write_buf;
                 m_iv[0].iov_len = m_write_idx;
                 m_iv[1].iov_base = m_file_address;
@@ -471,6 +1276,12 @@ bool http_conn::process_write(HTTP_CODE ret)
                 bytes_to_send = m_write_idx + m_file_stat.st_size;
                 return true;
             }
+            else if (ret == DYNAMIC_REQUEST)
+            {
+                // 204 不能带 Content-Length
+                bool ok = m_status == 204 ? add_linger() && add_blank_line() : add_headers(0);
+                if (!ok) return false;
+            }
             else
             {
                 const char *ok_string = "<html><body></body></html>";
@@ -478,6 +1289,40 @@ bool http_conn::process_write(HTTP_CODE ret)
                 if (!add_content(ok_string))
                     return false;
             }
+            break;
+        }
+        case STREAM_REQUEST:{
+            m_status = m_reply_status;
+            Metrics::count_status(m_status);
+            add_status_line( m_status, status_title( m_status ) );
+            if (!add_content_type() || !add_response( "Transfer-Encoding: chunked\r\n" ) ||
+                !add_linger() || !add_blank_line())
+            {
+                return false;
+            }
+            if (m_method == HEAD)
+            {
+                m_stream = NULL;
+                break;
+            }
+            // 第一块和响应头一起发送
+            m_iv[0].iov_base = m_write_buf;
+            m_iv[0].iov_len = m_write_idx;
+            bytes_to_send = m_write_idx;
+            m_sent_before = 0;
+            next_chunk();
+            return true;
+        }
+        case NOT_MODIFIED:{
+            m_status = 304;
+            Metrics::count_status(304);
+            add_status_line( 304, "Not Modified" );
+            if (!add_response( "ETag: %.*s\r\n", (int)m_bundle->m_etag_len, Bundle::at(m_bundle->m_etag_off) ) ||
+                !add_linger() || !add_blank_line())
+            {
+                return false;
+            }
+            break;
         }
         default: return false;
     }
@@ -494,35 +1339,97 @@ bool http_conn::process_write(HTTP_CODE ret)
 //处理http请求的入口函数
 void http_conn::process()
 {
+    uint64_t start = Metrics::now_ns();
+    m_request_ns = 0;
     HTTP_CODE read_ret = process_read();
+    uint64_t parsed = Metrics::now_ns();
+    if (m_traced) Trace::span(TR_PARSE, m_conn_id, start, parsed, read_ret);
+    // do_request 的耗时单独统计，解析阶段不包含它
+    Metrics::record(STAGE_PARSE, parsed - start - m_request_ns);
     if (read_ret == NO_REQUEST) //请求不完整，需要继续读取客户端数据
     {
         modfd( m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode ); //重新注册可读与EPOLLONESHOT
         return;
     }
+    if (m_request_ns)
+    {
+        Metrics::record(STAGE_REQUEST, m_request_ns);
+    }
 
     bool write_ret = process_write( read_ret );
+    m_write_start_ns = Metrics::now_ns();
+    Metrics::record(STAGE_WRITE, m_write_start_ns - parsed);
     if ( !write_ret )
     {
         close_conn();
     }
+    // 预读完成后由主线程注册 EPOLLOUT。提交之后连接可能随时被写出，这里不能再访问它
+    if ( m_cold_fd >= 0 )
+    {
+        int fd = m_cold_fd;
+        m_cold_fd = -1;
+        if ( write_ret && m_io_pool->submit( fd, m_file_stat.st_size, m_sockfd, m_conn_id ) ) return;
+        close( fd );
+    }
     modfd( m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode );
 }
 
+// 一个请求处理完后重置连接状态，保留读缓冲区中尚未解析的数据（HTTP 流水线中的后续请求）
+void http_conn::keep_pipelined()
+{
+    int left = m_read_idx - m_checked_idx;
+    if (left <= 0)
+    {
+        init();
+        return;
+    }
+    memmove(m_read_buf, m_read_buf + m_checked_idx, left);
+    reset_request();
+    m_read_idx = left;
+    m_req_start_ns = Metrics::now_ns();
+}
+
+// 应答发送完成后写一条访问日志
+void http_conn::log_access()
+{
+    AccessLog* log = AccessLog::get_instance();
+    if (!log->enabled()) return;
+    uint32_t latency_us = m_req_start_ns ? (Metrics::now_ns() - m_req_start_ns) / 1000 : 0;
+    log->record(m_method, m_url, m_query, m_status, bytes_have_send, latency_us,
+        m_sockaddr.sin_addr.s_addr, m_sockaddr.sin_port, m_conn_id);
+}
+
+// 录制连接上的事件，CAP_RESPONSE 记录本次应答的状态码和字节数
+void http_conn::capture(int type, const char* data, int len)
+{
+    Capture* cap = Capture::get_instance();
+    if (!cap->enabled()) return;
+    uint32_t bytes = type == CAP_RESPONSE ? bytes_have_send : len;
+    cap->record(type, m_conn_id, m_capture_seq, type == CAP_RESPONSE ? m_status : 0, bytes, data, len);
+}
+
+// 流式应答每次可写事件最多发送的块数
+static const int STREAM_BURST = 4;
+
 //将m_write_buf中的报文内容和m_file_address处的文件内容一起写到客户端 socket
 bool http_conn::write()
 {
     int temp = 0;
+    int burst = 0;
+    m_wait_next = false;
 
     if (bytes_to_send == 0){
         modfd( m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode );
         init();
+        m_wait_next = true;
         return true;
     }
     while(true)
     {
         // writev将m_iv中多块缓冲区的信息写入同一块fd
-        temp = writev( m_sockfd, m_iv, m_iv_count );
+        uint64_t start = m_traced ? Metrics::now_ns() : 0;
+        temp = transport::current()->writev( m_sockfd, m_iv, m_iv_count );
+        if (m_traced) Trace::span(TR_WRITEV, m_conn_id, start, Metrics::now_ns(), temp);
         if (temp <= -1)
         {
             // 如果TCP写缓冲区的资源暂时不可用，则监听等待写事件
@@ -536,30 +1443,57 @@ bool http_conn::write()
 
         bytes_have_send += temp;
         bytes_to_send -= temp;
+        Metrics::inc(CNT_BYTES_WRITTEN, temp);
 
-        // iv[0]缓冲区内容已经发送完毕了
-        if (bytes_have_send >= m_iv[0].iov_len){
+        // iv[0]缓冲区内容已经发送完毕了。要和响应头的总长度比较，
+        // iov_len 在多次短写之后已经是剩余长度，和累计发送量比较会提前跳到 iv[1]
+        if (bytes_have_send >= m_write_idx){
             m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
+            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx - m_sent_before);
             m_iv[1].iov_len = bytes_to_send;
         }
         // iv[0]缓冲区内容还没有发送完
         else{
             m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - temp;
+            m_iv[0].iov_len = m_write_idx - bytes_have_send;
+        }
+
+        // 流式应答的一块发完，生成下一块。连续发送 STREAM_BURST 块之后让出，等下一次可写事件再继续，
+        // 避免一个很长的应答占住线程。让出之前已经生成了下一块，bytes_to_send 不为 0，不会被当作流水线请求
+        if (bytes_to_send <= 0 && m_stream)
+        {
+            m_sent_before = bytes_have_send - m_write_idx;
+            next_chunk();
+            if (++burst >= STREAM_BURST)
+            {
+                modfd( m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode );
+                return true;
+            }
+            continue;
         }
 
         if (bytes_to_send <= 0)
         {
+            Metrics::record_since(STAGE_DRAIN, m_write_start_ns);
+            WS_PROBE4(request_end, m_conn_id, m_status, bytes_have_send, m_req_start_ns);
+            log_access();
+            capture(CAP_RESPONSE);
             unmap();
-            modfd( m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode );
 
             if (m_linger)
             {
-                init();
+                // 先重置状态再重新注册读事件，避免其他线程在重置前就开始处理下一个请求
+                // 缓冲区中已经有流水线发来的下一个请求时，不等待可读事件，由调用者直接交给 process()
+                keep_pipelined();
+                if (!has_pending())
+                {
+                    m_wait_next = true;
+                    modfd( m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode );
+                }
                 return true;
             }
-            else return false;
+            modfd( m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode );
+            return false;
         }
     }
 }
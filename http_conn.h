@@ -21,18 +21,40 @@
 #include "locker.h"
 #include <sys/uio.h>
 
+#include <string>
+#include <atomic>
+
 #include "lst_timer.h"
 
 using namespace std;
 
-class http_conn
+class io_pool;
+struct bundle_entry;
+struct route;
+
+// 路由匹配出的路径参数（见 router.h），值是 m_url 中的一段，用偏移和长度表示，不复制
+#define ROUTE_MAX_PARAMS 8
+struct route_params{
+    int m_count;
+    uint32_t m_off[ROUTE_MAX_PARAMS];
+    uint32_t m_len[ROUTE_MAX_PARAMS];
+};
+
+// 流式应答的生成进度，由生成函数自己解释。m_calls 是之前已经调用的次数，第一次调用时为 0
+struct stream_cursor{
+    uint64_t m_pos;
+    uint64_t m_end;
+    uint32_t m_calls;
+};
+
+class alignas(64) http_conn
 {
+    friend class http_conn_bench; // bench/bench_http.cpp 直接测量解析与应答函数
+
 public:
     static const int FILENAME_LEN = 200;
-    static const int READ_BUFFER_SIZE = 2048;
-    static const int WRITE_BUFFER_SIZE = 2048;
 
-    // 请求方法，这里只支持GET
+    // 请求方法。静态文件支持 GET 和 HEAD，OPTIONS 返回 Allow，其余方法的请求体照常接收，应答 405
     enum METHOD {GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT};
     
     /*
@@ -46,6 +68,9 @@ public:
     // 从状态机的三种可能状态，即行的读取状态，分别表示
     // 1.读取到一个完整的行 2.行出错 3.行数据尚且不完整
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
+
+    // chunked 请求体的解码状态：块大小行、块数据、块数据后的 \r\n、结尾的 trailer 行
+    enum CHUNK_STATE { CHUNK_SIZE = 0, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER };
     
     /*
         服务器处理HTTP请求的可能结果，报文解析的结果
@@ -57,24 +82,94 @@ public:
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        DYNAMIC_REQUEST     :   应答内容由服务器生成，保存在m_dynamic中
+        NOT_MODIFIED        :   资源包中的文件与 If-None-Match 一致，返回 304
+        OPTIONS_REQUEST     :   OPTIONS 请求，返回 Allow
+        NOT_ALLOWED         :   资源不支持该方法，返回 405
+        TOO_LARGE           :   请求体超过 max_body_size，返回 413 并关闭连接
+        STREAM_REQUEST      :   应答体由生成函数分块产生，以 chunked 编码发送
     */
-    enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION };
+    // 连接所处的阶段，各阶段的超时计算方法不同
+    enum PHASE { PHASE_HEAD = 0, PHASE_BODY, PHASE_SEND };
+
+    enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION, DYNAMIC_REQUEST, NOT_MODIFIED,
+        OPTIONS_REQUEST, NOT_ALLOWED, TOO_LARGE, STREAM_REQUEST };
+
+    // 流式应答的生成函数，向 out 追加不超过 budget 字节左右的应答体（可以略多，不能为 0 字节），
+    // 还有后续数据时返回 true。上一块完全写入套接字之后才会再次调用，套接字发送缓冲区满时暂停，
+    // 等到可写事件再继续，每个连接缓存的应答数据不超过一块。
+    // 调用发生在发送应答的线程中（Proactor 模式下是主线程），每次调用要足够快
+    typedef bool (*stream_producer)( http_conn& conn, stream_cursor& cursor, std::string& out, size_t budget );
     
 
 
     
 public:
-    http_conn(){}
-    ~http_conn(){}
+    // 缓冲区在建立连接时按当前配置分配，从未使用过的连接不占用内存
+    http_conn() : m_sockfd(-1), m_read_buf(NULL), m_read_buf_size(0), m_write_buf(NULL), m_write_buf_size(0), m_body_fd(-1) {}
+    ~http_conn()
+    {
+        delete[] m_read_buf;
+        delete[] m_write_buf;
+    }
 
     void init(int sockfd, const sockaddr_in& addr, int TRIGMODE);
     void close_conn();
     bool read();
     bool write();
     void process();
+    // 应答已经发完，读缓冲区中还有已经读入、尚未处理的请求数据（HTTP 流水线）。
+    // 短写返回 EAGAIN 时当前请求仍在缓冲区中，不能再交给 process()
+    bool has_pending() const { return bytes_to_send == 0 && m_read_idx > 0; }
+    bool closed() const { return m_sockfd == -1; }
+    // 连接已建立，但既没有读到请求数据也没有待发送的应答（空闲的 keep-alive）
+    bool idle() const { return m_sockfd != -1 && m_read_idx == 0 && bytes_to_send == 0; }
+    // 请求还没有收全：请求头中还没有空行，或请求体不足 Content-Length。缓冲区满时返回 false，交给 process() 处理
+    bool request_incomplete() const;
+    // 已经在解析请求体（请求头已经收全）
+    bool in_body() const { return m_check_state == CHECK_STATE_CONTENT; }
+    // 已经收到的请求体字节数（chunked 时不含块的分隔），splice 时是已经写入暂存文件的字节数
+    int64_t body_received() const { return in_body() ? m_body_len + (m_read_idx - m_checked_idx) : 0; }
+    // 当前应答已经发送的字节数
+    int64_t bytes_sent() const { return bytes_have_send; }
+    // 客户端 IPv4 地址，网络字节序
+    uint32_t client_ip() const { return m_sockaddr.sin_addr.s_addr; }
+
+    // 以下配置由主线程设置，重新加载后对之后建立的连接（缓冲区大小）或请求（根目录）生效
+    // stream_chunk 是流式应答每块的大小
+    static void set_buffer_size(int read_size, int write_size, int stream_chunk);
+    static void set_doc_root(const char* doc_root);
+    // 请求体的大小上限，以及 POST/PUT 请求体暂存文件所在的目录
+    static void set_body_limits(int max_body_size, const char* spool_dir);
+    // 注册内置的路由（静态文件、/metrics、/debug/trace、/healthz）并编译路由表。
+    // 其它模块的路由要在这之前用 Router::add 注册。重复调用时什么也不做
+    // metrics_cache_ms 是 /metrics 的应答在 MicroCache 中缓存的毫秒数
+    static void init_routes(int metrics_cache_ms);
+
+    // 以下供请求处理函数（router.h）使用，只在处理函数中有效
+    METHOD method() const { return m_method; }
+    const char* url() const { return m_url; }
+    // '?' 之后的查询串，未解码，没有时返回 NULL。长度写入 len
+    const char* query( size_t* len ) const { *len = m_query_len; return m_query; }
+    // 按名字取路径参数，没有时返回 NULL。返回值不以 '\0' 结尾，长度写入 len
+    const char* param( const char* name, size_t* len ) const;
+    // 请求体较小时留在读缓冲区中，body() 指向它；否则写入暂存文件（POST/PUT，用 pread 从偏移 0 读取）
+    // 或者已经丢弃，body() 为 NULL
+    const char* body() const { return m_body; }
+    int64_t body_length() const { return m_body_len; }
+    int body_fd() const { return m_body_fd; }
+    bool from_loopback() const { return m_sockaddr.sin_addr.s_addr == htonl(INADDR_LOOPBACK); }
+    // 清空并返回应答体缓冲区。缓冲区属于连接，容量在请求之间保留，稳定状态下不再分配内存
+    std::string& begin_reply() { m_dynamic.clear(); return m_dynamic; }
+    // 以 begin_reply() 中写入的内容作为应答体，处理函数直接返回它的结果
+    HTTP_CODE reply( int status, const char* content_type );
+    // 流式应答：响应头发出后反复调用 producer 生成应答体，直到它返回 false。HEAD 请求只发送响应头，不调用 producer
+    HTTP_CODE reply_stream( int status, const char* content_type, stream_producer producer );
 
 private:
     void init();
+    void reset_request(); //重置请求状态，不清空读缓冲区
+    void alloc_buffers(); //按当前配置分配读写缓冲区
     HTTP_CODE process_read(); //解析HTTP请求
     bool process_write( HTTP_CODE ret ); //填充HTTP应答
     
@@ -83,15 +178,38 @@ private:
     char* get_line(){ return m_read_buf + m_start_line; } // 返回一行数据
     HTTP_CODE parse_request_line( char* text ); // 解析请求行
     HTTP_CODE parse_headers( char* text ); //解析请求头
-    HTTP_CODE parse_content( char* text ); //解析请求体
-    HTTP_CODE do_request(); //响应函数
+    HTTP_CODE route_request(); //请求头解析完毕，匹配路由并检查方法
+    HTTP_CODE begin_body(); //准备接收请求体
+    HTTP_CODE parse_content(); //接收请求体
+    HTTP_CODE parse_chunked(); //解码 chunked 请求体
+    HTTP_CODE consume_body( const char* data, int len ); //把一段请求体写入暂存文件或丢弃
+    bool open_body_file(); //创建请求体暂存文件
+    bool splice_body(); //用 splice 把套接字中的请求体直接搬到暂存文件
+    void compact_body(); //把未处理的数据移到请求头之后，腾出读缓冲区
+    static bool normalize_url( char* url ); //原地规范化请求路径，越过根目录时返回 false
+    HTTP_CODE do_request(); //发送静态文件
+    HTTP_CODE timed_request(); //调用路由的处理函数并统计耗时
+    HTTP_CODE cached_request(); //经过 MicroCache 调用处理函数
+    //内置的处理函数
+    static HTTP_CODE serve_file( http_conn& conn ); //其余路由都不匹配的路径，调用do_request
+    static HTTP_CODE serve_metrics( http_conn& conn ); //输出 /metrics
+    static HTTP_CODE serve_trace( http_conn& conn ); //输出 /debug/trace
+    static bool stream_trace( http_conn& conn, stream_cursor& cursor, std::string& out, size_t budget );
+    static HTTP_CODE serve_health( http_conn& conn ); //输出 /healthz
+    HTTP_CODE bundle_request( const bundle_entry* e ); //从资源包发送文件
 
     //这一组函数被process_write调用以填充HTTP应答
     void unmap();
+    void log_access(); //应答发送完成后写访问日志
+    void capture(int type, const char* data = NULL, int len = 0); //写一条流量录制记录
+    void keep_pipelined(); //重置连接，保留流水线中的后续请求
+    void next_chunk(); //生成流式应答的下一块，放到 m_iv[1]
     bool add_response( const char* format, ... ); //按照format写一行应答
     bool add_content( const char* content ); //写错误信息
     bool add_status_line( int status, const char* title ); //写状态行
     bool add_headers( int content_length ); //写头部
+    bool add_allow(); //写 Allow
+    bool add_bundle_headers(); //写资源包中预先生成的头部
     bool add_content_length( int content_length );
     bool add_content_type(); 
     bool add_linger(); //添加是否keep-alive的信息
@@ -102,57 +220,125 @@ public:
     //所有的客户端共享的epollfd和链接进来的客户端数
     static int m_epollfd;
     static int m_user_count;
+    static std::atomic<uint64_t> m_conn_seq; //用于分配连接编号
+    // 以下大小由主线程在重新加载配置时修改，工作线程并发读取
+    static std::atomic<int> m_read_buffer_size; //新连接的读缓冲区大小
+    static std::atomic<int> m_write_buffer_size; //新连接的写缓冲区大小
+    static std::atomic<int> m_stream_chunk_size; //流式应答每块的大小
+    static std::atomic<const char*> m_doc_root; //静态文件根目录，工作线程并发读取
+    static std::atomic<int> m_max_body_size; //请求体的大小上限
+    static std::atomic<const char*> m_spool_dir; //请求体暂存文件所在的目录
+    static std::atomic<bool> m_draining; //升级交接后置位，之后的应答都带 Connection: close
+    static io_pool* m_io_pool; //冷文件预读线程池，为空时总是直接从映射发送。启动时设置
+    static bool m_splice_body_enabled; //暂存的请求体用 splice 接收，不经过读缓冲区。启动时设置
+
+    // m_users 是连续的数组，成员按访问频率分组：事件循环每个事件都要访问的热数据放在最前面，
+    // 线程间的同步标志单独占一条缓存行，只在解析请求和生成应答时使用的冷数据放在最后。
+    // 整个对象按缓存行对齐，相邻连接不会共用缓存行
+
+    // ---- 热数据：事件分发、定时器和读写进度 ----
 
     // 为当前客户连接添加定时器
     util_timer* m_timer;
-
-    // Reactor模式下变量
-    int m_state; // 当前所处读/写状态，0表示读，1表示写
-    int m_finish; // 工作线程是否读完/写完，1表示完成，0表示未完成
-    int m_timerflag; // 是否需要删除定时器，1表示需要删除，0表示不需要
+    // 当前阶段的开始时间，只由主线程访问
+    time_t m_phase_start;
+    uint64_t m_conn_id; //连接编号，在进程内唯一
+    // 当前阶段，只由主线程访问
+    PHASE m_phase;
+    // Reactor模式下当前所处读/写状态，0表示读，1表示写，2表示处理缓冲区中流水线的下一个请求。主线程在放入工作队列前设置
+    int m_state;
+    // 定时器在空闲连接链表（而不是定时器链表）中，只由主线程访问
+    bool m_in_idle_lst;
+    // 应答已经发完，正在等待下一个请求。由 write() 设置，主线程在 write() 完成后读取
+    bool m_wait_next;
+    bool m_traced; //该连接是否被采样追踪
 
 private:
     //当前客户端占用的socketfd以及客户端的地址
     int m_sockfd;
-    int m_fd;
+    // 触发模式，ET:1, LT:0
+    int m_TRIGMode;
     sockaddr_in m_sockaddr;
+
     //将这个socketfd中的内容读到m_read_buf缓冲区中，m_read_idx(偏移量)代表当前已经读到缓冲区的数据结束位置的下一个字节
-    char m_read_buf[ READ_BUFFER_SIZE ];
+    char* m_read_buf;
+    int m_read_buf_size;
     int m_read_idx;
-    
     int m_checked_idx; //当前正在解析的字符在读缓冲区中的位置
     int m_start_line; //当前正在解析的行的起始位置
-
     CHECK_STATE m_check_state; //主状态机当前所属的状态
+    int64_t m_content_length;
+    // 请求体：已经处理的字节数、在读缓冲区中的起始位置（紧跟请求头）。
+    // 能整个放进读缓冲区的请求体留在缓冲区中，否则边收边写入暂存文件或丢弃，收到的数据总是放在 m_body_start 之后
+    int64_t m_body_len;
+    int64_t m_chunk_left; //当前块还没有收到的字节数
+    int m_body_start;
+    CHUNK_STATE m_chunk_state;
+    bool m_chunked; //Transfer-Encoding: chunked
+    bool m_has_length; //已经解析过 Content-Length
+    bool m_body_streaming; //请求体放不进读缓冲区，或者是 chunked
+    bool m_spool_body; //请求体写入暂存文件（POST/PUT），否则丢弃
+    bool m_splice_body; //请求体剩余部分由 read() 用 splice 直接写入暂存文件
+    bool m_linger; //是否保持连接
+    bool m_file_mapped; //m_file_address是否需要munmap
 
+    //写缓冲区
+    char* m_write_buf;
+    int m_write_buf_size;
+    int m_write_idx;
+    //使用writev来执行写操作，将多个缓冲区中的数据写到一个fd中
+    struct iovec m_iv[2]; 
+    int m_iv_count;
+    int bytes_to_send;
+    int64_t bytes_have_send; //流式应答可能超过 2GB
+    char* m_file_address; //内存映射区的地址，动态应答时指向m_dynamic
+    stream_producer m_stream; //流式应答的生成函数，最后一块生成之后为 NULL
+    int64_t m_sent_before; //流式应答中当前块之前已经发送的应答体字节数（含块的分隔）
+
+public:
+    // ---- 主线程与工作线程之间的同步标志 ----
+    // Reactor 模式下主线程忙等工作线程置位，必须是原子变量，否则优化后的循环可能永远读不到新值。
+    // 单独占一条缓存行，主线程自旋时不会和工作线程写热数据互相争抢
+    alignas(64) std::atomic<int> m_finish; // 工作线程是否读完/写完，1表示完成，0表示未完成
+    std::atomic<int> m_timerflag; // 是否需要删除定时器，1表示需要删除，0表示不需要
+
+    // ---- 冷数据 ----
+
+    // 放入工作队列的时间，用于统计排队耗时
+    alignas(64) uint64_t m_enqueue_ns;
+
+private:
     //请求行的三个信息
     char* m_url;
+    char* m_query; //查询串，不含 '?'，没有时为 NULL
+    size_t m_query_len;
     char* m_version;
     METHOD m_method;
 
     //请求头部的信息
     char* m_host;
-    bool m_linger; //是否保持连接
-    int m_content_length;
+    char* m_if_none_match;
+
+    uint64_t m_write_start_ns; //开始发送应答的时间
+    uint64_t m_req_start_ns; //读到本次请求第一个字节的时间
+    uint64_t m_request_ns; //本次请求中处理函数的耗时
+    int m_status; //应答的状态码
+    uint32_t m_capture_seq; //该连接上下一条录制记录的序号
 
     //要发回的文件信息
-    char m_real_file[ FILENAME_LEN ]; //文件名
+    const char* m_content_type;
+    const bundle_entry* m_bundle; //请求的文件在资源包中时指向它的索引项
+    std::string m_dynamic; //服务器生成的应答内容
     struct stat m_file_stat; 
-    char* m_file_address; //内存映射区的地址
-    
-    //写缓冲区
-    char m_write_buf[ WRITE_BUFFER_SIZE ];
-    int m_write_idx;
-
-    //使用writev来执行写操作，将多个缓冲区中的数据写到一个fd中
-    struct iovec m_iv[2]; 
-    int m_iv_count;
-
-    int bytes_to_send;
-    int bytes_have_send;
-
-    // 触发模式，ET:1, LT:0
-    int m_TRIGMode;
+    int m_cold_fd; //文件不完全在页缓存中时保留的描述符，由 process() 交给 m_io_pool 预读
+    int m_body_fd; //请求体暂存文件（已经 unlink），请求结束时关闭
+    char* m_body; //留在读缓冲区中的请求体
+    const route* m_route; //匹配到的路由
+    route_params m_params; //路径参数
+    unsigned m_allow; //405 和 OPTIONS 应答中 Allow 的方法掩码
+    int m_reply_status; //处理函数生成的应答的状态码
+    stream_cursor m_cursor; //流式应答的生成进度
+    char m_real_file[ FILENAME_LEN ]; //文件名
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "io_pool.h"
+#include "log.h"
+#include "metrics.h"
+
+io_pool::io_pool(int thread_number, int max_jobs) : m_max_jobs(max_jobs), m_stop(false)
+{
+    if (thread_number <= 0 || max_jobs <= 0)
+    {
+        throw std::exception();
+    }
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventfd < 0)
+    {
+        throw std::exception();
+    }
+    for (int i = 0; i < thread_number; i++)
+    {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, this) != 0)
+        {
+            LOG_ERROR("create io thread failed, %d io threads running", i);
+            break;
+        }
+        m_threads.push_back(tid);
+    }
+}
+
+// 通知所有 I/O 线程退出并等待它们结束，队列中尚未预读的文件直接关闭
+io_pool::~io_pool()
+{
+    m_queuelocker.lock();
+    m_stop = true;
+    m_queuelocker.unlock();
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        m_queuestat.post();
+    }
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        pthread_join(m_threads[i], NULL);
+    }
+    for (std::list<job>::iterator it = m_queue.begin(); it != m_queue.end(); ++it)
+    {
+        close(it->m_fd);
+    }
+    close(m_eventfd);
+}
+
+bool io_pool::submit(int fd, off_t size, int sockfd, uint64_t conn_id)
+{
+    m_queuelocker.lock();
+    if (m_stop || m_threads.empty() || (int)m_queue.size() >= m_max_jobs)
+    {
+        m_queuelocker.unlock();
+        return false;
+    }
+    job j;
+    j.m_fd = fd;
+    j.m_size = size;
+    j.m_sockfd = sockfd;
+    j.m_conn_id = conn_id;
+    j.m_submit_ns = Metrics::now_ns();
+    m_queue.push_back(j);
+    m_queuelocker.unlock();
+    m_queuestat.post();
+    return true;
+}
+
+void io_pool::take_done(std::vector<job>& done)
+{
+    uint64_t n;
+    // 只是清除可读状态，任务数以 m_done 为准
+    while (read(m_eventfd, &n, sizeof(n)) > 0) {}
+    done.clear();
+    m_donelocker.lock();
+    done.swap(m_done);
+    m_donelocker.unlock();
+}
+
+bool io_pool::resident(const void* addr, size_t len)
+{
+    static const long page = sysconf(_SC_PAGESIZE);
+    // 每次查询 VEC_PAGES 页，遇到第一个不在页缓存中的页就返回
+    const size_t VEC_PAGES = 256;
+    unsigned char vec[VEC_PAGES];
+    const char* p = (const char*)addr;
+    const char* end = p + len;
+    while (p < end)
+    {
+        size_t chunk = end - p;
+        if (chunk > VEC_PAGES * page) chunk = VEC_PAGES * page;
+        if (mincore((void*)p, chunk, vec) != 0) return true;
+        size_t pages = (chunk + page - 1) / page;
+        for (size_t i = 0; i < pages; i++)
+        {
+            if (!(vec[i] & 1)) return false;
+        }
+        p += chunk;
+    }
+    return true;
+}
+
+void* io_pool::worker(void* arg)
+{
+    io_pool* pool = (io_pool*)arg;
+    pool->run();
+    return pool;
+}
+
+void io_pool::run()
+{
+    char* buf = new char[BUF_SIZE];
+    while (true)
+    {
+        m_queuestat.wait();
+        m_queuelocker.lock();
+        if (m_stop)
+        {
+            m_queuelocker.unlock();
+            break;
+        }
+        if (m_queue.empty())
+        {
+            m_queuelocker.unlock();
+            continue;
+        }
+        job j = m_queue.front();
+        m_queue.pop_front();
+        m_queuelocker.unlock();
+
+        prefault(j, buf);
+
+        m_donelocker.lock();
+        m_done.push_back(j);
+        m_donelocker.unlock();
+        uint64_t one = 1;
+        if (write(m_eventfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        {
+            LOG_ERROR("io pool notify failed, errno is %d", errno);
+        }
+    }
+    delete[] buf;
+}
+
+// 顺序读完整个文件，内核会同时预读后面的部分。读失败时不重试，发送时按原来的方式缺页
+void io_pool::prefault(const job& j, char* buf)
+{
+    posix_fadvise(j.m_fd, 0, j.m_size, POSIX_FADV_SEQUENTIAL);
+    off_t off = 0;
+    while (off < j.m_size)
+    {
+        ssize_t n = pread(j.m_fd, buf, BUF_SIZE, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += n;
+    }
+    close(j.m_fd);
+}
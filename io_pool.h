@@ -0,0 +1,64 @@
+#ifndef IO_POOL_H
+#define IO_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <list>
+#include <vector>
+#include "locker.h"
+
+// 冷文件预读线程池。
+// 映射的文件不在页缓存中时，writev 会在缺页处阻塞读盘，Proactor 模式下阻塞的是主线程，
+// Reactor 模式下是工作线程，排在后面的连接都要等它。工作线程发现文件不完全在页缓存中时，
+// 把文件描述符交给这里的 I/O 线程，I/O 线程用 pread 把整个文件读进页缓存（读到线程自己的
+// 缓冲区后丢弃），完成后通过 eventfd 通知主线程，主线程再为连接注册 EPOLLOUT，
+// 之后从映射发送时不再缺页。页缓存中的文件仍然直接走映射，不经过这里。
+// I/O 线程只访问自己持有的文件描述符，不访问连接对象，连接的关闭仍然只由主线程和工作线程负责
+class io_pool{
+public:
+    struct job{
+        int m_fd;           // 要预读的文件，由 I/O 线程关闭
+        off_t m_size;
+        int m_sockfd;       // 预读完成后要发送应答的连接
+        uint64_t m_conn_id; // 连接编号，主线程用它判断连接在预读期间是否已经关闭
+        uint64_t m_submit_ns;
+    };
+
+    io_pool(int thread_number, int max_jobs);
+    ~io_pool();
+
+    // 提交一个预读任务，队列已满时返回 false，文件描述符仍由调用者关闭。可在任意线程调用
+    bool submit(int fd, off_t size, int sockfd, uint64_t conn_id);
+    // 主线程在 epoll 中监听它，有任务完成时可读
+    int event_fd() const { return m_eventfd; }
+    // 取出已经完成的任务，只由主线程调用
+    void take_done(std::vector<job>& done);
+
+    // [addr, addr + len) 的所有页是否都在页缓存中。查询失败时返回 true，按原来的方式直接发送
+    static bool resident(const void* addr, size_t len);
+
+private:
+    static void* worker(void* arg);
+    void run();
+    void prefault(const job& j, char* buf);
+
+private:
+    static const int BUF_SIZE = 256 * 1024; // 每个 I/O 线程一个读缓冲区，启动时分配
+
+    std::vector<pthread_t> m_threads;
+    int m_max_jobs;
+
+    // 待预读的任务，受 m_queuelocker 保护
+    std::list<job> m_queue;
+    locker m_queuelocker;
+    sem m_queuestat;
+    bool m_stop;
+
+    // 已完成的任务，受 m_donelocker 保护
+    std::vector<job> m_done;
+    locker m_donelocker;
+    int m_eventfd;
+};
+
+#endif
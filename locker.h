@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <time.h>
 #include <exception>
 
 class locker{
@@ -55,15 +56,80 @@ public:
     }
     bool wait()
     {
-        sem_wait(&m_sem);
+        return sem_wait(&m_sem) == 0;
     }
     bool post()
     {
-        sem_post(&m_sem);
+        return sem_post(&m_sem) == 0;
     }
 
 private:
     sem_t m_sem;
 };
 
+// 读写锁，读多写少的共享数据使用
+class rwlocker{
+public:
+    rwlocker()
+    {
+        if (pthread_rwlock_init(&m_rwlock, NULL) != 0)
+        {
+            throw std::exception();
+        }
+    }
+    ~rwlocker()
+    {
+        pthread_rwlock_destroy(&m_rwlock);
+    }
+    bool rdlock()
+    {
+        return pthread_rwlock_rdlock(&m_rwlock) == 0;
+    }
+    bool wrlock()
+    {
+        return pthread_rwlock_wrlock(&m_rwlock) == 0;
+    }
+    bool unlock()
+    {
+        return pthread_rwlock_unlock(&m_rwlock) == 0;
+    }
+
+private:
+    pthread_rwlock_t m_rwlock;
+};
+
+// 条件变量，调用 wait 前需要持有传入的互斥锁
+class cond{
+public:
+    cond()
+    {
+        if (pthread_cond_init(&m_cond, NULL) != 0)
+            throw std::exception();
+    }
+    ~cond()
+    {
+        pthread_cond_destroy(&m_cond);
+    }
+    bool wait(pthread_mutex_t* mutex)
+    {
+        return pthread_cond_wait(&m_cond, mutex) == 0;
+    }
+    // abstime 为 CLOCK_REALTIME 的绝对时间，超时返回 false
+    bool timedwait(pthread_mutex_t* mutex, const struct timespec& abstime)
+    {
+        return pthread_cond_timedwait(&m_cond, mutex, &abstime) == 0;
+    }
+    bool signal()
+    {
+        return pthread_cond_signal(&m_cond) == 0;
+    }
+    bool broadcast()
+    {
+        return pthread_cond_broadcast(&m_cond) == 0;
+    }
+
+private:
+    pthread_cond_t m_cond;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include "log.h"
+
+static const char* level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+static const int BATCH_SIZE = 64 * 1024;
+
+// 每条日志在环形缓冲区中的头部，正文紧跟其后
+struct log_record{
+    int64_t ts_us; // 产生日志时的时间（微秒）
+    uint32_t tid;
+    uint32_t level;
+};
+
+static __thread spsc_ring* t_ring = NULL;
+static __thread uint32_t t_tid = 0;
+
+Log* Log::get_instance()
+{
+    static Log instance;
+    return &instance;
+}
+
+Log::Log() : m_level(INFO), m_dropped(0), m_running(false), m_stop(false), m_ring_count(0),
+m_fd(STDOUT_FILENO), m_max_file_size(0), m_file_size(0), m_max_files(0), m_flush_interval_ms(10), m_batch_len(0)
+{
+    m_file_name[0] = '\0';
+    for (int i = 0; i < MAX_THREADS; ++i) m_ring_state[i].store(RING_USED, std::memory_order_relaxed);
+    pthread_key_create(&m_ring_key, release_ring);
+    m_shared_ring = new spsc_ring(RING_SIZE);
+    m_batch = new char[BATCH_SIZE];
+}
+
+Log::~Log()
+{
+    stop();
+    // 工作线程是分离的，进程退出时可能仍在写日志，这里不释放各线程的缓冲区
+    delete[] m_batch;
+}
+
+bool Log::init(const char* file_name, int level, long max_file_size, int max_files, int flush_interval_ms)
+{
+    if (m_running.load()) return false;
+
+    m_level.store(level);
+    m_max_file_size = max_file_size;
+    m_max_files = max_files;
+    m_flush_interval_ms = flush_interval_ms > 0 ? flush_interval_ms : 1;
+
+    if (file_name && file_name[0] != '\0')
+    {
+        strncpy(m_file_name, file_name, sizeof(m_file_name) - 1);
+        m_file_name[sizeof(m_file_name) - 1] = '\0';
+        m_fd = open(m_file_name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+        {
+            m_fd = STDOUT_FILENO;
+            m_file_name[0] = '\0';
+            return false;
+        }
+        m_file_size = lseek(m_fd, 0, SEEK_END);
+    }
+
+    m_stop.store(false);
+    if (pthread_create(&m_thread, NULL, flush_worker, this) != 0)
+    {
+        return false;
+    }
+    m_running.store(true);
+    return true;
+}
+
+void Log::stop()
+{
+    if (!m_running.exchange(false)) return;
+    m_stop.store(true);
+    pthread_join(m_thread, NULL);
+    if (m_fd != STDOUT_FILENO)
+    {
+        close(m_fd);
+        m_fd = STDOUT_FILENO;
+    }
+}
+
+// 线程第一次写日志时取得自己的缓冲区，优先复用已退出线程留下的空闲缓冲区
+spsc_ring* Log::thread_ring()
+{
+    if (t_ring) return t_ring;
+    int slot = -1;
+    m_shared_locker.lock();
+    int count = m_ring_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i)
+    {
+        // 空闲的缓冲区已经取空，原来的线程不会再写入，本线程成为它唯一的生产者
+        if (m_ring_state[i].load(std::memory_order_acquire) == RING_FREE)
+        {
+            m_ring_state[i].store(RING_USED, std::memory_order_relaxed);
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0 && count < MAX_THREADS)
+    {
+        // 注册之后后台线程就可以看到它
+        m_rings[count] = new spsc_ring(RING_SIZE);
+        m_ring_state[count].store(RING_USED, std::memory_order_relaxed);
+        m_ring_count.store(count + 1, std::memory_order_release);
+        slot = count;
+    }
+    m_shared_locker.unlock();
+    if (slot < 0) return NULL;
+    t_ring = m_rings[slot];
+    pthread_setspecific(m_ring_key, (void*)(intptr_t)(slot + 1));
+    return t_ring;
+}
+
+// 线程退出：缓冲区交给后台线程，取空之后才能被复用。
+// 之后的其它 TLS 析构函数如果还写日志，会重新取得一个缓冲区
+void Log::release_ring(void* slot)
+{
+    Log* log = get_instance();
+    t_ring = NULL;
+    log->m_ring_state[(intptr_t)slot - 1].store(RING_RETIRED, std::memory_order_release);
+}
+
+void Log::write_log(int level, const char* format, ...)
+{
+    if (level < DEBUG || level > ERROR) return;
+
+    char text[MAX_LINE];
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(text, sizeof(text), format, arg_list);
+    va_end(arg_list);
+    if (len < 0) return;
+    if (len >= (int)sizeof(text)) len = sizeof(text) - 1;
+    // 去掉调用者自带的换行，输出时统一添加
+    while (len > 0 && text[len - 1] == '\n') --len;
+
+    if (t_tid == 0) t_tid = syscall(SYS_gettid);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    log_record rec;
+    rec.ts_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    rec.tid = t_tid;
+    rec.level = level;
+
+    // 日志线程还没有启动时直接同步输出
+    if (!m_running.load(std::memory_order_acquire))
+    {
+        text[len++] = '\n';
+        ssize_t ret = ::write(m_fd, text, len);
+        (void)ret;
+        return;
+    }
+
+    bool ok;
+    spsc_ring* ring = thread_ring();
+    if (ring)
+    {
+        ok = ring->push(&rec, sizeof(rec), text, len);
+    }
+    else
+    {
+        m_shared_locker.lock();
+        ok = m_shared_ring->push(&rec, sizeof(rec), text, len);
+        m_shared_locker.unlock();
+    }
+    if (!ok)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void* Log::flush_worker(void* arg)
+{
+    Log* log = (Log*)arg;
+    log->flush_loop();
+    return NULL;
+}
+
+void Log::flush_loop()
+{
+    struct timespec interval;
+    interval.tv_sec = m_flush_interval_ms / 1000;
+    interval.tv_nsec = (m_flush_interval_ms % 1000) * 1000000L;
+
+    while (!m_stop.load(std::memory_order_acquire))
+    {
+        // 取不到日志时才休眠，日志多的时候一直批量写
+        if (!drain())
+        {
+            nanosleep(&interval, NULL);
+        }
+    }
+    // 退出前把剩余的日志写完
+    while (drain()) {}
+}
+
+bool Log::drain()
+{
+    char line[sizeof(log_record) + MAX_LINE];
+    bool got = false;
+    int count = m_ring_count.load(std::memory_order_acquire);
+    for (int i = 0; i <= count; ++i)
+    {
+        spsc_ring* ring = (i < count) ? m_rings[i] : m_shared_ring;
+        // 在取日志之前读状态：看到 RING_RETIRED 时原来的线程已经写完，下面取空之后就可以复用
+        bool retired = i < count && m_ring_state[i].load(std::memory_order_acquire) == RING_RETIRED;
+        uint32_t len;
+        while ((len = ring->pop(line, sizeof(line))) != 0)
+        {
+            got = true;
+            log_record* rec = (log_record*)line;
+            int text_len = len - sizeof(log_record);
+
+            // 格式化时间等前缀的工作放在后台线程中完成
+            time_t sec = rec->ts_us / 1000000;
+            struct tm tm_now;
+            localtime_r(&sec, &tm_now);
+            if (m_batch_len + 96 + text_len > BATCH_SIZE)
+            {
+                write_out(m_batch, m_batch_len);
+                m_batch_len = 0;
+            }
+            m_batch_len += snprintf(m_batch + m_batch_len, BATCH_SIZE - m_batch_len,
+                "%04d-%02d-%02d %02d:%02d:%02d.%06ld %-5s [%u] ",
+                tm_now.tm_year + 1900, tm_now.tm_mon + 1, tm_now.tm_mday,
+                tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec, (long)(rec->ts_us % 1000000),
+                level_names[rec->level], rec->tid);
+            memcpy(m_batch + m_batch_len, line + sizeof(log_record), text_len);
+            m_batch_len += text_len;
+            m_batch[m_batch_len++] = '\n';
+        }
+        if (retired) m_ring_state[i].store(RING_FREE, std::memory_order_release);
+    }
+    if (m_batch_len > 0)
+    {
+        write_out(m_batch, m_batch_len);
+        m_batch_len = 0;
+    }
+    return got;
+}
+
+void Log::write_out(const char* buf, int len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(m_fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+        m_file_size += n;
+    }
+    if (m_file_name[0] != '\0' && m_max_file_size > 0 && m_file_size >= m_max_file_size)
+    {
+        rotate();
+    }
+}
+
+// 日志文件滚动：server.log -> server.log.1 -> ... -> server.log.N，超出 N 的被删除
+void Log::rotate()
+{
+    char from[300], to[300];
+    close(m_fd);
+    for (int i = m_max_files - 1; i >= 1; --i)
+    {
+        snprintf(from, sizeof(from), "%s.%d", m_file_name, i);
+        snprintf(to, sizeof(to), "%s.%d", m_file_name, i + 1);
+        rename(from, to);
+    }
+    if (m_max_files > 0)
+    {
+        snprintf(to, sizeof(to), "%s.1", m_file_name);
+        rename(m_file_name, to);
+    }
+    else
+    {
+        unlink(m_file_name);
+    }
+    m_fd = open(m_file_name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+    {
+        m_fd = STDOUT_FILENO;
+        m_file_name[0] = '\0';
+    }
+    m_file_size = 0;
+}
@@ -0,0 +1,92 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "locker.h"
+#include "ring_buffer.h"
+
+// 编译期日志级别，低于该级别的日志调用在编译期就被消除
+// 默认 1 (INFO)，调试时可以用 -DLOG_COMPILE_LEVEL=0 打开 DEBUG 日志
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 1
+#endif
+
+// 异步日志：每个线程写自己的无锁环形缓冲区，后台线程批量取出写到文件
+class Log{
+public:
+    enum LEVEL { DEBUG = 0, INFO, WARN, ERROR, OFF };
+
+    static const int MAX_THREADS = 256;       // 最多有多少个线程拥有自己的缓冲区
+    static const int RING_SIZE = 256 * 1024;  // 每个线程缓冲区的大小
+    static const int MAX_LINE = 1024;         // 单条日志的最大长度
+
+    static Log* get_instance();
+
+    // file_name 为空时输出到标准输出；max_file_size 为 0 时不滚动
+    bool init(const char* file_name, int level, long max_file_size = 64 * 1024 * 1024,
+              int max_files = 5, int flush_interval_ms = 10);
+    void stop();
+
+    void write_log(int level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    int get_level() const { return m_level.load(std::memory_order_relaxed); }
+    void set_level(int level) { m_level.store(level, std::memory_order_relaxed); }
+
+    // 因缓冲区满而丢弃的日志条数
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    Log();
+    ~Log();
+
+    static void* flush_worker(void* arg);
+    void flush_loop();
+    bool drain(); // 取出所有线程缓冲区中的日志并写出，返回是否取到了日志
+    void write_out(const char* buf, int len);
+    void rotate();
+    spsc_ring* thread_ring();
+    static void release_ring(void* slot); // 线程退出时由 pthread 调用
+
+private:
+    std::atomic<int> m_level;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stop;
+
+    // 各线程的缓冲区，后台线程按 m_ring_count 遍历。线程退出后缓冲区不释放，
+    // 后台线程把其中的日志取完后标记为空闲，由之后新建的线程复用
+    enum RING_STATE { RING_USED = 0, RING_RETIRED, RING_FREE };
+    spsc_ring* m_rings[MAX_THREADS];
+    std::atomic<int> m_ring_state[MAX_THREADS];
+    std::atomic<int> m_ring_count;
+    pthread_key_t m_ring_key; // 值为槽位下标 + 1，线程退出时调用 release_ring
+    // 超出 MAX_THREADS 的线程共用一个缓冲区，需要加锁
+    spsc_ring* m_shared_ring;
+    locker m_shared_locker;
+
+    pthread_t m_thread;
+    int m_fd;
+    char m_file_name[256];
+    long m_max_file_size;
+    long m_file_size;
+    int m_max_files;
+    int m_flush_interval_ms;
+
+    char* m_batch;      // 后台线程的批量写缓冲区
+    int m_batch_len;
+};
+
+#define LOG_BASE(level, format, ...) \
+    do { \
+        if ((level) >= LOG_COMPILE_LEVEL && (level) >= Log::get_instance()->get_level()) \
+            Log::get_instance()->write_log(level, format, ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(format, ...) LOG_BASE(Log::DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_BASE(Log::INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_BASE(Log::WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_BASE(Log::ERROR, format, ##__VA_ARGS__)
+
+#endif
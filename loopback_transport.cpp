@@ -0,0 +1,491 @@
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <arpa/inet.h>
+#include "loopback_transport.h"
+#include "message_framer.h"
+
+struct loopback_transport::conn{
+    int m_fd;                // 服务器一侧的描述符，accept 之前和关闭之后为 -1
+    bool m_accepted;
+    bool m_peer_closed;      // 客户端已 shutdown
+    bool m_server_closed;
+    bool m_released;
+    std::string m_in;        // 客户端发出、服务器尚未读取的数据
+    size_t m_in_off;
+    uint64_t m_reads;
+    uint64_t m_writes;
+
+    // 切分客户端发出的请求，只为了记下哪些是 HEAD 请求，它们的应答没有消息体
+    message_framer m_request;
+    std::deque<bool> m_head_requests;
+    // 切分服务器写出的应答
+    message_framer m_response;
+    uint64_t m_responses;
+    std::string m_out;
+
+    conn() : m_fd(-1), m_accepted(false), m_peer_closed(false), m_server_closed(false), m_released(false),
+             m_in_off(0), m_reads(0), m_writes(0), m_responses(0) {}
+};
+
+loopback_transport::loopback_transport() : m_listenfd(-1), m_backlog_limit(0), m_pollfd(-1), m_next_port(10000)
+{
+    m_fds.resize(MAX_FDS);
+    for (int i = MAX_FDS - 1; i >= 0; --i)
+    {
+        m_fds[i].m_kind = FD_FREE;
+        m_free_fds.push_back(FD_BASE + i);
+    }
+}
+
+loopback_transport::~loopback_transport()
+{
+    for (size_t i = 0; i < m_conns.size(); ++i) delete m_conns[i];
+}
+
+void loopback_transport::set_pattern(const loopback_pattern& pattern)
+{
+    m_locker.lock();
+    m_pattern = pattern;
+    m_locker.unlock();
+}
+
+loopback_transport::fd_slot* loopback_transport::slot(int fd, FD_KIND kind)
+{
+    if (fd < FD_BASE || fd >= FD_BASE + MAX_FDS) return NULL;
+    fd_slot* s = &m_fds[fd - FD_BASE];
+    return s->m_kind == kind ? s : NULL;
+}
+
+// 与内核一样优先分配最小的空闲描述符
+int loopback_transport::alloc_fd(FD_KIND kind)
+{
+    if (m_free_fds.empty()) return -1;
+    int fd = m_free_fds.back();
+    m_free_fds.pop_back();
+    fd_slot& s = m_fds[fd - FD_BASE];
+    s.m_kind = kind;
+    s.m_conn = NULL;
+    s.m_registered = false;
+    s.m_armed = false;
+    s.m_queued = false;
+    s.m_events = 0;
+    s.m_data.u64 = 0;
+    return fd;
+}
+
+void loopback_transport::free_fd(int fd)
+{
+    m_fds[fd - FD_BASE].m_kind = FD_FREE;
+    m_fds[fd - FD_BASE].m_registered = false;
+    // 保持空闲列表末尾是最小的描述符
+    std::vector<int>::iterator it = std::lower_bound(m_free_fds.begin(), m_free_fds.end(), fd, std::greater<int>());
+    m_free_fds.insert(it, fd);
+}
+
+uint32_t loopback_transport::ready_events(const fd_slot& s) const
+{
+    if (s.m_kind == FD_LISTEN) return m_backlog.empty() ? 0 : EPOLLIN;
+    if (s.m_kind != FD_CONN) return 0;
+    const conn* c = s.m_conn;
+    uint32_t ev = EPOLLOUT;
+    if (c->m_in_off < c->m_in.size()) ev |= EPOLLIN;
+    if (c->m_peer_closed) ev |= EPOLLIN | EPOLLRDHUP;
+    return ev;
+}
+
+// 状态变化（新数据、新连接、重新注册）后调用，相当于内核的就绪回调
+void loopback_transport::notify(int fd)
+{
+    fd_slot* s = &m_fds[fd - FD_BASE];
+    if (!s->m_registered || !s->m_armed || s->m_queued) return;
+    if (!(ready_events(*s) & (s->m_events | EPOLLERR | EPOLLHUP))) return;
+    s->m_queued = true;
+    m_ready.push_back(fd);
+    m_cond.signal();
+}
+
+loopback_transport::conn* loopback_transport::connect()
+{
+    conn* c = new conn();
+    m_locker.lock();
+    m_conns.push_back(c);
+    m_backlog.push_back(c);
+    if (m_listenfd >= 0) notify(m_listenfd);
+    m_locker.unlock();
+    return c;
+}
+
+void loopback_transport::send(conn* c, const char* data, size_t len)
+{
+    m_locker.lock();
+    if (!c->m_server_closed && !c->m_peer_closed)
+    {
+        c->m_in.append(data, len);
+        feed_input(c, data, len);
+        if (c->m_fd >= 0) notify(c->m_fd);
+    }
+    m_locker.unlock();
+}
+
+void loopback_transport::shutdown(conn* c)
+{
+    m_locker.lock();
+    c->m_peer_closed = true;
+    if (c->m_fd >= 0) notify(c->m_fd);
+    m_locker.unlock();
+}
+
+uint64_t loopback_transport::responses(conn* c)
+{
+    m_locker.lock();
+    uint64_t n = c->m_responses;
+    m_locker.unlock();
+    return n;
+}
+
+std::string loopback_transport::output(conn* c)
+{
+    m_locker.lock();
+    std::string out = c->m_out;
+    m_locker.unlock();
+    return out;
+}
+
+bool loopback_transport::closed(conn* c)
+{
+    m_locker.lock();
+    bool ret = c->m_server_closed;
+    m_locker.unlock();
+    return ret;
+}
+
+void loopback_transport::release(conn* c)
+{
+    m_locker.lock();
+    c->m_released = true;
+    if (c->m_server_closed || !c->m_accepted)
+    {
+        std::deque<conn*>::iterator b = std::find(m_backlog.begin(), m_backlog.end(), c);
+        if (b != m_backlog.end()) m_backlog.erase(b);
+        m_conns.erase(std::find(m_conns.begin(), m_conns.end(), c));
+        delete c;
+    }
+    m_locker.unlock();
+}
+
+int loopback_transport::listen(int port, const listen_options& opt)
+{
+    m_locker.lock();
+    int fd = m_listenfd >= 0 ? -1 : alloc_fd(FD_LISTEN);
+    if (fd >= 0)
+    {
+        m_listenfd = fd;
+        m_backlog_limit = opt.m_backlog;
+    }
+    m_locker.unlock();
+    if (fd < 0) errno = EADDRINUSE;
+    return fd;
+}
+
+int loopback_transport::accept(int listenfd, sockaddr_in* addr)
+{
+    m_locker.lock();
+    if (!slot(listenfd, FD_LISTEN))
+    {
+        m_locker.unlock();
+        errno = EBADF;
+        return -1;
+    }
+    if (m_backlog.empty())
+    {
+        m_locker.unlock();
+        errno = EAGAIN;
+        return -1;
+    }
+    int fd = alloc_fd(FD_CONN);
+    if (fd < 0)
+    {
+        m_locker.unlock();
+        errno = EMFILE;
+        return -1;
+    }
+    conn* c = m_backlog.front();
+    m_backlog.pop_front();
+    c->m_fd = fd;
+    c->m_accepted = true;
+    m_fds[fd - FD_BASE].m_conn = c;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = htons(m_next_port++);
+    m_locker.unlock();
+    return fd;
+}
+
+ssize_t loopback_transport::recv(int fd, void* buf, size_t len)
+{
+    m_locker.lock();
+    fd_slot* s = slot(fd, FD_CONN);
+    if (!s)
+    {
+        m_locker.unlock();
+        errno = EBADF;
+        return -1;
+    }
+    conn* c = s->m_conn;
+    size_t avail = c->m_in.size() - c->m_in_off;
+    c->m_reads++;
+    if (avail > 0 && m_pattern.m_read_eagain > 0 && c->m_reads % m_pattern.m_read_eagain == 0)
+    {
+        // 剩余数据"稍后到达"：这次读不到，随后再触发一次可读事件
+        notify(fd);
+        m_locker.unlock();
+        errno = EAGAIN;
+        return -1;
+    }
+    if (avail == 0)
+    {
+        m_locker.unlock();
+        if (c->m_peer_closed) return 0;
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t n = std::min(len, avail);
+    if (m_pattern.m_max_read > 0) n = std::min(n, (size_t)m_pattern.m_max_read);
+    memcpy(buf, c->m_in.data() + c->m_in_off, n);
+    c->m_in_off += n;
+    if (c->m_in_off == c->m_in.size())
+    {
+        c->m_in.clear();
+        c->m_in_off = 0;
+    }
+    m_locker.unlock();
+    return n;
+}
+
+void loopback_transport::feed_input(conn* c, const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t used = c->m_request.feed(data, len);
+        data += used;
+        len -= used;
+        if (c->m_request.m_state == message_framer::FR_HEADER_DONE)
+        {
+            c->m_head_requests.push_back(c->m_request.head_request());
+            c->m_request.start_body(false);
+        }
+        if (c->m_request.m_state == message_framer::FR_DONE) c->m_request.reset();
+    }
+}
+
+// 切分服务器写出的数据，统计完整的应答个数。1xx 是中间应答，不计数也不对应请求
+void loopback_transport::feed_output(conn* c, const char* data, size_t len)
+{
+    if (m_pattern.m_keep_output) c->m_out.append(data, len);
+    while (len > 0)
+    {
+        size_t used = c->m_response.feed(data, len);
+        data += used;
+        len -= used;
+        if (c->m_response.m_state == message_framer::FR_HEADER_DONE)
+        {
+            int status = c->m_response.status();
+            bool interim = status >= 100 && status < 200;
+            bool head = false;
+            if (!interim && !c->m_head_requests.empty())
+            {
+                head = c->m_head_requests.front();
+                c->m_head_requests.pop_front();
+            }
+            c->m_response.start_body(interim || head || status == 204 || status == 304);
+            if (interim)
+            {
+                c->m_response.reset();
+                continue;
+            }
+        }
+        if (c->m_response.m_state == message_framer::FR_DONE)
+        {
+            c->m_responses++;
+            c->m_response.reset();
+        }
+    }
+}
+
+ssize_t loopback_transport::writev(int fd, const struct iovec* iov, int iovcnt)
+{
+    m_locker.lock();
+    fd_slot* s = slot(fd, FD_CONN);
+    if (!s)
+    {
+        m_locker.unlock();
+        errno = EBADF;
+        return -1;
+    }
+    conn* c = s->m_conn;
+    c->m_writes++;
+    if (m_pattern.m_write_eagain > 0 && c->m_writes % m_pattern.m_write_eagain == 0)
+    {
+        m_locker.unlock();
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t limit = m_pattern.m_max_write > 0 ? (size_t)m_pattern.m_max_write : (size_t)-1;
+    size_t written = 0;
+    for (int i = 0; i < iovcnt && written < limit; ++i)
+    {
+        size_t n = std::min(iov[i].iov_len, limit - written);
+        feed_output(c, (const char*)iov[i].iov_base, n);
+        written += n;
+    }
+    m_locker.unlock();
+    return written;
+}
+
+int loopback_transport::close(int fd)
+{
+    m_locker.lock();
+    if (fd < FD_BASE || fd >= FD_BASE + MAX_FDS || m_fds[fd - FD_BASE].m_kind == FD_FREE)
+    {
+        m_locker.unlock();
+        errno = EBADF;
+        return -1;
+    }
+    fd_slot& s = m_fds[fd - FD_BASE];
+    if (s.m_kind == FD_CONN)
+    {
+        conn* c = s.m_conn;
+        c->m_fd = -1;
+        c->m_server_closed = true;
+        if (c->m_released)
+        {
+            m_conns.erase(std::find(m_conns.begin(), m_conns.end(), c));
+            delete c;
+        }
+    }
+    else if (s.m_kind == FD_LISTEN)
+    {
+        m_listenfd = -1;
+    }
+    else if (s.m_kind == FD_POLL)
+    {
+        m_pollfd = -1;
+        m_ready.clear();
+    }
+    free_fd(fd);
+    m_locker.unlock();
+    return 0;
+}
+
+int loopback_transport::poll_create()
+{
+    m_locker.lock();
+    int fd = m_pollfd >= 0 ? -1 : alloc_fd(FD_POLL);
+    if (fd >= 0) m_pollfd = fd;
+    m_locker.unlock();
+    if (fd < 0) errno = EMFILE;
+    return fd;
+}
+
+int loopback_transport::poll_ctl(int epollfd, int op, int fd, epoll_event* event)
+{
+    // 真实的描述符（信号管道）不参与模拟
+    if (fd < FD_BASE) return 0;
+
+    m_locker.lock();
+    if (epollfd != m_pollfd || fd >= FD_BASE + MAX_FDS || m_fds[fd - FD_BASE].m_kind == FD_FREE)
+    {
+        m_locker.unlock();
+        errno = EBADF;
+        return -1;
+    }
+    fd_slot& s = m_fds[fd - FD_BASE];
+    switch (op)
+    {
+        case EPOLL_CTL_ADD:
+        case EPOLL_CTL_MOD:
+            s.m_registered = true;
+            s.m_armed = true;
+            s.m_events = event->events;
+            s.m_data = event->data;
+            notify(fd);
+            break;
+        case EPOLL_CTL_DEL:
+            s.m_registered = false;
+            break;
+    }
+    m_locker.unlock();
+    return 0;
+}
+
+int loopback_transport::poll_wait(int epollfd, epoll_event* events, int maxevents, int timeout_ms)
+{
+    struct timespec deadline;
+    if (timeout_ms > 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    m_locker.lock();
+    if (epollfd != m_pollfd)
+    {
+        m_locker.unlock();
+        errno = EBADF;
+        return -1;
+    }
+    int n = 0;
+    while (true)
+    {
+        // 每个就绪项最多检查一次，LT 重新入队的项留到下一次调用
+        size_t scan = m_ready.size();
+        while (scan-- > 0 && n < maxevents)
+        {
+            int fd = m_ready.front();
+            m_ready.pop_front();
+            fd_slot& s = m_fds[fd - FD_BASE];
+            s.m_queued = false;
+            if (s.m_kind == FD_FREE || !s.m_registered || !s.m_armed) continue;
+            uint32_t ev = ready_events(s) & (s.m_events | EPOLLERR | EPOLLHUP);
+            if (!ev) continue;
+            events[n].events = ev;
+            events[n].data = s.m_data;
+            ++n;
+            if (s.m_events & EPOLLONESHOT)
+            {
+                s.m_armed = false;
+            }
+            else if (!(s.m_events & EPOLLET))
+            {
+                s.m_queued = true;
+                m_ready.push_back(fd);
+            }
+        }
+        if (n > 0 || timeout_ms == 0) break;
+        if (timeout_ms < 0) m_cond.wait(m_locker.get());
+        else if (!m_cond.timedwait(m_locker.get(), deadline)) break;
+    }
+    m_locker.unlock();
+    return n;
+}
+
+bool loopback_transport::listen_stats(int listenfd, int* queued, int* backlog)
+{
+    m_locker.lock();
+    bool ok = slot(listenfd, FD_LISTEN) != NULL;
+    *queued = m_backlog.size();
+    *backlog = m_backlog_limit;
+    m_locker.unlock();
+    return ok;
+}
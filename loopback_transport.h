@@ -0,0 +1,97 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include "locker.h"
+#include "transport.h"
+
+// 模拟的收发行为，用来构造各种边界情况
+struct loopback_pattern{
+    int m_max_read;       // 每次 recv 最多返回的字节数（请求分多次到达），0 表示不限
+    int m_read_eagain;    // 每 N 次 recv 返回一次 EAGAIN，随后剩余数据"到达"并重新触发可读事件，0 表示不插入
+    int m_max_write;      // 每次 writev 最多接受的字节数（短写），0 表示不限
+    int m_write_eagain;   // 每 N 次 writev 返回一次 EAGAIN，0 表示不插入
+    bool m_keep_output;   // 保留服务器写出的原始数据，否则只统计应答个数
+
+    loopback_pattern() : m_max_read(0), m_read_eagain(0), m_max_write(0), m_write_eagain(0), m_keep_output(false) {}
+};
+
+// 进程内的回环 transport：连接、监听队列和 epoll 都在内存中模拟，不经过内核。
+// 驱动方（基准测试或复现程序）通过 connect/send/shutdown 扮演客户端，服务器照常调用 transport 接口。
+// epoll 的语义与内核一致：LT 在仍然就绪时反复报告，ET 只在新数据到达或 EPOLL_CTL_MOD 时报告，
+// EPOLLONESHOT 报告一次后需要 MOD 重新启用。
+// 模拟的描述符从 FD_BASE 开始编号，高于默认的 RLIMIT_NOFILE，不会与进程中真实的描述符混淆；
+// 加入 epoll 的真实描述符（信号管道）被忽略，所以回环模式下没有定时器和信号处理
+class loopback_transport : public transport{
+public:
+    static const int FD_BASE = 1024;
+    static const int MAX_FDS = 64 * 1024 - FD_BASE; // 描述符超出配置的 max_conns 时连接会被服务器拒绝
+
+    struct conn; // 客户端一侧的连接
+
+    loopback_transport();
+    virtual ~loopback_transport();
+
+    void set_pattern(const loopback_pattern& pattern);
+
+    // 客户端操作，可以在任意线程调用
+    conn* connect();
+    void send(conn* c, const char* data, size_t len);
+    void shutdown(conn* c);                  // 客户端关闭写端，服务器读到 0
+    uint64_t responses(conn* c);             // 已经完整收到的应答个数
+    std::string output(conn* c);             // 服务器写出的原始数据，需要 m_keep_output
+    bool closed(conn* c);                    // 服务器是否已经关闭该连接
+    void release(conn* c);                   // 客户端不再使用，服务器关闭后回收
+
+    virtual int listen(int port, const listen_options& opt);
+    virtual int accept(int listenfd, sockaddr_in* addr);
+    virtual ssize_t recv(int fd, void* buf, size_t len);
+    virtual ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+    virtual int close(int fd);
+
+    virtual int poll_create();
+    virtual int poll_ctl(int epollfd, int op, int fd, epoll_event* event);
+    virtual int poll_wait(int epollfd, epoll_event* events, int maxevents, int timeout_ms);
+
+    virtual bool listen_stats(int listenfd, int* queued, int* backlog);
+
+private:
+    enum FD_KIND { FD_FREE = 0, FD_LISTEN, FD_POLL, FD_CONN };
+
+    struct fd_slot{
+        FD_KIND m_kind;
+        conn* m_conn;
+        bool m_registered;   // 在 epoll 的监听列表中
+        bool m_armed;        // EPOLLONESHOT 报告后为 false
+        bool m_queued;       // 已在就绪队列中
+        uint32_t m_events;
+        epoll_data_t m_data;
+    };
+
+    fd_slot* slot(int fd, FD_KIND kind);
+    int alloc_fd(FD_KIND kind);
+    void free_fd(int fd);
+    uint32_t ready_events(const fd_slot& s) const;
+    void notify(int fd);
+    void feed_input(conn* c, const char* data, size_t len);
+    void feed_output(conn* c, const char* data, size_t len);
+
+private:
+    locker m_locker;
+    cond m_cond;                 // 就绪队列不为空时通知 poll_wait
+    loopback_pattern m_pattern;
+    std::vector<fd_slot> m_fds;
+    std::vector<int> m_free_fds;
+    std::deque<int> m_ready;     // 就绪队列
+    std::deque<conn*> m_backlog; // 等待 accept 的连接
+    std::vector<conn*> m_conns;  // 所有未回收的连接，析构时释放
+    int m_listenfd;
+    int m_backlog_limit;         // 只用于 listen_stats，模拟的队列没有上限
+    int m_pollfd;
+    uint16_t m_next_port;
+};
+
+#endif
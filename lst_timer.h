@@ -65,28 +65,52 @@ public:
         timer -> next = tail;
     }
     
-    /* 当某个定时任务发生变化时，将该定时器挪动到末尾 */
+    // 按过期时间插入。连接各阶段的期限不同，新期限通常接近最晚的，从尾部向前查找
+    void add_timer( util_timer* timer )
+    {
+        if (!timer) return;
+        util_timer* pos = tail -> prev;
+        while (pos != head && pos -> m_expire > timer -> m_expire) {
+            pos = pos -> prev;
+        }
+        timer -> prev = pos;
+        timer -> next = pos -> next;
+        pos -> next -> prev = timer;
+        pos -> next = timer;
+    }
+
+    /* 当某个定时任务的过期时间发生变化时，将该定时器挪动到新的位置 */
     void adjust_timer( util_timer* timer )
     {
         if( !timer )  {
             return;
         }
         del_timer( timer );
-        push_back( timer );
+        add_timer( timer );
     }
 
-    // 将目标定时器 timer 从链表中移除
+    // 将目标定时器 timer 从链表中移除。移除后指针置空，同一批事件中对已关闭的连接再次移除时什么也不做
     void del_timer( util_timer* timer )
     {
-        if (!timer) return;
+        if (!timer || !timer->prev) return;
         timer->prev->next = timer->next;
         timer->next->prev = timer->prev; 
+        timer->prev = nullptr;
+        timer->next = nullptr;
     }
 
-    /* SIGALARM 信号每次被触发就在其信号处理函数中执行一次 tick() 函数，以处理链表上到期任务。*/
-    void tick() {
+    // 返回链表中的第一个定时器（最早到期），链表为空时返回 nullptr
+    util_timer* front() const
+    {
+        return head -> next == tail ? nullptr : head -> next;
+    }
+
+    /* SIGALARM 信号每次被触发就在其信号处理函数中执行一次 tick() 函数，以处理链表上到期任务。
+       返回本次到期的定时器个数 */
+    int tick() {
+        int expired = 0;
         if( head -> next == tail ) {
-            return;
+            return expired;
         }
         time_t cur = time( NULL );  // 获取当前系统时间
         util_timer* tmp = head -> next;
@@ -102,11 +126,13 @@ public:
             // 调用定时器的回调函数，以执行定时任务
             // 注意：前向声明的类指针不能去操纵自己的对象，因而这里不可以用user_data指针去调用close_conn
             tmp->m_cbfunc( tmp->m_user_data );
+            ++expired;
             // 执行完定时器中的定时任务之后，就将它从链表中删除
             tmp2 = tmp -> next;
             del_timer( tmp );
             tmp = tmp2;
         }
+        return expired;
     }
 };
 
@@ -12,19 +12,44 @@
 #include "http_conn.h"
 #include "lst_timer.h"
 #include "config.h"
+#include "log.h"
+#include "access_log.h"
+#include "capture.h"
+#include "trace.h"
 
 int main(int argc, char* argv[])
 {
     //检验命令行，获取端口号
     Config config;
-    config.parse_arg(argc, argv);
+    if (!config.parse_arg(argc, argv))
+    {
+        fprintf(stderr, "config error: %s\n", config.error());
+        return 1;
+    }
+
+    // 启动异步日志线程
+    Log::get_instance()->init(config.LogFile, config.LogLevel);
+    if (config.AccessLogFile[0] != '\0' && !AccessLog::get_instance()->init(config.AccessLogFile))
+    {
+        LOG_ERROR("open access log %s failed", config.AccessLogFile);
+    }
+    if (config.CaptureFile[0] != '\0' && !Capture::get_instance()->init(config.CaptureFile))
+    {
+        LOG_ERROR("open capture file %s failed (it must not exist or be empty)", config.CaptureFile);
+    }
+    Trace::init(config.TraceSample);
 
     Webserver webserver;
-    webserver.init(config.PORT, config.ActorMode, config.TrigMode);
+    webserver.init(config);
 
     webserver.thread_pool();
 
-    webserver.eventlisten();
+    if (!webserver.eventlisten())
+    {
+        fprintf(stderr, "start server failed, see the log for details\n");
+        Log::get_instance()->stop();
+        return 1;
+    }
 
     webserver.eventloop();
 
@@ -0,0 +1,96 @@
+#ifndef MESSAGE_FRAMER_H
+#define MESSAGE_FRAMER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <string>
+#include <algorithm>
+
+// 按 HTTP/1.1 的规则切分一个方向上的消息：头部，然后是 Content-length 或 chunked 编码的消息体。
+// 读完头部时停下，由调用者根据头部和对方的请求决定消息体的长度。
+// 只依赖标准库，loopback_transport 和客户端工具（tools/replay、loadgen）共用
+struct message_framer{
+    enum STATE { FR_HEADER = 0, FR_HEADER_DONE, FR_BODY, FR_CHUNK_SIZE, FR_CHUNK_DATA, FR_CHUNK_END, FR_TRAILER, FR_DONE };
+
+    STATE m_state;
+    std::string m_text;  // 未完成的头部或当前行；FR_HEADER_DONE 时是完整的头部
+    uint64_t m_left;     // 消息体或当前块剩余的字节数
+
+    message_framer() : m_state(FR_HEADER), m_left(0) {}
+
+    // 消耗数据直到头部读完、消息结束或数据用完，返回消耗的字节数
+    size_t feed(const char* data, size_t len)
+    {
+        size_t used = 0;
+        while (used < len && m_state != FR_HEADER_DONE && m_state != FR_DONE)
+        {
+            if (m_state == FR_BODY || m_state == FR_CHUNK_DATA)
+            {
+                size_t take = std::min((uint64_t)(len - used), m_left);
+                m_left -= take;
+                used += take;
+                if (m_left == 0) m_state = m_state == FR_BODY ? FR_DONE : FR_CHUNK_END;
+                continue;
+            }
+            // 其余状态按行处理
+            const char* nl = (const char*)memchr(data + used, '\n', len - used);
+            size_t n = nl ? nl - (data + used) + 1 : len - used;
+            m_text.append(data + used, n);
+            used += n;
+            if (!nl) break;
+            if (m_state == FR_HEADER)
+            {
+                if (m_text.size() >= 4 && m_text.compare(m_text.size() - 4, 4, "\r\n\r\n") == 0) m_state = FR_HEADER_DONE;
+                continue;
+            }
+            if (m_state == FR_CHUNK_SIZE)
+            {
+                m_left = strtoull(m_text.c_str(), NULL, 16);
+                m_state = m_left > 0 ? FR_CHUNK_DATA : FR_TRAILER;
+            }
+            else if (m_state == FR_CHUNK_END)
+            {
+                m_state = FR_CHUNK_SIZE;
+            }
+            else if (m_text == "\r\n")
+            {
+                m_state = FR_DONE; // 拖尾头部之后的空行
+            }
+            m_text.clear();
+        }
+        return used;
+    }
+
+    // 以下两个在 FR_HEADER_DONE 时使用：请求是否是 HEAD；应答的状态码，不是状态行时为 0
+    bool head_request() const { return m_text.compare(0, 5, "HEAD ") == 0; }
+    int status() const { return m_text.size() > 12 && m_text.compare(0, 7, "HTTP/1.") == 0 ? atoi(m_text.c_str() + 9) : 0; }
+
+    // 在 FR_HEADER_DONE 时调用，no_body 表示这条消息没有消息体（HEAD 的应答、1xx/204/304）
+    void start_body(bool no_body)
+    {
+        const char* te = strcasestr(m_text.c_str(), "\ntransfer-encoding:");
+        const char* cl = strcasestr(m_text.c_str(), "\ncontent-length:");
+        bool chunked = false;
+        if (te)
+        {
+            std::string value(te, strchr(te + 1, '\n') - te);
+            chunked = strcasestr(value.c_str(), "chunked") != NULL;
+        }
+        m_left = !no_body && !chunked && cl ? strtoull(cl + 16, NULL, 10) : 0;
+        if (no_body) m_state = FR_DONE;
+        else if (chunked) m_state = FR_CHUNK_SIZE;
+        else m_state = m_left > 0 ? FR_BODY : FR_DONE;
+        m_text.clear();
+    }
+
+    void reset()
+    {
+        m_state = FR_HEADER;
+        m_text.clear();
+        m_left = 0;
+    }
+};
+
+#endif
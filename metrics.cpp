@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+#include "log.h"
+#include "access_log.h"
+#include "capture.h"
+
+metrics_shard Metrics::m_shards[Metrics::MAX_SHARDS];
+std::atomic<int> Metrics::m_next_shard(0);
+std::atomic<int64_t> Metrics::m_gauges[GAUGE_NUM];
+__thread metrics_shard* Metrics::t_shard = NULL;
+
+static const char* stage_names[STAGE_NUM] = { "accept", "queue", "parse", "request", "write", "drain", "prefault" };
+
+// 导出的直方图边界（秒）
+static const double le_bounds[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+    1e-3, 2.5e-3, 5e-3, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+void Metrics::count_status(int status)
+{
+    switch (status)
+    {
+        case 200: inc(CNT_STATUS_200); break;
+        case 304: inc(CNT_STATUS_304); break;
+        case 400: inc(CNT_STATUS_400); break;
+        case 403: inc(CNT_STATUS_403); break;
+        case 404: inc(CNT_STATUS_404); break;
+        case 405: inc(CNT_STATUS_405); break;
+        case 413: inc(CNT_STATUS_413); break;
+        case 500: inc(CNT_STATUS_500); break;
+        default: break;
+    }
+}
+
+// /proc/net/netstat 中 TcpExt 的 ListenOverflows 和 ListenDrops，统计的是整个网络命名空间
+static bool read_listen_drops(uint64_t& overflows, uint64_t& drops)
+{
+    FILE* fp = fopen("/proc/net/netstat", "r");
+    if (!fp) return false;
+    char names[4096], values[4096];
+    bool found = false;
+    while (!found && fgets(names, sizeof(names), fp) && fgets(values, sizeof(values), fp))
+    {
+        if (strncmp(names, "TcpExt:", 7) != 0) continue;
+        found = true;
+        char* name_save;
+        char* value_save;
+        char* name = strtok_r(names, " \n", &name_save);
+        char* value = strtok_r(values, " \n", &value_save);
+        while (name && value)
+        {
+            if (strcmp(name, "ListenOverflows") == 0) overflows = strtoull(value, NULL, 10);
+            else if (strcmp(name, "ListenDrops") == 0) drops = strtoull(value, NULL, 10);
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+static void append_format(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+static void append_format(std::string& out, const char* format, ...)
+{
+    char line[256];
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(line, sizeof(line), format, arg_list);
+    va_end(arg_list);
+    if (len > 0) out.append(line, len < (int)sizeof(line) ? len : sizeof(line) - 1);
+}
+
+void Metrics::render(std::string& out)
+{
+    // 汇总所有分片，读取时不加锁，各个值之间只保证近似一致
+    uint64_t buckets[latency_histogram::BUCKETS];
+    uint64_t counters[CNT_NUM] = { 0 };
+    for (int s = 0; s < MAX_SHARDS; ++s)
+    {
+        for (int c = 0; c < CNT_NUM; ++c)
+        {
+            counters[c] += m_shards[s].m_counters[c].load(std::memory_order_relaxed);
+        }
+    }
+
+    out.append("# HELP ws_stage_duration_seconds Time spent in each server stage.\n");
+    out.append("# TYPE ws_stage_duration_seconds histogram\n");
+    std::string quantile_lines;
+    for (int st = 0; st < STAGE_NUM; ++st)
+    {
+        uint64_t total = 0, sum_ns = 0;
+        for (int b = 0; b < latency_histogram::BUCKETS; ++b)
+        {
+            buckets[b] = 0;
+            for (int s = 0; s < MAX_SHARDS; ++s)
+            {
+                buckets[b] += m_shards[s].m_hist[st].m_buckets[b].load(std::memory_order_relaxed);
+            }
+            total += buckets[b];
+        }
+        for (int s = 0; s < MAX_SHARDS; ++s)
+        {
+            sum_ns += m_shards[s].m_hist[st].m_sum.load(std::memory_order_relaxed);
+        }
+
+        // 累积计数：桶的上界不超过 le 的都计入
+        uint64_t cum = 0;
+        int b = 0;
+        for (size_t i = 0; i < sizeof(le_bounds) / sizeof(le_bounds[0]); ++i)
+        {
+            uint64_t le_ns = (uint64_t)(le_bounds[i] * 1e9);
+            while (b < latency_histogram::BUCKETS && latency_histogram::bucket_upper(b) <= le_ns)
+            {
+                cum += buckets[b++];
+            }
+            append_format(out, "ws_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                stage_names[st], le_bounds[i], (unsigned long long)cum);
+        }
+        append_format(out, "ws_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+            stage_names[st], (unsigned long long)total);
+        append_format(out, "ws_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[st], sum_ns / 1e9);
+        append_format(out, "ws_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+            stage_names[st], (unsigned long long)total);
+
+        // 分位数直接从 HDR 桶中计算，取桶的上界
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q)
+        {
+            uint64_t target = (uint64_t)(quantiles[q] * total + 0.5);
+            uint64_t seen = 0;
+            uint64_t value = 0;
+            for (int k = 0; k < latency_histogram::BUCKETS && total > 0; ++k)
+            {
+                seen += buckets[k];
+                if (seen >= target && seen > 0)
+                {
+                    value = latency_histogram::bucket_upper(k);
+                    break;
+                }
+            }
+            append_format(quantile_lines, "ws_stage_duration_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                stage_names[st], quantiles[q], value / 1e9);
+        }
+    }
+    out.append("# HELP ws_stage_duration_quantile_seconds Approximate quantiles of stage durations.\n");
+    out.append("# TYPE ws_stage_duration_quantile_seconds gauge\n");
+    out.append(quantile_lines);
+
+    append_format(out, "# TYPE ws_connections_accepted_total counter\nws_connections_accepted_total %llu\n",
+        (unsigned long long)counters[CNT_CONN_ACCEPTED]);
+    append_format(out, "# TYPE ws_connections_closed_total counter\nws_connections_closed_total %llu\n",
+        (unsigned long long)counters[CNT_CONN_CLOSED]);
+    append_format(out, "# TYPE ws_connections_rejected_total counter\nws_connections_rejected_total %llu\n",
+        (unsigned long long)counters[CNT_CONN_REJECTED]);
+    append_format(out, "# TYPE ws_connections_active gauge\nws_connections_active %lld\n",
+        (long long)(counters[CNT_CONN_ACCEPTED] - counters[CNT_CONN_CLOSED]));
+    append_format(out, "# TYPE ws_connections_evicted_total counter\nws_connections_evicted_total %llu\n",
+        (unsigned long long)counters[CNT_CONN_EVICTED]);
+    out.append("# TYPE ws_rate_limited_total counter\n");
+    append_format(out, "ws_rate_limited_total{scope=\"conn\"} %llu\n", (unsigned long long)counters[CNT_CONN_LIMITED]);
+    append_format(out, "ws_rate_limited_total{scope=\"request\"} %llu\n", (unsigned long long)counters[CNT_REQ_LIMITED]);
+    append_format(out, "# TYPE ws_connections_idle gauge\nws_connections_idle %lld\n",
+        (long long)m_gauges[GAUGE_IDLE_CONNS].load(std::memory_order_relaxed));
+    append_format(out, "# TYPE ws_read_bytes_total counter\nws_read_bytes_total %llu\n",
+        (unsigned long long)counters[CNT_BYTES_READ]);
+    append_format(out, "# TYPE ws_written_bytes_total counter\nws_written_bytes_total %llu\n",
+        (unsigned long long)counters[CNT_BYTES_WRITTEN]);
+
+    out.append("# TYPE ws_responses_total counter\n");
+    static const int codes[] = { 200, 304, 400, 403, 404, 405, 413, 500 };
+    for (int i = 0; i < 8; ++i)
+    {
+        append_format(out, "ws_responses_total{code=\"%d\"} %llu\n", codes[i],
+            (unsigned long long)counters[CNT_STATUS_200 + i]);
+    }
+
+    append_format(out, "# TYPE ws_accept_wakeups_total counter\nws_accept_wakeups_total %llu\n",
+        (unsigned long long)counters[CNT_ACCEPT_WAKEUPS]);
+    append_format(out, "# TYPE ws_accept_batch_full_total counter\nws_accept_batch_full_total %llu\n",
+        (unsigned long long)counters[CNT_ACCEPT_BATCH_FULL]);
+    append_format(out, "# TYPE ws_accept_queue gauge\nws_accept_queue %lld\n",
+        (long long)m_gauges[GAUGE_ACCEPT_QUEUE].load(std::memory_order_relaxed));
+    append_format(out, "# TYPE ws_accept_backlog gauge\nws_accept_backlog %lld\n",
+        (long long)m_gauges[GAUGE_ACCEPT_BACKLOG].load(std::memory_order_relaxed));
+    uint64_t overflows = 0, drops = 0;
+    if (read_listen_drops(overflows, drops))
+    {
+        out.append("# HELP ws_listen_overflows_total Accept queue overflows in this network namespace.\n");
+        append_format(out, "# TYPE ws_listen_overflows_total counter\nws_listen_overflows_total %llu\n",
+            (unsigned long long)overflows);
+        append_format(out, "# TYPE ws_listen_drops_total counter\nws_listen_drops_total %llu\n",
+            (unsigned long long)drops);
+    }
+
+    append_format(out, "# TYPE ws_queue_depth gauge\nws_queue_depth %lld\n",
+        (long long)m_gauges[GAUGE_QUEUE_DEPTH].load(std::memory_order_relaxed));
+    append_format(out, "# TYPE ws_queue_dropped_total counter\nws_queue_dropped_total %llu\n",
+        (unsigned long long)counters[CNT_QUEUE_DROPPED]);
+    append_format(out, "# TYPE ws_timer_expired_total counter\nws_timer_expired_total %llu\n",
+        (unsigned long long)counters[CNT_TIMER_EXPIRED]);
+    out.append("# TYPE ws_deadline_expired_total counter\n");
+    static const char* phases[] = { "head", "body", "send" };
+    for (int i = 0; i < 3; ++i)
+    {
+        append_format(out, "ws_deadline_expired_total{phase=\"%s\"} %llu\n", phases[i],
+            (unsigned long long)counters[CNT_DEADLINE_HEAD + i]);
+    }
+    out.append("# TYPE ws_micro_cache_total counter\n");
+    static const char* cache_results[] = { "hit", "stale", "miss", "coalesced", "bypass" };
+    for (int i = 0; i < 5; ++i)
+    {
+        append_format(out, "ws_micro_cache_total{result=\"%s\"} %llu\n", cache_results[i],
+            (unsigned long long)counters[CNT_CACHE_HIT + i]);
+    }
+    append_format(out, "# TYPE ws_log_dropped_total counter\nws_log_dropped_total %llu\n",
+        (unsigned long long)Log::get_instance()->dropped());
+    append_format(out, "# TYPE ws_access_log_dropped_total counter\nws_access_log_dropped_total %llu\n",
+        (unsigned long long)AccessLog::get_instance()->dropped());
+    append_format(out, "# TYPE ws_capture_dropped_total counter\nws_capture_dropped_total %llu\n",
+        (unsigned long long)Capture::get_instance()->dropped());
+}
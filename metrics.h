@@ -0,0 +1,156 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+
+// 服务器内部各阶段的耗时
+enum METRIC_STAGE {
+    STAGE_ACCEPT = 0,   // accept + 初始化连接
+    STAGE_QUEUE,        // 在线程池工作队列中等待的时间
+    STAGE_PARSE,        // process_read() 解析请求（不含 do_request）
+    STAGE_REQUEST,      // do_request() 查找并映射文件
+    STAGE_WRITE,        // process_write() 填充应答
+    STAGE_DRAIN,        // 从第一次 write() 到应答全部写入 socket
+    STAGE_PREFAULT,     // 冷文件从提交预读到读入页缓存
+    STAGE_NUM
+};
+
+// 计数器
+enum METRIC_COUNTER {
+    CNT_CONN_ACCEPTED = 0,
+    CNT_CONN_CLOSED,
+    CNT_CONN_REJECTED,      // 连接数已满被拒绝
+    CNT_BYTES_READ,
+    CNT_BYTES_WRITTEN,
+    CNT_STATUS_200,
+    CNT_STATUS_304,
+    CNT_STATUS_400,
+    CNT_STATUS_403,
+    CNT_STATUS_404,
+    CNT_STATUS_405,
+    CNT_STATUS_413,
+    CNT_STATUS_500,
+    CNT_QUEUE_DROPPED,      // 工作队列已满，append 失败
+    CNT_TIMER_EXPIRED,      // 定时器到期关闭的连接
+    CNT_ACCEPT_WAKEUPS,     // 监听 socket 可读的次数
+    CNT_ACCEPT_BATCH_FULL,  // 一次唤醒 accept 达到上限，队列中可能还有连接
+    CNT_CONN_EVICTED,       // 为接纳新连接或超过空闲上限而关闭的空闲 keep-alive 连接
+    CNT_CONN_LIMITED,       // 超过单个 IP 或子网的并发连接数，返回 429
+    CNT_REQ_LIMITED,        // 超过单个 IP 或子网的请求速率，返回 429
+    CNT_DEADLINE_HEAD,      // 超过期限被关闭的连接，按所处阶段（http_conn::PHASE）分别计数
+    CNT_DEADLINE_BODY,
+    CNT_DEADLINE_SEND,
+    CNT_CACHE_HIT,          // 处理函数应答缓存（micro_cache.h）：命中
+    CNT_CACHE_STALE,        // 命中过期的应答，同时有请求在重新生成
+    CNT_CACHE_MISS,         // 调用处理函数生成应答
+    CNT_CACHE_COALESCED,    // 等待同一个键的生成完成后命中
+    CNT_CACHE_BYPASS,       // 不使用缓存：缓存关闭或已满、应答不能缓存、等待超时
+    CNT_NUM
+};
+
+// 瞬时值，只有一份，不分片
+enum METRIC_GAUGE {
+    GAUGE_QUEUE_DEPTH = 0,
+    GAUGE_ACCEPT_QUEUE,     // 监听 socket 全连接队列的长度，定时采样
+    GAUGE_ACCEPT_BACKLOG,   // 全连接队列的上限
+    GAUGE_IDLE_CONNS,       // 空闲的 keep-alive 连接数
+    GAUGE_NUM
+};
+
+// HDR 风格的对数-线性分桶：每个 2 的幂区间再等分为 2^SUB_BITS 个子桶，相对误差不超过 1/16
+// 记录值单位为纳秒，最大约 2^36 ns (68s)，超出的记入最后一个桶
+class latency_histogram{
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_EXP = 36;
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+    static int bucket_index(uint64_t v)
+    {
+        if (v < (uint64_t)SUB_COUNT) return (int)v;
+        int e = 63 - __builtin_clzll(v);
+        if (e > MAX_EXP) return BUCKETS - 1;
+        int sub = (int)((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+        return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+    }
+
+    // 桶 idx 能容纳的最大值
+    static uint64_t bucket_upper(int idx)
+    {
+        if (idx < SUB_COUNT) return idx;
+        int e = idx / SUB_COUNT + SUB_BITS - 1;
+        uint64_t sub = idx % SUB_COUNT;
+        return ((SUB_COUNT + sub + 1) << (e - SUB_BITS)) - 1;
+    }
+
+    void record(uint64_t v)
+    {
+        m_buckets[bucket_index(v)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+    std::atomic<uint64_t> m_sum;
+};
+
+// 每个线程写自己的分片，读取时再汇总，避免多个线程同时写同一条缓存行
+struct alignas(64) metrics_shard{
+    latency_histogram m_hist[STAGE_NUM];
+    std::atomic<uint64_t> m_counters[CNT_NUM];
+};
+
+class Metrics{
+public:
+    static const int MAX_SHARDS = 32;
+
+    static uint64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static void record(METRIC_STAGE stage, uint64_t ns)
+    {
+        shard()->m_hist[stage].record(ns);
+    }
+
+    // 记录从 start_ns 到现在的耗时，start_ns 为 0 表示没有开始计时
+    static void record_since(METRIC_STAGE stage, uint64_t start_ns)
+    {
+        if (start_ns) record(stage, now_ns() - start_ns);
+    }
+
+    static void inc(METRIC_COUNTER counter, uint64_t n = 1)
+    {
+        shard()->m_counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static void set_gauge(METRIC_GAUGE gauge, int64_t v)
+    {
+        m_gauges[gauge].store(v, std::memory_order_relaxed);
+    }
+
+    static void count_status(int status);
+
+    // 以 Prometheus 文本格式输出所有指标
+    static void render(std::string& out);
+
+private:
+    static metrics_shard* shard()
+    {
+        if (!t_shard) t_shard = &m_shards[m_next_shard.fetch_add(1, std::memory_order_relaxed) % MAX_SHARDS];
+        return t_shard;
+    }
+
+    static metrics_shard m_shards[MAX_SHARDS];
+    static std::atomic<int> m_next_shard;
+    static std::atomic<int64_t> m_gauges[GAUGE_NUM];
+    static __thread metrics_shard* t_shard;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include <time.h>
+#include "micro_cache.h"
+#include "metrics.h"
+#include "probes.h"
+
+MicroCache::cache_shard MicroCache::m_shards[MicroCache::SHARDS];
+std::atomic<size_t> MicroCache::m_shard_capacity(0);
+std::atomic<uint64_t> MicroCache::m_stale_ns(0);
+
+// 缩小上限时已有的项不立即删除，过期之后由 evict 清理
+void MicroCache::set_limits(int max_entries, int stale_ms)
+{
+    m_shard_capacity.store((max_entries + SHARDS - 1) / SHARDS, std::memory_order_relaxed);
+    m_stale_ns.store((uint64_t)stale_ms * 1000000ULL, std::memory_order_relaxed);
+}
+
+MicroCache::cache_shard& MicroCache::shard_of(const std::string& key)
+{
+    return m_shards[std::hash<std::string>()(key) & (SHARDS - 1)];
+}
+
+// 删除已经不能再使用的项，正在生成的项保留。分片满时才调用，返回是否腾出了空间
+bool MicroCache::evict(cache_shard& shard, uint64_t now)
+{
+    std::unordered_map<std::string, cache_entry>::iterator it = shard.m_entries.begin();
+    while (it != shard.m_entries.end())
+    {
+        const cache_entry& e = it->second;
+        if (!e.m_filling && now >= e.m_stale_until && now >= e.m_bypass_until) it = shard.m_entries.erase(it);
+        else ++it;
+    }
+    return shard.m_entries.size() < m_shard_capacity.load(std::memory_order_relaxed);
+}
+
+MicroCache::RESULT MicroCache::bypass(const std::string& key)
+{
+    Metrics::inc(CNT_CACHE_BYPASS);
+    WS_PROBE2(cache_bypass, key.data(), key.size());
+    return CACHE_BYPASS;
+}
+
+MicroCache::RESULT MicroCache::lookup(const std::string& key, std::shared_ptr<const cache_value>& value)
+{
+    uint64_t now = Metrics::now_ns();
+    if (m_shard_capacity.load(std::memory_order_relaxed) == 0) return bypass(key);
+    cache_shard& shard = shard_of(key);
+    uint64_t wait_start = 0; // 开始等待正在生成的请求的时间，0 表示没有等待
+    struct timespec deadline;
+    shard.m_lock.lock();
+    while (true)
+    {
+        std::unordered_map<std::string, cache_entry>::iterator it = shard.m_entries.find(key);
+        if (it == shard.m_entries.end())
+        {
+            if (shard.m_entries.size() >= m_shard_capacity.load(std::memory_order_relaxed) && !evict(shard, now))
+            {
+                shard.m_lock.unlock();
+                return bypass(key);
+            }
+            cache_entry& e = shard.m_entries[key];
+            e.m_fresh_until = e.m_stale_until = e.m_bypass_until = 0;
+            e.m_filling = true;
+            shard.m_lock.unlock();
+            Metrics::inc(CNT_CACHE_MISS);
+            WS_PROBE2(cache_miss, key.data(), key.size());
+            return CACHE_FILL;
+        }
+        cache_entry& e = it->second;
+        if (e.m_value && now < e.m_fresh_until)
+        {
+            value = e.m_value;
+            shard.m_lock.unlock();
+            if (wait_start)
+            {
+                Metrics::inc(CNT_CACHE_COALESCED);
+                WS_PROBE3(cache_coalesced, key.data(), key.size(), wait_start);
+            }
+            else
+            {
+                Metrics::inc(CNT_CACHE_HIT);
+                WS_PROBE2(cache_hit, key.data(), key.size());
+            }
+            return CACHE_HIT;
+        }
+        if (e.m_value && now < e.m_stale_until)
+        {
+            // 已经有请求在重新生成时使用旧的应答，否则由这个请求重新生成
+            if (e.m_filling)
+            {
+                value = e.m_value;
+                shard.m_lock.unlock();
+                Metrics::inc(CNT_CACHE_STALE);
+                WS_PROBE2(cache_stale, key.data(), key.size());
+                return CACHE_HIT;
+            }
+            e.m_filling = true;
+            shard.m_lock.unlock();
+            Metrics::inc(CNT_CACHE_MISS);
+            WS_PROBE2(cache_miss, key.data(), key.size());
+            return CACHE_FILL;
+        }
+        if (!e.m_filling)
+        {
+            if (now < e.m_bypass_until)
+            {
+                shard.m_lock.unlock();
+                return bypass(key);
+            }
+            e.m_value.reset();
+            e.m_filling = true;
+            shard.m_lock.unlock();
+            Metrics::inc(CNT_CACHE_MISS);
+            WS_PROBE2(cache_miss, key.data(), key.size());
+            return CACHE_FILL;
+        }
+        // 没有可用的应答，等正在生成的请求完成。等待超时（处理函数很慢）时自己调用处理函数
+        if (!wait_start)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += WAIT_MS / 1000;
+            deadline.tv_nsec += (WAIT_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            wait_start = now;
+        }
+        if (!shard.m_cond.timedwait(shard.m_lock.get(), deadline))
+        {
+            shard.m_lock.unlock();
+            return bypass(key);
+        }
+        now = Metrics::now_ns();
+    }
+}
+
+void MicroCache::fill(const std::string& key, int ttl_ms, const std::shared_ptr<const cache_value>& value)
+{
+    cache_shard& shard = shard_of(key);
+    uint64_t now = Metrics::now_ns();
+    uint64_t ttl = (uint64_t)ttl_ms * 1000000ULL;
+    shard.m_lock.lock();
+    // 正在生成的项不会被 evict 删除
+    std::unordered_map<std::string, cache_entry>::iterator it = shard.m_entries.find(key);
+    if (it != shard.m_entries.end())
+    {
+        cache_entry& e = it->second;
+        e.m_value = value;
+        e.m_fresh_until = now + ttl;
+        e.m_stale_until = value ? e.m_fresh_until + m_stale_ns.load(std::memory_order_relaxed) : 0;
+        e.m_bypass_until = value ? 0 : now + ttl;
+        e.m_filling = false;
+    }
+    shard.m_cond.broadcast();
+    shard.m_lock.unlock();
+}
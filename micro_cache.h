@@ -0,0 +1,65 @@
+#ifndef MICRO_CACHE_H
+#define MICRO_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include "locker.h"
+
+// 缓存的应答，发布之后不再修改，多个连接共享。m_type 必须是静态字符串
+struct cache_value{
+    std::string m_body;
+    const char* m_type;
+    int m_status;
+};
+
+struct cache_entry{
+    std::shared_ptr<const cache_value> m_value; // 没有可用的应答时为空
+    uint64_t m_fresh_until;  // 在此之前直接使用 m_value
+    uint64_t m_stale_until;  // 在此之前过期的 m_value 仍可使用，同时由一个请求重新生成
+    uint64_t m_bypass_until; // 处理函数的结果不能缓存（不是 DYNAMIC_REQUEST），在此之前不缓存也不合并
+    bool m_filling;          // 有一个请求正在调用处理函数生成应答
+};
+
+// 处理函数应答的短时缓存（毫秒到秒级）。同一个键的并发未命中只调用一次处理函数，
+// 其余请求等它完成后使用它的结果；过期不久的应答在重新生成期间继续使用（stale-while-revalidate）。
+// 按键的哈希分成 SHARDS 个分片，每个分片有自己的锁，工作线程之间很少争抢同一把锁。
+// 命中时只在锁内复制 shared_ptr，应答内容在锁外复制到连接的缓冲区
+class MicroCache{
+public:
+    enum RESULT {
+        CACHE_HIT = 0,  // value 是新鲜的或（正在重新生成时）过期不久的应答
+        CACHE_FILL,     // 调用者负责调用处理函数，之后必须调用 fill()
+        CACHE_BYPASS    // 不使用缓存，直接调用处理函数
+    };
+
+    // 最多缓存的键数（0 表示不使用缓存）和过期之后还能使用的时间。由主线程在启动和重新加载配置时调用
+    static void set_limits(int max_entries, int stale_ms);
+
+    // 工作线程并发调用。另一个请求正在生成同一个键时在这里等待，最多 WAIT_MS 毫秒
+    static RESULT lookup(const std::string& key, std::shared_ptr<const cache_value>& value);
+    // 结束 CACHE_FILL。value 为空表示这次的应答不能缓存，ttl_ms 内同一个键都直接调用处理函数
+    static void fill(const std::string& key, int ttl_ms, const std::shared_ptr<const cache_value>& value);
+
+private:
+    static const int SHARDS = 16;
+    static const int WAIT_MS = 1000;
+
+    struct alignas(64) cache_shard{
+        locker m_lock;
+        cond m_cond; // 生成完成时广播
+        std::unordered_map<std::string, cache_entry> m_entries;
+    };
+
+    static cache_shard& shard_of(const std::string& key);
+    static bool evict(cache_shard& shard, uint64_t now);
+    static RESULT bypass(const std::string& key); // 计数并返回 CACHE_BYPASS
+
+    static cache_shard m_shards[SHARDS];
+    static std::atomic<size_t> m_shard_capacity;
+    static std::atomic<uint64_t> m_stale_ns;
+};
+
+#endif
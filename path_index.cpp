@@ -0,0 +1,272 @@
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "path_index.h"
+#include "log.h"
+
+rwlocker PathIndex::m_lock;
+std::unordered_map<std::string, uint8_t> PathIndex::m_entries;
+std::unordered_map<int, std::string> PathIndex::m_watches;
+std::string PathIndex::m_root;
+size_t PathIndex::m_max_entries = 0;
+int PathIndex::m_fd = -1;
+std::atomic<bool> PathIndex::m_enabled(false);
+
+// 只关心目录项的增减，文件内容和属性的变化不影响索引
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// 查找时复用的键，避免每次查找都分配内存
+static thread_local std::string t_key;
+
+static std::string full_path(const std::string& root, const std::string& rel)
+{
+    std::string path = root + rel;
+    return path.empty() ? "/" : path;
+}
+
+bool PathIndex::build(const char* doc_root, int max_entries)
+{
+    if (m_fd < 0)
+    {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0)
+        {
+            LOG_WARN("inotify_init1 failed, errno is %d, path index disabled", errno);
+            return false;
+        }
+    }
+    m_root = doc_root;
+    while (!m_root.empty() && m_root[m_root.size() - 1] == '/') m_root.erase(m_root.size() - 1);
+    m_max_entries = max_entries;
+    return rebuild();
+}
+
+void PathIndex::shutdown()
+{
+    m_enabled.store(false, std::memory_order_release);
+    if (m_fd >= 0) close(m_fd);
+    m_fd = -1;
+    m_watches.clear();
+    m_lock.wrlock();
+    m_entries.clear();
+    m_lock.unlock();
+}
+
+// 重新扫描整个目录树。扫描期间不使用索引，查找都返回 PATH_UNKNOWN
+bool PathIndex::rebuild()
+{
+    m_enabled.store(false, std::memory_order_release);
+    for (std::unordered_map<int, std::string>::iterator it = m_watches.begin(); it != m_watches.end(); ++it)
+    {
+        inotify_rm_watch(m_fd, it->first);
+    }
+    m_watches.clear();
+    m_lock.wrlock();
+    m_entries.clear();
+    m_lock.unlock();
+    if (!scan(""))
+    {
+        disable("scan failed");
+        return false;
+    }
+    m_enabled.store(true, std::memory_order_release);
+    LOG_INFO("path index: %zu entries, %zu directories watched", m_entries.size(), m_watches.size());
+    return true;
+}
+
+void PathIndex::disable(const char* reason)
+{
+    LOG_WARN("path index disabled (%s), fall back to stat", reason);
+    m_enabled.store(false, std::memory_order_release);
+    for (std::unordered_map<int, std::string>::iterator it = m_watches.begin(); it != m_watches.end(); ++it)
+    {
+        inotify_rm_watch(m_fd, it->first);
+    }
+    m_watches.clear();
+    m_lock.wrlock();
+    m_entries.clear();
+    m_lock.unlock();
+}
+
+// 先加监听再读目录，读目录期间新建的文件要么在目录中，要么会产生事件
+bool PathIndex::scan(const std::string& rel)
+{
+    std::string dir = full_path(m_root, rel);
+    int wd = inotify_add_watch(m_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0)
+    {
+        // 目录已经被删除时忽略，其余错误（通常是 max_user_watches 不够）放弃索引
+        if (errno == ENOENT || errno == ENOTDIR) return true;
+        LOG_WARN("inotify_add_watch %s failed, errno is %d", dir.c_str(), errno);
+        return false;
+    }
+    m_watches[wd] = rel;
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) return true;
+    bool ok = true;
+    struct dirent* ent;
+    while (ok && (ent = readdir(d)) != NULL)
+    {
+        const char* name = ent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        std::string child = rel + "/" + name;
+        uint8_t kind = KIND_FILE;
+        if (ent->d_type == DT_DIR) kind = KIND_DIR;
+        else if (ent->d_type == DT_LNK) kind = KIND_LINK;
+        else if (ent->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            if (lstat(full_path(m_root, child).c_str(), &st) < 0) continue;
+            if (S_ISDIR(st.st_mode)) kind = KIND_DIR;
+            else if (S_ISLNK(st.st_mode)) kind = KIND_LINK;
+        }
+        ok = add(child, kind) && (kind != KIND_DIR || scan(child));
+    }
+    closedir(d);
+    return ok;
+}
+
+bool PathIndex::add(const std::string& rel, uint8_t kind)
+{
+    m_lock.wrlock();
+    bool ok = m_entries.size() < m_max_entries || m_entries.count(rel);
+    if (ok) m_entries[rel] = kind;
+    m_lock.unlock();
+    return ok;
+}
+
+// 删除一个路径，是目录时连同其下的所有路径和监听一起删除
+void PathIndex::remove_tree(const std::string& rel)
+{
+    std::string prefix = rel + "/";
+    m_lock.wrlock();
+    std::unordered_map<std::string, uint8_t>::iterator it = m_entries.find(rel);
+    if (it == m_entries.end())
+    {
+        m_lock.unlock();
+        return;
+    }
+    bool dir = it->second == KIND_DIR;
+    m_entries.erase(it);
+    if (dir)
+    {
+        for (it = m_entries.begin(); it != m_entries.end(); )
+        {
+            if (it->first.compare(0, prefix.size(), prefix) == 0) it = m_entries.erase(it);
+            else ++it;
+        }
+    }
+    m_lock.unlock();
+    if (!dir) return;
+    // 改名移出的目录仍然被监听，之后的事件会用旧的路径，需要主动取消
+    for (std::unordered_map<int, std::string>::iterator w = m_watches.begin(); w != m_watches.end(); )
+    {
+        if (w->second == rel || w->second.compare(0, prefix.size(), prefix) == 0)
+        {
+            inotify_rm_watch(m_fd, w->first);
+            w = m_watches.erase(w);
+        }
+        else ++w;
+    }
+}
+
+void PathIndex::handle_events()
+{
+    char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool overflow = false;
+    bool full = false;
+    while (true)
+    {
+        ssize_t n = read(m_fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        // 索引已停用时只清空事件
+        if (!enabled()) continue;
+        const struct inotify_event* ev;
+        for (char* p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event*)p;
+            if (ev->mask & IN_Q_OVERFLOW)
+            {
+                overflow = true;
+                continue;
+            }
+            std::unordered_map<int, std::string>::iterator it = m_watches.find(ev->wd);
+            if (it == m_watches.end()) continue;
+            if (ev->mask & IN_IGNORED)
+            {
+                m_watches.erase(it);
+                continue;
+            }
+            // 根目录本身被删除或改名，重新扫描（通常会失败并停用索引）
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                if (it->second.empty()) overflow = true;
+                continue;
+            }
+            if (ev->len == 0) continue;
+            std::string rel = it->second + "/" + ev->name;
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+            {
+                if (ev->mask & IN_ISDIR)
+                {
+                    full = full || !add(rel, KIND_DIR) || !scan(rel);
+                }
+                else
+                {
+                    struct stat st;
+                    bool link = lstat(full_path(m_root, rel).c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+                    full = full || !add(rel, link ? KIND_LINK : KIND_FILE);
+                }
+            }
+            else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                remove_tree(rel);
+            }
+        }
+    }
+    if (overflow)
+    {
+        LOG_WARN("%s", "path index lost events, rescan");
+        rebuild();
+    }
+    else if (full)
+    {
+        disable("too many entries or watches");
+    }
+}
+
+PathIndex::LOOKUP PathIndex::lookup(const char* path, size_t len)
+{
+    if (!enabled()) return PATH_UNKNOWN;
+    while (len > 1 && path[len - 1] == '/') len--;
+    if (len <= 1) return PATH_EXISTS; // 根目录
+    t_key.assign(path, len);
+    LOOKUP ret = PATH_MISSING;
+    m_lock.rdlock();
+    if (m_entries.count(t_key))
+    {
+        ret = PATH_EXISTS;
+    }
+    else
+    {
+        // 路径中间经过符号链接时索引中没有下面的内容，交给 stat
+        size_t pos = t_key.rfind('/');
+        while (pos != std::string::npos && pos > 0)
+        {
+            t_key.resize(pos);
+            std::unordered_map<std::string, uint8_t>::const_iterator it = m_entries.find(t_key);
+            if (it != m_entries.end())
+            {
+                if (it->second == KIND_LINK) ret = PATH_UNKNOWN;
+                break;
+            }
+            pos = t_key.rfind('/');
+        }
+    }
+    m_lock.unlock();
+    return ret;
+}
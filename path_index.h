@@ -0,0 +1,58 @@
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <unordered_map>
+#include "locker.h"
+
+// 文档根目录的文件树索引。启动时扫描一次，之后用 inotify 跟踪文件的创建、删除和改名。
+// 请求的路径不在索引中时直接返回 404，不需要 stat 走一遍内核的路径解析。
+// 索引只记录路径是否存在，权限、大小等仍以 stat 的结果为准。
+// 符号链接指向的目录不扫描（避免循环），链接下面的路径查不到时交给 stat 判断。
+// inotify 不可用、监听数超过系统上限或文件数超过上限时不使用索引，所有请求都走 stat
+class PathIndex{
+public:
+    enum LOOKUP {
+        PATH_MISSING = 0,   // 确定不存在
+        PATH_EXISTS,        // 存在（文件或目录）
+        PATH_UNKNOWN        // 索引未启用，或路径在符号链接下面
+    };
+
+    // 扫描 doc_root 建立索引，max_entries 是最多记录的路径数。只由主线程调用，
+    // 重新加载配置修改了 doc_root 时再次调用，inotify 描述符保持不变
+    static bool build(const char* doc_root, int max_entries);
+    // 关闭 inotify 描述符并清空索引
+    static void shutdown();
+    // 主线程在 epoll 中监听它，没有时为 -1
+    static int watch_fd() { return m_fd; }
+    // 处理 inotify 事件，只由主线程调用
+    static void handle_events();
+    static bool enabled() { return m_enabled.load(std::memory_order_acquire); }
+
+    // path 是规范化之后的请求路径，以 '/' 开头。工作线程并发调用
+    static LOOKUP lookup(const char* path, size_t len);
+
+private:
+    enum KIND { KIND_FILE = 0, KIND_DIR, KIND_LINK };
+
+    static bool scan(const std::string& rel);
+    static bool add(const std::string& rel, uint8_t kind);
+    static void remove_tree(const std::string& rel);
+    static void disable(const char* reason);
+    static bool rebuild();
+
+    static rwlocker m_lock;
+    // 相对于根目录的路径（以 '/' 开头，不以 '/' 结尾）到类型，受 m_lock 保护
+    static std::unordered_map<std::string, uint8_t> m_entries;
+    // inotify 监听描述符到目录的相对路径，只由主线程访问
+    static std::unordered_map<int, std::string> m_watches;
+    static std::string m_root;
+    static size_t m_max_entries;
+    static int m_fd;
+    static std::atomic<bool> m_enabled;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT 静态探针，provider 为 webserver，可以用 bpftrace / perf 挂载：
+//   bpftrace -l 'usdt:./app:webserver:*'
+// 探针未启用时只是一条 nop 指令；参数都是现成的值，不会为探针额外计算
+// 时间参数使用 CLOCK_MONOTONIC 纳秒，与 bpftrace 的 nsecs 相同，可以直接相减
+//
+//   conn_accept(fd, conn_id, ip, port)         ip/port 为网络字节序
+//   conn_close(fd, conn_id)
+//   request_start(fd, conn_id)                  读到请求的第一个字节
+//   request_end(conn_id, status, bytes, start_ns)
+//   queue_enqueue(request, depth)
+//   queue_dequeue(request, depth, enqueue_ns)
+//   timer_expire(conn_id)
+//   cache_hit(key, key_len)                     key 不以 '\0' 结尾，用 str(arg0, arg1) 读取
+//   cache_stale(key, key_len)
+//   cache_miss(key, key_len)
+//   cache_coalesced(key, key_len, wait_start_ns) 等待另一个请求生成完成后命中
+//   cache_bypass(key, key_len)
+//
+// 系统中没有 <sys/sdt.h>（systemtap-sdt-dev）或定义了 WS_NO_PROBES 时，探针被编译为空
+#if !defined(WS_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WS_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef WS_HAVE_PROBES
+#define WS_PROBE1(name, a1) STAP_PROBE1(webserver, name, a1)
+#define WS_PROBE2(name, a1, a2) STAP_PROBE2(webserver, name, a1, a2)
+#define WS_PROBE3(name, a1, a2, a3) STAP_PROBE3(webserver, name, a1, a2, a3)
+#define WS_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(webserver, name, a1, a2, a3, a4)
+#else
+#define WS_PROBE1(name, a1) do {} while (0)
+#define WS_PROBE2(name, a1, a2) do {} while (0)
+#define WS_PROBE3(name, a1, a2, a3) do {} while (0)
+#define WS_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
+
+#endif
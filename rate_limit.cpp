@@ -0,0 +1,98 @@
+#include <time.h>
+#include <arpa/inet.h>
+#include "rate_limit.h"
+
+rate_slot* RateLimit::m_ip_slots = NULL;
+rate_slot* RateLimit::m_subnet_slots = NULL;
+int RateLimit::m_shift = 32;
+uint32_t RateLimit::m_subnet_mask = 0xffffff00u;
+rate_limits RateLimit::m_limits;
+
+void RateLimit::init(int table_bits, int subnet_prefix)
+{
+    // 进程退出前一直使用，不释放；再次初始化时（bench 中依次创建多个服务器）换成新表
+    delete[] m_ip_slots;
+    delete[] m_subnet_slots;
+    m_ip_slots = new rate_slot[1u << table_bits]();
+    m_subnet_slots = new rate_slot[1u << table_bits]();
+    m_shift = 32 - table_bits;
+    m_subnet_mask = subnet_prefix == 0 ? 0 : 0xffffffffu << (32 - subnet_prefix);
+}
+
+void RateLimit::set_limits(const rate_limits& limits)
+{
+    m_limits = limits;
+}
+
+uint32_t RateLimit::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// 乘法哈希，取乘积的高位作为下标
+rate_slot& RateLimit::ip_slot(uint32_t ip)
+{
+    return m_ip_slots[(ntohl(ip) * 2654435761u) >> m_shift];
+}
+
+rate_slot& RateLimit::subnet_slot(uint32_t ip)
+{
+    return m_subnet_slots[((ntohl(ip) & m_subnet_mask) * 2654435761u) >> m_shift];
+}
+
+bool RateLimit::acquire_conn(uint32_t ip)
+{
+    if (!m_ip_slots) return true;
+    rate_slot& host = ip_slot(ip);
+    rate_slot& net = subnet_slot(ip);
+    // 不限制时也计数，重新加载配置打开限制后计数仍然准确
+    int32_t host_conns = host.m_conns.fetch_add(1, std::memory_order_relaxed) + 1;
+    int32_t net_conns = net.m_conns.fetch_add(1, std::memory_order_relaxed) + 1;
+    if ((m_limits.m_ip_max_conns > 0 && host_conns > m_limits.m_ip_max_conns) ||
+        (m_limits.m_subnet_max_conns > 0 && net_conns > m_limits.m_subnet_max_conns))
+    {
+        host.m_conns.fetch_sub(1, std::memory_order_relaxed);
+        net.m_conns.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void RateLimit::release_conn(uint32_t ip)
+{
+    if (!m_ip_slots) return;
+    ip_slot(ip).m_conns.fetch_sub(1, std::memory_order_relaxed);
+    subnet_slot(ip).m_conns.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// 先按经过的时间补充令牌，再取一个。令牌不足时不修改表项，下次从同一个时间点重新计算
+bool RateLimit::take(rate_slot& slot, uint32_t now, int rate, int burst)
+{
+    if (rate <= 0) return true;
+    uint64_t cap = (uint64_t)(burst > 0 ? burst : rate) * 1000;
+    uint64_t old = slot.m_bucket.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint32_t last = (uint32_t)(old >> 32);
+        uint64_t tokens = (uint32_t)old;
+        // 无符号减法，时间回绕后仍然正确；从未使用过的表项 last 为 0，直接补满
+        uint64_t elapsed = (uint32_t)(now - last);
+        tokens += elapsed * rate; // 每毫秒补充 rate/1000 个令牌
+        if (tokens > cap) tokens = cap;
+        if (tokens < 1000) return false;
+        tokens -= 1000;
+        uint64_t next = ((uint64_t)now << 32) | tokens;
+        if (slot.m_bucket.compare_exchange_weak(old, next, std::memory_order_relaxed)) return true;
+    }
+}
+
+bool RateLimit::allow_request(uint32_t ip)
+{
+    if (!m_ip_slots) return true;
+    uint32_t now = now_ms();
+    // 先检查 IP，单个 IP 超限时不消耗子网的令牌
+    if (!take(ip_slot(ip), now, m_limits.m_ip_rate, m_limits.m_ip_burst)) return false;
+    return take(subnet_slot(ip), now, m_limits.m_subnet_rate, m_limits.m_subnet_burst);
+}
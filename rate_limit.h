@@ -0,0 +1,57 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+#include <atomic>
+
+// 每个客户端（IP）和每个子网的令牌桶与并发连接数。
+// 两张固定大小的哈希表在启动时分配，之后不再分配内存，查找和更新都是 O(1)。
+// 表项不保存键，哈希冲突的客户端共用一个表项，计数是近似的：冲突只会让限制提前生效，不会放过超限的客户端
+struct alignas(16) rate_slot{
+    // 高 32 位：上次补充令牌的时间（毫秒），低 32 位：剩余令牌数（千分之一个）
+    std::atomic<uint64_t> m_bucket;
+    // 当前的连接数，连接可能在工作线程中关闭
+    std::atomic<int32_t> m_conns;
+};
+
+// 限制值，0 表示不限制。rate 为每秒请求数，burst 为桶的容量
+struct rate_limits{
+    rate_limits() : m_ip_rate(0), m_ip_burst(0), m_ip_max_conns(0),
+        m_subnet_rate(0), m_subnet_burst(0), m_subnet_max_conns(0) {}
+
+    int m_ip_rate;
+    int m_ip_burst;
+    int m_ip_max_conns;
+    int m_subnet_rate;
+    int m_subnet_burst;
+    int m_subnet_max_conns;
+};
+
+class RateLimit{
+public:
+    // 分配两张 2^table_bits 项的表，subnet_prefix 是子网掩码长度。只在启动时调用一次
+    static void init(int table_bits, int subnet_prefix);
+    // 修改限制值，由主线程在启动和重新加载配置时调用
+    static void set_limits(const rate_limits& limits);
+
+    // 新连接计入所属 IP 和子网，超过并发连接数上限时不计入并返回 false。只由主线程调用
+    static bool acquire_conn(uint32_t ip);
+    // 连接关闭时调用，可能在工作线程中
+    static void release_conn(uint32_t ip);
+    // 连接上开始一个新请求时取一个令牌，令牌不足返回 false。只由主线程调用
+    static bool allow_request(uint32_t ip);
+
+private:
+    static rate_slot& ip_slot(uint32_t ip);
+    static rate_slot& subnet_slot(uint32_t ip);
+    static bool take(rate_slot& slot, uint32_t now_ms, int rate, int burst);
+    static uint32_t now_ms();
+
+    static rate_slot* m_ip_slots;
+    static rate_slot* m_subnet_slots;
+    static int m_shift;
+    static uint32_t m_subnet_mask;
+    static rate_limits m_limits;
+};
+
+#endif
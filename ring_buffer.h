@@ -0,0 +1,118 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <exception>
+
+// 单生产者单消费者(SPSC)的无锁环形缓冲区
+// 每条记录由 4 字节长度 + 数据组成，数据可以跨越缓冲区末尾（分两段拷贝）
+// 生产者只写 m_tail，消费者只写 m_head，两者放在不同的缓存行上避免伪共享
+class spsc_ring{
+public:
+    // capacity 会向上取整为 2 的幂
+    explicit spsc_ring(uint32_t capacity) : m_head(0), m_tail(0), m_cached_head(0)
+    {
+        m_capacity = 1;
+        while (m_capacity < capacity) m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+        m_buf = new char[m_capacity];
+        if (!m_buf)
+        {
+            throw std::exception();
+        }
+    }
+
+    ~spsc_ring()
+    {
+        delete[] m_buf;
+    }
+
+    // 生产者调用：写入一条由 hdr + data 两段拼成的记录，空间不足时返回 false，从不阻塞
+    bool push(const void* hdr, uint32_t hlen, const void* data, uint32_t dlen)
+    {
+        uint64_t need = sizeof(uint32_t) + hlen + dlen;
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail + need - m_cached_head > m_capacity)
+        {
+            // 先用缓存的消费者位置判断，不够时才去读一次共享的 m_head
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail + need - m_cached_head > m_capacity) return false;
+        }
+        uint32_t len = hlen + dlen;
+        copy_in(tail, &len, sizeof(len));
+        copy_in(tail + sizeof(len), hdr, hlen);
+        copy_in(tail + sizeof(len) + hlen, data, dlen);
+        m_tail.store(tail + need, std::memory_order_release);
+        return true;
+    }
+
+    bool push(const void* data, uint32_t len)
+    {
+        return push(data, len, NULL, 0);
+    }
+
+    // 消费者调用：取出一条记录写入 out，返回记录长度；没有记录时返回 0
+    // 记录比 cap 长时只拷贝前 cap 字节，剩余部分丢弃
+    uint32_t pop(void* out, uint32_t cap)
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        if (head == tail) return 0;
+        uint32_t len;
+        copy_out(head, &len, sizeof(len));
+        copy_out(head + sizeof(len), out, len < cap ? len : cap);
+        m_head.store(head + sizeof(len) + len, std::memory_order_release);
+        return len < cap ? len : cap;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    void copy_in(uint64_t pos, const void* src, uint32_t len)
+    {
+        if (len == 0) return;
+        uint32_t off = pos & m_mask;
+        uint32_t first = m_capacity - off;
+        if (first >= len)
+        {
+            memcpy(m_buf + off, src, len);
+        }
+        else
+        {
+            memcpy(m_buf + off, src, first);
+            memcpy(m_buf, (const char*)src + first, len - first);
+        }
+    }
+
+    void copy_out(uint64_t pos, void* dst, uint32_t len)
+    {
+        if (len == 0) return;
+        uint32_t off = pos & m_mask;
+        uint32_t first = m_capacity - off;
+        if (first >= len)
+        {
+            memcpy(dst, m_buf + off, len);
+        }
+        else
+        {
+            memcpy(dst, m_buf + off, first);
+            memcpy((char*)dst + first, m_buf, len - first);
+        }
+    }
+
+private:
+    char* m_buf;
+    uint32_t m_capacity;
+    uint64_t m_mask;
+
+    alignas(64) std::atomic<uint64_t> m_head; // 消费者的读位置
+    alignas(64) std::atomic<uint64_t> m_tail; // 生产者的写位置
+    uint64_t m_cached_head; // 生产者缓存的读位置，减少对 m_head 所在缓存行的访问
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include <string.h>
+#include <algorithm>
+#include "router.h"
+#include "log.h"
+
+std::vector<Router::build_node> Router::m_build;
+std::vector<route> Router::m_routes;
+std::vector<Router::route_node> Router::m_nodes;
+std::string Router::m_labels;
+std::string Router::m_first;
+unsigned Router::m_methods = 0;
+bool Router::m_compiled = false;
+
+int Router::new_node(const std::string& label, uint8_t kind)
+{
+    build_node node;
+    node.m_label = label;
+    node.m_kind = kind;
+    node.m_param = -1;
+    node.m_wild = -1;
+    node.m_route = -1;
+    m_build.push_back(node);
+    return m_build.size() - 1;
+}
+
+// 把静态串插入 n 的子树，返回串结束处的节点。与已有的边只有部分公共前缀时在公共前缀处拆开。
+// push_back 可能使引用失效，这里只保存下标
+int Router::insert_static(int n, const char* s, size_t len)
+{
+    while (len > 0)
+    {
+        int child = -1;
+        size_t slot = 0;
+        for (; slot < m_build[n].m_children.size(); ++slot)
+        {
+            int c = m_build[n].m_children[slot];
+            if (m_build[c].m_label[0] == s[0])
+            {
+                child = c;
+                break;
+            }
+        }
+        if (child < 0)
+        {
+            int c = new_node(std::string(s, len), NODE_STATIC);
+            m_build[n].m_children.push_back(c);
+            return c;
+        }
+        const std::string& label = m_build[child].m_label;
+        size_t common = 0;
+        while (common < label.size() && common < len && label[common] == s[common]) common++;
+        if (common < label.size())
+        {
+            int mid = new_node(label.substr(0, common), NODE_STATIC);
+            m_build[child].m_label.erase(0, common);
+            m_build[mid].m_children.push_back(child);
+            m_build[n].m_children[slot] = mid;
+            child = mid;
+        }
+        n = child;
+        s += common;
+        len -= common;
+    }
+    return n;
+}
+
+// 参数占据整段且名字非空，通配符只能是最后一段，参数不超过 ROUTE_MAX_PARAMS 个
+static bool valid_pattern(const char* pattern)
+{
+    if (pattern[0] != '/') return false;
+    int params = 0;
+    for (const char* p = pattern + 1; *p; ++p)
+    {
+        if ((*p != ':' && *p != '*') || p[-1] != '/') continue;
+        const char* end = strchrnul(p + 1, '/');
+        if (end == p + 1 || (*p == '*' && *end) || ++params > ROUTE_MAX_PARAMS) return false;
+    }
+    return true;
+}
+
+bool Router::add(unsigned methods, const char* pattern, route_handler handler, int cache_ms)
+{
+    if (m_compiled || !handler || !valid_pattern(pattern))
+    {
+        LOG_ERROR("bad route %s", pattern);
+        return false;
+    }
+    if (m_build.empty()) new_node("", NODE_STATIC);
+    route r;
+    r.m_methods = methods;
+    r.m_handler = handler;
+    r.m_cache_ms = cache_ms;
+    r.m_pattern = pattern;
+    r.m_next = -1;
+
+    int n = 0;
+    const char* p = pattern;
+    while (*p)
+    {
+        if ((*p == ':' || *p == '*') && p[-1] == '/')
+        {
+            const char* name = p + 1;
+            const char* end = strchrnul(name, '/');
+            r.m_params.push_back(std::string(name, end - name));
+            bool wild = *p == '*';
+            int child = wild ? m_build[n].m_wild : m_build[n].m_param;
+            if (child < 0)
+            {
+                child = new_node("", wild ? NODE_WILD : NODE_PARAM);
+                if (wild) m_build[n].m_wild = child;
+                else m_build[n].m_param = child;
+            }
+            n = child;
+            p = end;
+        }
+        else
+        {
+            const char* end = p + 1;
+            while (*end && !((*end == ':' || *end == '*') && end[-1] == '/')) end++;
+            n = insert_static(n, p, end - p);
+            p = end;
+        }
+    }
+    // 同一路径可以按方法注册多个处理函数，方法不能重叠
+    int* last = &m_build[n].m_route;
+    while (*last >= 0)
+    {
+        if (m_routes[*last].m_methods & methods)
+        {
+            LOG_ERROR("route %s conflicts with %s", pattern, m_routes[*last].m_pattern.c_str());
+            return false;
+        }
+        last = &m_routes[*last].m_next;
+    }
+    *last = m_routes.size();
+    m_routes.push_back(r);
+    m_methods |= methods;
+    return true;
+}
+
+static bool first_byte_less(const std::pair<char, int>& a, const std::pair<char, int>& b)
+{
+    return (unsigned char)a.first < (unsigned char)b.first;
+}
+
+void Router::compile()
+{
+    if (m_compiled) return;
+    if (m_build.empty()) new_node("", NODE_STATIC);
+    // 广度优先编号：同一节点的静态子节点按首字节排序后连续编号，参数和通配符子节点在其后
+    std::vector<int> order(1, 0);
+    std::vector<int> index(m_build.size(), -1);
+    index[0] = 0;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        build_node& b = m_build[order[i]];
+        std::vector<std::pair<char, int> > children;
+        for (size_t k = 0; k < b.m_children.size(); ++k)
+        {
+            children.push_back(std::make_pair(m_build[b.m_children[k]].m_label[0], b.m_children[k]));
+        }
+        std::sort(children.begin(), children.end(), first_byte_less);
+        b.m_children.clear();
+        for (size_t k = 0; k < children.size(); ++k)
+        {
+            b.m_children.push_back(children[k].second);
+            index[children[k].second] = order.size();
+            order.push_back(children[k].second);
+        }
+        if (b.m_param >= 0)
+        {
+            index[b.m_param] = order.size();
+            order.push_back(b.m_param);
+        }
+        if (b.m_wild >= 0)
+        {
+            index[b.m_wild] = order.size();
+            order.push_back(b.m_wild);
+        }
+    }
+    m_nodes.resize(order.size());
+    m_first.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const build_node& b = m_build[order[i]];
+        route_node& node = m_nodes[i];
+        node.m_label_off = m_labels.size();
+        node.m_label_len = b.m_label.size();
+        m_labels += b.m_label;
+        node.m_first_child = b.m_children.empty() ? 0 : index[b.m_children[0]];
+        node.m_child_count = b.m_children.size();
+        node.m_kind = b.m_kind;
+        node.m_param = b.m_param < 0 ? -1 : index[b.m_param];
+        node.m_wild = b.m_wild < 0 ? -1 : index[b.m_wild];
+        node.m_route = b.m_route;
+        m_first[i] = b.m_label.empty() ? '\0' : b.m_label[0];
+    }
+    m_build.clear();
+    m_compiled = true;
+    LOG_INFO("router: %zu routes, %zu nodes", m_routes.size(), m_nodes.size());
+}
+
+// 在节点 n 处匹配 [p, end)，成功时返回路由下标。静态子节点失败时回溯，依次尝试参数和通配符
+int Router::match_at(int n, const char* path, const char* p, const char* end, route_params& params)
+{
+    const route_node& node = m_nodes[n];
+    if (node.m_kind == NODE_STATIC)
+    {
+        if ((size_t)(end - p) < node.m_label_len || memcmp(p, m_labels.data() + node.m_label_off, node.m_label_len) != 0)
+        {
+            return -1;
+        }
+        p += node.m_label_len;
+    }
+    else
+    {
+        const char* q = node.m_kind == NODE_WILD ? end : (const char*)memchr(p, '/', end - p);
+        if (!q) q = end;
+        if (node.m_kind == NODE_PARAM && q == p) return -1;
+        params.m_off[params.m_count] = p - path;
+        params.m_len[params.m_count] = q - p;
+        params.m_count++;
+        p = q;
+    }
+    if (p == end && node.m_route >= 0) return node.m_route;
+    int count = params.m_count;
+    if (p < end)
+    {
+        const char* first = m_first.data() + node.m_first_child;
+        for (int i = 0; i < node.m_child_count; ++i)
+        {
+            if (first[i] != *p) continue;
+            int r = match_at(node.m_first_child + i, path, p, end, params);
+            if (r >= 0) return r;
+            params.m_count = count;
+            break;
+        }
+        if (node.m_param >= 0)
+        {
+            int r = match_at(node.m_param, path, p, end, params);
+            if (r >= 0) return r;
+            params.m_count = count;
+        }
+    }
+    if (node.m_wild >= 0)
+    {
+        int r = match_at(node.m_wild, path, p, end, params);
+        if (r >= 0) return r;
+        params.m_count = count;
+    }
+    return -1;
+}
+
+const route* Router::match(const char* path, size_t len, route_params& params)
+{
+    params.m_count = 0;
+    if (!m_compiled) return NULL;
+    int r = match_at(0, path, path, path + len, params);
+    return r < 0 ? NULL : &m_routes[r];
+}
@@ -0,0 +1,93 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "http_conn.h"
+
+// 请求处理函数。通过 http_conn 的公开接口读取请求（方法、路径参数、请求体），
+// 把应答写入连接自己的缓冲区（begin_reply/reply），或者返回错误码由 process_write 生成错误页
+typedef http_conn::HTTP_CODE (*route_handler)(http_conn& conn);
+
+// 方法掩码，GET 总是包含 HEAD（HEAD 的应答去掉消息体）
+#define ROUTE_METHOD(m) (1u << (m))
+enum {
+    ROUTE_GET = ROUTE_METHOD(http_conn::GET) | ROUTE_METHOD(http_conn::HEAD),
+    ROUTE_POST = ROUTE_METHOD(http_conn::POST),
+    ROUTE_PUT = ROUTE_METHOD(http_conn::PUT),
+    ROUTE_DELETE = ROUTE_METHOD(http_conn::DELETE),
+};
+
+struct route{
+    unsigned m_methods;
+    route_handler m_handler;
+    int m_cache_ms; //GET/HEAD 应答在 MicroCache 中缓存的毫秒数，0 表示不缓存
+    std::string m_pattern;
+    // 路径参数的名字，按在模式中出现的顺序
+    std::vector<std::string> m_params;
+    // 同一路径上方法不同的下一个路由，没有时为 -1
+    int m_next;
+};
+
+// 路由表。启动时用 add() 注册，compile() 之后只读，工作线程并发匹配不需要加锁。
+// 模式由以 '/' 分隔的段组成，":name" 匹配一个非空的段，"*name" 只能在最后，匹配剩余的全部路径（可以为空）。
+// 匹配时静态的段优先，其次是 ":name"，最后是 "*name"，例如 /*path 只匹配其余路由都不匹配的路径。
+// 内部是压缩的基数树：只有一个子节点的静态前缀合并成一条边；compile() 把节点按广度优先顺序展开到数组中，
+// 同一节点的静态子节点连续存放，匹配时只访问这几个数组，不分配内存
+class Router{
+public:
+    // 注册路由。模式不合法、参数超过 ROUTE_MAX_PARAMS 或与已有路由的方法冲突时返回 false。只在 compile() 之前调用。
+    // cache_ms 大于 0 时 GET/HEAD 的 DYNAMIC_REQUEST 应答按方法、Host、路径、查询串（原样，不解码、不排序）
+    // 和客户端是否本机缓存这么久，处理函数的结果不能依赖其它请求内容（其它头部、Cookie 等），Content-Type 要用静态字符串
+    static bool add(unsigned methods, const char* pattern, route_handler handler, int cache_ms = 0);
+    static void compile();
+    static bool compiled() { return m_compiled; }
+
+    // 匹配规范化之后的请求路径，返回该路径上的第一个路由（沿 m_next 找方法匹配的），没有时返回 NULL。
+    // 参数值写入 params，以相对于 path 的偏移和长度表示
+    static const route* match(const char* path, size_t len, route_params& params);
+    static const route* next(const route* r) { return r->m_next < 0 ? NULL : &m_routes[r->m_next]; }
+    // 所有路由支持的方法，用于 OPTIONS *
+    static unsigned methods() { return m_methods; }
+
+private:
+    enum KIND { NODE_STATIC = 0, NODE_PARAM, NODE_WILD };
+
+    // 注册期间使用的树，子节点用下标表示
+    struct build_node{
+        std::string m_label;
+        uint8_t m_kind;
+        std::vector<int> m_children;
+        int m_param;
+        int m_wild;
+        int m_route;
+    };
+
+    // 编译后的节点
+    struct route_node{
+        uint32_t m_label_off;
+        uint32_t m_label_len;
+        uint32_t m_first_child;
+        uint16_t m_child_count;
+        uint8_t m_kind;
+        int32_t m_param;
+        int32_t m_wild;
+        int32_t m_route;
+    };
+
+    static int new_node(const std::string& label, uint8_t kind);
+    static int insert_static(int n, const char* s, size_t len);
+    static int match_at(int n, const char* path, const char* p, const char* end, route_params& params);
+
+    static std::vector<build_node> m_build;
+    static std::vector<route> m_routes;
+    static std::vector<route_node> m_nodes;
+    static std::string m_labels;
+    static std::string m_first; // 每个节点标签的第一个字节
+    static unsigned m_methods;
+    static bool m_compiled;
+};
+
+#endif
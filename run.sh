@@ -1 +1,7 @@
-g++ *.cpp -o app -pthread
+#!/bin/bash
+# 构建类型: Release（默认）、RelWithDebInfo、Debug；产物在 build/ 下：
+#   build/app  build/loadgen  build/bench  build/accesslog_decode
+# PGO 构建与各配置的吞吐对比见 scripts/pgo.sh
+set -e
+cmake -S . -B build -DCMAKE_BUILD_TYPE=${BUILD_TYPE:-Release}
+cmake --build build -j"$(nproc)"
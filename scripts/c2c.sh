@@ -0,0 +1,64 @@
+#!/bin/bash
+# 用 perf c2c 检查连接数组上的伪共享：压测期间记录访存采样，输出 HITM（读到另一个核修改过、
+# 尚未写回的缓存行）的统计和最热的缓存行。默认使用 Reactor 模式，主线程和工作线程交接连接最频繁。
+#
+# 用法: scripts/c2c.sh [app ...]
+#   不指定 app 时构建当前代码的 RelWithDebInfo 版本。传入多个 app（例如在 git worktree 中
+#   构建的旧版本）时依次测量，便于对比前后的 HITM 次数
+# 环境变量: PORT（默认 9307）、DURATION（默认 10）、THREADS、CONNS、ACTOR（默认 1）
+# 需要 perf 有权限采样（root 或 kernel.perf_event_paranoid <= 0），以及 CPU 支持 c2c
+# 所需的访存采样（Intel load latency 或 AMD IBS）
+set -e
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+ROOT=$SRC/build-c2c
+PORT=${PORT:-9307}
+DURATION=${DURATION:-10}
+THREADS=${THREADS:-2}
+CONNS=${CONNS:-64}
+ACTOR=${ACTOR:-1}
+
+if ! command -v perf > /dev/null; then
+    echo "perf not found" >&2
+    exit 1
+fi
+
+mkdir -p "$ROOT"
+log=$ROOT/build.log
+if ! { cmake -S "$SRC" -B "$ROOT" -DCMAKE_BUILD_TYPE=RelWithDebInfo &&
+       cmake --build "$ROOT" -j"$(nproc)" --target app loadgen; } > "$log" 2>&1; then
+    cat "$log" >&2
+    exit 1
+fi
+LOADGEN=$ROOT/loadgen
+APPS=("$@")
+[ ${#APPS[@]} -eq 0 ] && APPS=("$ROOT/app")
+
+SERVER_PID=
+trap '[ -n "$SERVER_PID" ] && kill -9 "$SERVER_PID" 2>/dev/null' EXIT
+
+n=0
+for app in "${APPS[@]}"; do
+    n=$((n + 1))
+    data=$ROOT/c2c.$n.data
+    "$app" -p "$PORT" -a "$ACTOR" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    for i in $(seq 50); do
+        if (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; then break; fi
+        sleep 0.1
+    done
+
+    echo "== $app"
+    perf c2c record -o "$data" -p "$SERVER_PID" -- sleep "$DURATION" > /dev/null 2>&1 &
+    PERF_PID=$!
+    "$LOADGEN" -t "$THREADS" -c "$CONNS" -d "$DURATION" -w 0 "http://127.0.0.1:$PORT/" | grep requests
+    wait "$PERF_PID" || true
+    kill -TERM "$SERVER_PID"
+    wait "$SERVER_PID" || true
+    SERVER_PID=
+
+    perf c2c report -i "$data" --stdio --stats 2>/dev/null | grep -E "Load HITM|Load Local HITM|Load Remote HITM|Total records"
+    # 前 10 个 HITM 最多的缓存行
+    perf c2c report -i "$data" --stdio 2>/dev/null |
+        sed -n '/Shared Data Cache Line Table/,/Shared Cache Line Distribution/p' | head -16
+done
@@ -0,0 +1,119 @@
+#!/bin/bash
+# 构建并对比各种编译配置的吞吐：
+#   debug    -O0，相当于原来的 g++ *.cpp
+#   release  -O2
+#   lto      -O2 + LTO
+#   pgo      -O2 + LTO + PGO：先构建插桩版本，用 loadgen 按 pgo-urls.txt 的分布压测收集 profile，再重新编译
+#
+# 用法: scripts/pgo.sh [build_root]
+# 环境变量: PORT（默认 9306）、DURATION（每个配置压测秒数，默认 10）、THREADS、CONNS、TRAIN（训练秒数，默认 20）
+# 服务器使用临时配置文件，doc_root 指向源码中的 resources 目录，pgo-urls.txt 中的文件都在其中
+set -e
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+ROOT=${1:-$SRC/build-pgo}
+PORT=${PORT:-9306}
+DURATION=${DURATION:-10}
+TRAIN=${TRAIN:-20}
+THREADS=${THREADS:-2}
+CONNS=${CONNS:-64}
+URLS=$SRC/scripts/pgo-urls.txt
+JOBS=$(nproc)
+
+configure() # 目录 构建类型 额外参数...
+{
+    local dir=$1 type=$2
+    shift 2
+    local log=$ROOT/$dir.log
+    if ! { cmake -S "$SRC" -B "$ROOT/$dir" -DCMAKE_BUILD_TYPE="$type" "$@" &&
+           cmake --build "$ROOT/$dir" -j"$JOBS" --target app loadgen; } > "$log" 2>&1; then
+        cat "$log" >&2
+        exit 1
+    fi
+}
+
+mkdir -p "$ROOT"
+CONF=$ROOT/pgo.conf
+cat > "$CONF" <<EOF
+port = $PORT
+doc_root = $SRC/resources
+EOF
+
+SERVER_PID=
+start_server() # app 路径
+{
+    "$1" -c "$CONF" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    for i in $(seq 50); do
+        if (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; then return 0; fi
+        sleep 0.1
+    done
+    echo "server $1 did not start" >&2
+    exit 1
+}
+
+stop_server()
+{
+    # SIGTERM 让服务器正常退出，插桩版本在退出时写出 profile
+    kill -TERM "$SERVER_PID"
+    wait "$SERVER_PID" || true
+    SERVER_PID=
+}
+trap '[ -n "$SERVER_PID" ] && kill -9 "$SERVER_PID" 2>/dev/null' EXIT
+
+LOADGEN=
+
+run_load() # app 路径 秒数 结果文件
+{
+    start_server "$1"
+    "$LOADGEN" -t "$THREADS" -c "$CONNS" -d "$2" -w 2 -u "$URLS" -j "$3" "http://127.0.0.1:$PORT/" > /dev/null
+    stop_server
+}
+
+rps() # 结果文件
+{
+    sed -n 's/.*"requests_per_s": \([0-9.]*\).*/\1/p' "$1"
+}
+
+p99() # 结果文件
+{
+    sed -n 's/.*"p99": \([0-9.]*\).*/\1/p' "$1"
+}
+
+echo "== building debug / release / lto"
+configure debug Debug -DWS_LTO=OFF
+configure release Release -DWS_LTO=OFF
+configure lto Release -DWS_LTO=ON
+LOADGEN=$ROOT/release/loadgen
+
+echo "== building instrumented server"
+PROFILE=$ROOT/profile
+rm -rf "$PROFILE"
+configure pgo-gen Release -DWS_LTO=ON -DWS_PGO=GENERATE -DWS_PGO_DIR="$PROFILE"
+
+echo "== training for ${TRAIN}s"
+run_load "$ROOT/pgo-gen/app" "$TRAIN" "$ROOT/train.json"
+if [ -z "$(find "$PROFILE" -name '*.gcda' -o -name '*.profraw' 2>/dev/null)" ]; then
+    echo "no profile data written to $PROFILE" >&2
+    exit 1
+fi
+if ls "$PROFILE"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -o "$PROFILE/default.profdata" "$PROFILE"/*.profraw
+fi
+
+echo "== building with profile"
+configure pgo Release -DWS_LTO=ON -DWS_PGO=USE -DWS_PGO_DIR="$PROFILE"
+
+CONFIGS="debug release lto pgo"
+for c in $CONFIGS; do
+    echo "== measuring $c for ${DURATION}s"
+    run_load "$ROOT/$c/app" "$DURATION" "$ROOT/$c.json"
+done
+
+base=$(rps "$ROOT/release.json")
+printf "\n%-10s %14s %10s %12s\n" config "req/s" "vs release" "p99 (us)"
+for c in $CONFIGS; do
+    r=$(rps "$ROOT/$c.json")
+    awk -v c="$c" -v r="$r" -v b="$base" -v p="$(p99 "$ROOT/$c.json")" \
+        'BEGIN { printf "%-10s %14.1f %+9.1f%% %12s\n", c, r, (r - b) * 100 / b, p }'
+done
@@ -0,0 +1,756 @@
+// 基于 epoll 的多线程 HTTP 压测工具
+//
+// 与 webbench 相比：
+//   - 每个线程用一个 epoll 管理多个长连接（keep-alive），也可以每个请求新建连接
+//   - 支持流水线（一个连接上同时有多个未完成的请求）
+//   - 开环模式：按固定速率发送请求，延迟从"计划发送时间"开始计算，修正协调遗漏(coordinated omission)
+//   - 从文件读取带权重的 URL 列表
+//   - 输出 p50 ~ p99.99 的延迟分位数，可以输出 JSON
+//
+// 用法: loadgen [选项] http://host:port/path
+//   -t threads      线程数 (默认 2)
+//   -c conns        连接总数 (默认 16)
+//   -d seconds      测试时长 (默认 10)
+//   -w seconds      预热时长，期间的请求不计入结果 (默认 0)
+//   -R rate         开环模式，每秒发送的请求总数；不指定时为闭环模式（尽快发送）
+//   -P depth        流水线深度 (默认 1)
+//   -C              不使用 keep-alive，每个请求新建连接
+//   -u file         URL 列表文件，每行 "[权重] [GET|HEAD] 路径"，# 开头为注释
+//   -T ms           请求超时 (默认 10000)
+//   -j file         把结果以 JSON 写入文件，"-" 表示标准输出
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include "../../message_framer.h"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 对数-线性分桶的延迟直方图，每个 2 的幂区间 128 个子桶，相对误差 < 1%
+class histogram{
+public:
+    static const int SUB_BITS = 7;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_EXP = 40; // 约 1100 秒
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+    histogram() : m_buckets(BUCKETS, 0), m_count(0), m_sum(0), m_min(UINT64_MAX), m_max(0) {}
+
+    static int index(uint64_t v)
+    {
+        if (v < (uint64_t)SUB_COUNT) return (int)v;
+        int e = 63 - __builtin_clzll(v);
+        if (e > MAX_EXP) return BUCKETS - 1;
+        return (e - SUB_BITS + 1) * SUB_COUNT + (int)((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    static uint64_t upper(int idx)
+    {
+        if (idx < SUB_COUNT) return idx;
+        int e = idx / SUB_COUNT + SUB_BITS - 1;
+        return ((uint64_t)(SUB_COUNT + idx % SUB_COUNT + 1) << (e - SUB_BITS)) - 1;
+    }
+
+    void record(uint64_t v)
+    {
+        m_buckets[index(v)]++;
+        m_count++;
+        m_sum += v;
+        if (v < m_min) m_min = v;
+        if (v > m_max) m_max = v;
+    }
+
+    void merge(const histogram& other)
+    {
+        for (int i = 0; i < BUCKETS; ++i) m_buckets[i] += other.m_buckets[i];
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        if (other.m_min < m_min) m_min = other.m_min;
+        if (other.m_max > m_max) m_max = other.m_max;
+    }
+
+    uint64_t percentile(double p) const
+    {
+        if (m_count == 0) return 0;
+        uint64_t target = (uint64_t)ceil(p / 100.0 * m_count);
+        if (target == 0) target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            seen += m_buckets[i];
+            if (seen >= target) return upper(i) < m_max ? upper(i) : m_max;
+        }
+        return m_max;
+    }
+
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+struct options{
+    std::string host;
+    int port;
+    std::string path;
+    int threads;
+    int conns;
+    double duration;
+    double warmup;
+    double rate;
+    int pipeline;
+    bool keepalive;
+    int timeout_ms;
+    std::string url_file;
+    std::string json_path;
+};
+
+struct url_entry{
+    std::string request; // 预先拼好的完整请求报文
+    double weight;
+    bool head;           // HEAD 请求的应答没有消息体
+};
+
+enum ERROR_KIND { ERR_CONNECT = 0, ERR_READ, ERR_WRITE, ERR_TIMEOUT, ERR_PARSE, ERR_NUM };
+static const char* error_names[ERR_NUM] = { "connect", "read", "write", "timeout", "parse" };
+
+struct connection{
+    int fd;
+    bool connected;
+    std::string out;        // 待发送的数据
+    size_t out_off;
+    std::vector<char> in;   // 已收到、尚未解析的数据
+    size_t in_len;
+    std::deque<uint64_t> inflight; // 每个未完成请求的开始时间（开环模式下为计划发送时间）
+    std::deque<bool> inflight_head; // 与 inflight 对应，是否是 HEAD 请求
+    // 应答解析状态
+    message_framer framer;
+    int status;
+    bool close_after;
+};
+
+struct worker{
+    int id;
+    pthread_t thread;
+    int epfd;
+    std::vector<connection> conns;
+    histogram hist;
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t errors[ERR_NUM];
+    uint64_t status[6]; // 1xx ~ 5xx，下标 0 为其他
+    uint64_t backlog_max; // 开环模式下积压的最大请求数
+    unsigned int seed;
+};
+
+static options g_opt;
+static std::vector<url_entry> g_urls;
+static double g_total_weight = 0;
+static struct sockaddr_in g_addr;
+static volatile bool g_stop = false;
+static uint64_t g_start_ns = 0;   // 开始计入结果的时间（预热结束）
+static uint64_t g_end_ns = 0;
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "usage: %s [-t threads] [-c conns] [-d seconds] [-w warmup] [-R rate] [-P depth]\n"
+        "          [-C] [-u url_file] [-T timeout_ms] [-j json_file] http://host:port/path\n", prog);
+    exit(1);
+}
+
+static bool parse_url(const char* url, options& opt)
+{
+    if (strncasecmp(url, "http://", 7) != 0) return false;
+    const char* host = url + 7;
+    const char* slash = strchr(host, '/');
+    std::string hostport = slash ? std::string(host, slash - host) : std::string(host);
+    opt.path = slash ? slash : "/";
+    size_t colon = hostport.rfind(':');
+    if (colon != std::string::npos)
+    {
+        opt.host = hostport.substr(0, colon);
+        opt.port = atoi(hostport.c_str() + colon + 1);
+    }
+    else
+    {
+        opt.host = hostport;
+        opt.port = 80;
+    }
+    return !opt.host.empty() && opt.port > 0;
+}
+
+static std::string build_request(const char* method, const std::string& path)
+{
+    std::string req = std::string(method) + " " + path + " HTTP/1.1\r\nHost: " + g_opt.host + "\r\n";
+    req += g_opt.keepalive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    return req;
+}
+
+static bool load_urls()
+{
+    if (g_opt.url_file.empty())
+    {
+        url_entry e;
+        e.request = build_request("GET", g_opt.path);
+        e.weight = 1;
+        e.head = false;
+        g_urls.push_back(e);
+        g_total_weight = 1;
+        return true;
+    }
+    FILE* fp = fopen(g_opt.url_file.c_str(), "r");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", g_opt.url_file.c_str());
+        return false;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char* p = line + strspn(line, " \t");
+        p[strcspn(p, "\r\n")] = '\0';
+        if (*p == '\0' || *p == '#') continue;
+        url_entry e;
+        e.weight = 1;
+        if (*p != '/')
+        {
+            char* end;
+            e.weight = strtod(p, &end);
+            p = end + strspn(end, " \t");
+        }
+        e.head = strncmp(p, "HEAD", 4) == 0 && (p[4] == ' ' || p[4] == '\t');
+        if (e.head || (strncmp(p, "GET", 3) == 0 && (p[3] == ' ' || p[3] == '\t')))
+        {
+            p += e.head ? 4 : 3;
+            p += strspn(p, " \t");
+        }
+        if (*p != '/' || e.weight <= 0) continue;
+        e.request = build_request(e.head ? "HEAD" : "GET", p);
+        g_urls.push_back(e);
+        g_total_weight += e.weight;
+    }
+    fclose(fp);
+    if (g_urls.empty())
+    {
+        fprintf(stderr, "no url in %s\n", g_opt.url_file.c_str());
+        return false;
+    }
+    return true;
+}
+
+static const url_entry& pick_request(worker* w)
+{
+    if (g_urls.size() == 1) return g_urls[0];
+    double r = (double)rand_r(&w->seed) / ((double)RAND_MAX + 1) * g_total_weight;
+    for (size_t i = 0; i < g_urls.size(); ++i)
+    {
+        r -= g_urls[i].weight;
+        if (r < 0) return g_urls[i];
+    }
+    return g_urls.back();
+}
+
+static void update_events(worker* w, connection& c)
+{
+    epoll_event ev;
+    ev.data.ptr = &c;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if (!c.connected || c.out_off < c.out.size()) ev.events |= EPOLLOUT;
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+static void reset_parser(connection& c)
+{
+    c.framer.reset();
+    c.status = 0;
+    c.close_after = false;
+}
+
+static bool open_conn(worker* w, connection& c)
+{
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd < 0) return false;
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c.connected = false;
+    c.out.clear();
+    c.out_off = 0;
+    c.in_len = 0;
+    reset_parser(c);
+    if (connect(c.fd, (sockaddr*)&g_addr, sizeof(g_addr)) < 0 && errno != EINPROGRESS)
+    {
+        close(c.fd);
+        c.fd = -1;
+        return false;
+    }
+    epoll_event ev;
+    ev.data.ptr = &c;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, c.fd, &ev);
+    return true;
+}
+
+// 关闭连接；仍未完成的请求记为错误（开环模式下由调用者重新排队）
+static void close_conn(worker* w, connection& c, ERROR_KIND err, std::deque<uint64_t>* requeue)
+{
+    if (c.fd >= 0)
+    {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c.fd, NULL);
+        close(c.fd);
+        c.fd = -1;
+    }
+    if (!c.inflight.empty())
+    {
+        if (now_ns() >= g_start_ns) w->errors[err] += c.inflight.size();
+        if (requeue)
+        {
+            // 开环模式下请求的计划时间不变，延迟仍然从计划时间算起
+            requeue->insert(requeue->begin(), c.inflight.begin(), c.inflight.end());
+        }
+    }
+    c.inflight.clear();
+    c.inflight_head.clear();
+    c.connected = false;
+}
+
+static void queue_request(worker* w, connection& c, uint64_t start)
+{
+    const url_entry& e = pick_request(w);
+    c.out += e.request;
+    c.inflight.push_back(start);
+    c.inflight_head.push_back(e.head);
+}
+
+static bool flush_out(worker* w, connection& c)
+{
+    while (c.out_off < c.out.size())
+    {
+        ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        c.out_off += n;
+    }
+    if (c.out_off == c.out.size())
+    {
+        c.out.clear();
+        c.out_off = 0;
+    }
+    update_events(w, c);
+    return true;
+}
+
+// 在 [p, p+len) 中查找不区分大小写的头部字段，返回值的起始位置
+static const char* find_header(const char* p, size_t len, const char* name)
+{
+    size_t nlen = strlen(name);
+    const char* end = p + len;
+    while (p < end)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        if ((size_t)(eol - p) > nlen && strncasecmp(p, name, nlen) == 0 && p[nlen] == ':')
+        {
+            const char* v = p + nlen + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) ++v;
+            return v;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+static void complete_response(worker* w, connection& c)
+{
+    uint64_t now = now_ns();
+    uint64_t start = c.inflight.front();
+    c.inflight.pop_front();
+    c.inflight_head.pop_front();
+    if (start >= g_start_ns && now <= g_end_ns)
+    {
+        w->hist.record(now - start);
+        w->requests++;
+        int cls = c.status / 100;
+        w->status[(cls >= 1 && cls <= 5) ? cls : 0]++;
+    }
+}
+
+// 解析收到的数据，返回 false 表示需要关闭连接。
+// HEAD 请求和 1xx/204/304 的应答没有消息体，chunked 的应答读到最后一块为止，1xx 不是最终应答
+static bool parse_responses(worker* w, connection& c)
+{
+    const char* data = c.in.data();
+    size_t len = c.in_len;
+    c.in_len = 0;
+    while (len > 0)
+    {
+        size_t used = c.framer.feed(data, len);
+        data += used;
+        len -= used;
+        if (c.framer.m_state == message_framer::FR_HEADER_DONE)
+        {
+            c.status = c.framer.status();
+            if (c.inflight.empty() || c.status == 0)
+            {
+                w->errors[ERR_PARSE]++;
+                return false;
+            }
+            bool interim = c.status < 200;
+            const std::string& header = c.framer.m_text;
+            const char* conn = find_header(header.data(), header.size(), "Connection");
+            c.close_after = !g_opt.keepalive || (conn && strncasecmp(conn, "close", 5) == 0);
+            c.framer.start_body(interim || c.inflight_head.front() || c.status == 204 || c.status == 304);
+            if (interim)
+            {
+                reset_parser(c);
+                continue;
+            }
+        }
+        if (c.framer.m_state != message_framer::FR_DONE) continue;
+
+        complete_response(w, c);
+        bool close_after = c.close_after;
+        reset_parser(c);
+        if (close_after) return false;
+    }
+    return true;
+}
+
+static bool read_conn(worker* w, connection& c)
+{
+    while (true)
+    {
+        if (c.in.size() - c.in_len < 16384) c.in.resize(c.in.size() * 2);
+        ssize_t n = recv(c.fd, c.in.data() + c.in_len, c.in.size() - c.in_len, 0);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            return false;
+        }
+        if (n == 0) return false;
+        c.in_len += n;
+        if (now_ns() >= g_start_ns) w->bytes += n;
+        if (!parse_responses(w, c)) return false;
+    }
+}
+
+static void* run_worker(void* arg)
+{
+    worker* w = (worker*)arg;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    size_t nconn = w->conns.size();
+    for (size_t i = 0; i < nconn; ++i)
+    {
+        connection& c = w->conns[i];
+        c.fd = -1;
+        c.in.resize(65536);
+        if (!open_conn(w, c)) w->errors[ERR_CONNECT]++;
+    }
+
+    bool open_loop = g_opt.rate > 0;
+    uint64_t interval_ns = open_loop ? (uint64_t)(1e9 * g_opt.threads / g_opt.rate) : 0;
+    uint64_t next_send = now_ns();
+    std::deque<uint64_t> backlog; // 开环模式下已经到计划时间、还没有可用连接发送的请求
+    size_t rr = 0;
+    std::vector<epoll_event> events(nconn + 1);
+
+    while (!g_stop)
+    {
+        uint64_t now = now_ns();
+        if (now >= g_end_ns) break;
+
+        if (open_loop)
+        {
+            while (next_send <= now)
+            {
+                backlog.push_back(next_send);
+                next_send += interval_ns;
+            }
+            if (backlog.size() > w->backlog_max) w->backlog_max = backlog.size();
+            // 把积压的请求分给流水线还有空位的连接
+            for (size_t k = 0; k < nconn && !backlog.empty(); ++k)
+            {
+                connection& c = w->conns[(rr + k) % nconn];
+                if (c.fd < 0 || !c.connected) continue;
+                bool queued = false;
+                while ((int)c.inflight.size() < g_opt.pipeline && !backlog.empty())
+                {
+                    queue_request(w, c, backlog.front());
+                    backlog.pop_front();
+                    queued = true;
+                }
+                if (queued && !flush_out(w, c))
+                {
+                    w->errors[ERR_WRITE]++;
+                    close_conn(w, c, ERR_WRITE, &backlog);
+                }
+            }
+            rr++;
+        }
+
+        // 重连被关闭的连接，检查超时
+        uint64_t timeout_ns = (uint64_t)g_opt.timeout_ms * 1000000ULL;
+        for (size_t i = 0; i < nconn; ++i)
+        {
+            connection& c = w->conns[i];
+            if (c.fd >= 0 && !c.inflight.empty() && now > c.inflight.front() + timeout_ns)
+            {
+                close_conn(w, c, ERR_TIMEOUT, NULL);
+            }
+            if (c.fd < 0 && !open_conn(w, c))
+            {
+                w->errors[ERR_CONNECT]++;
+            }
+        }
+
+        int wait_ms = 10;
+        if (open_loop)
+        {
+            uint64_t t = now_ns();
+            wait_ms = next_send > t ? (int)((next_send - t) / 1000000) : 0;
+            if (wait_ms > 10) wait_ms = 10;
+        }
+        int n = epoll_wait(w->epfd, events.data(), events.size(), wait_ms);
+        for (int i = 0; i < n; ++i)
+        {
+            connection& c = *(connection*)events[i].data.ptr;
+            if (c.fd < 0) continue;
+            if (!c.connected)
+            {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0 || (events[i].events & (EPOLLERR | EPOLLHUP)))
+                {
+                    w->errors[ERR_CONNECT]++;
+                    close_conn(w, c, ERR_CONNECT, open_loop ? &backlog : NULL);
+                    continue;
+                }
+                c.connected = true;
+                if (!open_loop)
+                {
+                    // 闭环模式：连接建立后立即填满流水线
+                    uint64_t t = now_ns();
+                    while ((int)c.inflight.size() < g_opt.pipeline) queue_request(w, c, t);
+                }
+                if (!flush_out(w, c))
+                {
+                    close_conn(w, c, ERR_WRITE, open_loop ? &backlog : NULL);
+                }
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                if (!read_conn(w, c))
+                {
+                    // 按 Connection: close 正常关闭时没有未完成的请求，不计为错误
+                    close_conn(w, c, ERR_READ, open_loop ? &backlog : NULL);
+                    continue;
+                }
+                if (!open_loop)
+                {
+                    uint64_t t = now_ns();
+                    while ((int)c.inflight.size() < g_opt.pipeline) queue_request(w, c, t);
+                }
+            }
+            if (c.fd >= 0 && !flush_out(w, c))
+            {
+                close_conn(w, c, ERR_WRITE, open_loop ? &backlog : NULL);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nconn; ++i)
+    {
+        if (w->conns[i].fd >= 0) close(w->conns[i].fd);
+    }
+    close(w->epfd);
+    return NULL;
+}
+
+static void on_signal(int)
+{
+    g_stop = true;
+}
+
+static void report(std::vector<worker>& workers, double elapsed)
+{
+    histogram hist;
+    uint64_t requests = 0, bytes = 0, errors[ERR_NUM] = { 0 }, status[6] = { 0 }, backlog_max = 0;
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        worker& w = workers[i];
+        hist.merge(w.hist);
+        requests += w.requests;
+        bytes += w.bytes;
+        for (int k = 0; k < ERR_NUM; ++k) errors[k] += w.errors[k];
+        for (int k = 0; k < 6; ++k) status[k] += w.status[k];
+        if (w.backlog_max > backlog_max) backlog_max = w.backlog_max;
+    }
+
+    static const double pcts[] = { 50, 75, 90, 99, 99.9, 99.99 };
+    static const char* pct_names[] = { "p50", "p75", "p90", "p99", "p99.9", "p99.99" };
+    double rps = requests / elapsed;
+
+    printf("target: http://%s:%d%s  threads: %d  connections: %d  pipeline: %d  %s\n",
+        g_opt.host.c_str(), g_opt.port, g_opt.path.c_str(), g_opt.threads, g_opt.conns, g_opt.pipeline,
+        g_opt.keepalive ? "keep-alive" : "close");
+    if (g_opt.rate > 0) printf("mode: open loop at %.0f req/s (latency corrected for coordinated omission)\n", g_opt.rate);
+    else printf("mode: closed loop\n");
+    printf("requests: %llu in %.2fs, %.1f req/s, %.2f MB/s\n", (unsigned long long)requests, elapsed, rps,
+        bytes / elapsed / 1048576.0);
+    printf("status: 2xx=%llu 3xx=%llu 4xx=%llu 5xx=%llu other=%llu\n", (unsigned long long)status[2],
+        (unsigned long long)status[3], (unsigned long long)status[4], (unsigned long long)status[5],
+        (unsigned long long)(status[0] + status[1]));
+    printf("errors:");
+    for (int k = 0; k < ERR_NUM; ++k) printf(" %s=%llu", error_names[k], (unsigned long long)errors[k]);
+    printf("\nlatency (us): min=%.1f mean=%.1f", hist.m_count ? hist.m_min / 1e3 : 0.0,
+        hist.m_count ? (double)hist.m_sum / hist.m_count / 1e3 : 0.0);
+    for (int k = 0; k < 6; ++k) printf(" %s=%.1f", pct_names[k], hist.percentile(pcts[k]) / 1e3);
+    printf(" max=%.1f\n", hist.m_max / 1e3);
+
+    if (g_opt.json_path.empty()) return;
+    FILE* fp = g_opt.json_path == "-" ? stdout : fopen(g_opt.json_path.c_str(), "w");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", g_opt.json_path.c_str());
+        return;
+    }
+    fprintf(fp, "{\n  \"target\": \"http://%s:%d%s\",\n", g_opt.host.c_str(), g_opt.port, g_opt.path.c_str());
+    fprintf(fp, "  \"threads\": %d,\n  \"connections\": %d,\n  \"pipeline\": %d,\n  \"keepalive\": %s,\n",
+        g_opt.threads, g_opt.conns, g_opt.pipeline, g_opt.keepalive ? "true" : "false");
+    fprintf(fp, "  \"mode\": \"%s\",\n  \"target_rate\": %.1f,\n", g_opt.rate > 0 ? "open" : "closed", g_opt.rate);
+    fprintf(fp, "  \"duration_s\": %.3f,\n  \"requests\": %llu,\n  \"bytes\": %llu,\n", elapsed,
+        (unsigned long long)requests, (unsigned long long)bytes);
+    fprintf(fp, "  \"requests_per_s\": %.1f,\n  \"bytes_per_s\": %.1f,\n", rps, bytes / elapsed);
+    fprintf(fp, "  \"max_backlog\": %llu,\n", (unsigned long long)backlog_max);
+    fprintf(fp, "  \"status\": {\"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, \"other\": %llu},\n",
+        (unsigned long long)status[2], (unsigned long long)status[3], (unsigned long long)status[4],
+        (unsigned long long)status[5], (unsigned long long)(status[0] + status[1]));
+    fprintf(fp, "  \"errors\": {");
+    for (int k = 0; k < ERR_NUM; ++k)
+    {
+        fprintf(fp, "%s\"%s\": %llu", k ? ", " : "", error_names[k], (unsigned long long)errors[k]);
+    }
+    fprintf(fp, "},\n  \"latency_us\": {\"min\": %.1f, \"mean\": %.1f", hist.m_count ? hist.m_min / 1e3 : 0.0,
+        hist.m_count ? (double)hist.m_sum / hist.m_count / 1e3 : 0.0);
+    for (int k = 0; k < 6; ++k) fprintf(fp, ", \"%s\": %.1f", pct_names[k], hist.percentile(pcts[k]) / 1e3);
+    fprintf(fp, ", \"max\": %.1f}\n}\n", hist.m_max / 1e3);
+    if (fp != stdout) fclose(fp);
+}
+
+int main(int argc, char* argv[])
+{
+    g_opt.threads = 2;
+    g_opt.conns = 16;
+    g_opt.duration = 10;
+    g_opt.warmup = 0;
+    g_opt.rate = 0;
+    g_opt.pipeline = 1;
+    g_opt.keepalive = true;
+    g_opt.timeout_ms = 10000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:d:w:R:P:Cu:T:j:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': g_opt.threads = atoi(optarg); break;
+        case 'c': g_opt.conns = atoi(optarg); break;
+        case 'd': g_opt.duration = atof(optarg); break;
+        case 'w': g_opt.warmup = atof(optarg); break;
+        case 'R': g_opt.rate = atof(optarg); break;
+        case 'P': g_opt.pipeline = atoi(optarg); break;
+        case 'C': g_opt.keepalive = false; break;
+        case 'u': g_opt.url_file = optarg; break;
+        case 'T': g_opt.timeout_ms = atoi(optarg); break;
+        case 'j': g_opt.json_path = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || !parse_url(argv[optind], g_opt)) usage(argv[0]);
+    if (g_opt.threads <= 0 || g_opt.conns < g_opt.threads || g_opt.pipeline <= 0 || g_opt.duration <= 0)
+    {
+        fprintf(stderr, "need threads > 0, conns >= threads, pipeline > 0, duration > 0\n");
+        return 1;
+    }
+    if (!g_opt.keepalive) g_opt.pipeline = 1;
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(g_opt.host.c_str(), NULL, &hints, &res) != 0)
+    {
+        fprintf(stderr, "cannot resolve %s\n", g_opt.host.c_str());
+        return 1;
+    }
+    g_addr = *(sockaddr_in*)res->ai_addr;
+    g_addr.sin_port = htons(g_opt.port);
+    freeaddrinfo(res);
+
+    if (!load_urls()) return 1;
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+
+    uint64_t t0 = now_ns();
+    g_start_ns = t0 + (uint64_t)(g_opt.warmup * 1e9);
+    g_end_ns = g_start_ns + (uint64_t)(g_opt.duration * 1e9);
+
+    std::vector<worker> workers(g_opt.threads);
+    for (int i = 0; i < g_opt.threads; ++i)
+    {
+        worker& w = workers[i];
+        w.id = i;
+        w.requests = w.bytes = w.backlog_max = 0;
+        memset(w.errors, 0, sizeof(w.errors));
+        memset(w.status, 0, sizeof(w.status));
+        w.seed = 12345 + i;
+        w.conns.resize(g_opt.conns / g_opt.threads + (i < g_opt.conns % g_opt.threads ? 1 : 0));
+    }
+    for (int i = 0; i < g_opt.threads; ++i)
+    {
+        pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+    }
+    for (int i = 0; i < g_opt.threads; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    uint64_t end = now_ns();
+    if (end > g_end_ns) end = g_end_ns;
+    double elapsed = end > g_start_ns ? (end - g_start_ns) / 1e9 : 0;
+    if (elapsed <= 0)
+    {
+        fprintf(stderr, "test stopped during warmup\n");
+        return 1;
+    }
+    report(workers, elapsed);
+    return 0;
+}
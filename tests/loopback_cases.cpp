@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "../webserver.h"
+#include "../router.h"
+#include "../loopback_transport.h"
+
+// 在 loopback_transport 上驱动完整的服务器，检查请求解析和路由的行为：
+// chunked 请求体、Content-Length / Transfer-Encoding 的冲突、路径规范化、路由优先级和 405。
+// 每个用例在新的连接上分段发送请求，等到收齐应答（或服务器关闭连接）后检查状态码、头部和应答体。
+// 全部用例在几种事件模式和收发模式下各运行一遍，失败时返回非 0
+
+// 测试用的路由，在服务器注册内置路由之前添加
+static http_conn::HTTP_CODE echo_body(http_conn& conn)
+{
+    std::string& out = conn.begin_reply();
+    if (conn.body())
+    {
+        out.assign(conn.body(), conn.body_length());
+    }
+    else if (conn.body_fd() >= 0)
+    {
+        out.resize(conn.body_length());
+        if (pread(conn.body_fd(), &out[0], out.size(), 0) != (ssize_t)out.size()) return http_conn::INTERNAL_ERROR;
+    }
+    return conn.reply(200, "text/plain");
+}
+
+static http_conn::HTTP_CODE route_static(http_conn& conn)
+{
+    conn.begin_reply() = "static";
+    return conn.reply(200, "text/plain");
+}
+
+static http_conn::HTTP_CODE route_param(http_conn& conn)
+{
+    size_t len = 0;
+    const char* id = conn.param("id", &len);
+    conn.begin_reply() = "param:" + std::string(id, len);
+    return conn.reply(200, "text/plain");
+}
+
+static http_conn::HTTP_CODE route_wild(http_conn& conn)
+{
+    size_t len = 0;
+    const char* rest = conn.param("rest", &len);
+    conn.begin_reply() = "wild:" + std::string(rest ? rest : "", len);
+    return conn.reply(200, "text/plain");
+}
+
+static http_conn::HTTP_CODE route_delete(http_conn& conn)
+{
+    conn.begin_reply() = "deleted";
+    return conn.reply(200, "text/plain");
+}
+
+static void add_routes()
+{
+    Router::add(ROUTE_POST, "/echo", echo_body);
+    Router::add(ROUTE_GET, "/r/static", route_static);
+    Router::add(ROUTE_DELETE, "/r/static", route_delete);
+    Router::add(ROUTE_GET, "/r/:id", route_param);
+    Router::add(ROUTE_GET, "/r/*rest", route_wild);
+}
+
+#define KA "Connection: keep-alive\r\n"
+#define POST_CHUNKED "POST /echo HTTP/1.1\r\n" KA "Transfer-Encoding: chunked\r\n\r\n"
+
+struct http_case{
+    const char* m_name;
+    const char* m_parts[4];  // 依次发送，每段之间让服务器先处理已经到达的数据
+    int m_status;            // 最后一个应答的状态码
+    const char* m_body;      // 最后一个应答的应答体，NULL 表示不检查
+    const char* m_header;    // 最后一个应答必须包含的头部，NULL 表示不检查
+    int m_responses;         // 应答个数（流水线）
+    bool m_close;            // 应答后服务器应当关闭连接
+};
+
+static const http_case cases[] = {
+    // chunked 请求体
+    { "chunked", { POST_CHUNKED "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n" }, 200, "hello world", NULL, 1, false },
+    { "chunked/ext+hex", { POST_CHUNKED "5;name=v\r\nhello\r\nA\r\n0123456789\r\n0\r\n\r\n" }, 200, "hello0123456789", NULL, 1, false },
+    { "chunked/split-size", { POST_CHUNKED "1", "0\r", "\n0123456789abcdef\r", "\n0\r\n\r\n" }, 200, "0123456789abcdef", NULL, 1, false },
+    { "chunked/split-data", { POST_CHUNKED "b\r\nhel", "lo wo", "rld\r\n0\r\n", "\r\n" }, 200, "hello world", NULL, 1, false },
+    { "chunked/trailers", { POST_CHUNKED "5\r\nhello\r\n0\r\nX-Sum: 1\r\nX-Other: 2\r\n\r\nGET /r/static HTTP/1.1\r\n" KA "\r\n" },
+      200, "static", NULL, 2, false },
+    { "chunked/bad-size", { POST_CHUNKED "zz\r\nhello\r\n0\r\n\r\n" }, 400, NULL, NULL, 1, true },
+    { "chunked/negative-size", { POST_CHUNKED "-5\r\nhello\r\n0\r\n\r\n" }, 400, NULL, NULL, 1, true },
+    { "chunked/size-overflow", { POST_CHUNKED "10000000000000000\r\nhello\r\n0\r\n\r\n" }, 400, NULL, NULL, 1, true },
+    { "chunked/bare-lf", { POST_CHUNKED "5\nhello\r\n0\r\n\r\n" }, 400, NULL, NULL, 1, true },
+    { "chunked/missing-crlf", { POST_CHUNKED "5\r\nhelloXY0\r\n\r\n" }, 400, NULL, NULL, 1, true },
+    { "chunked/long-size-line", { POST_CHUNKED "5;xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx",
+      "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" },
+      400, NULL, NULL, 1, true },
+
+    // Content-Length 与 Transfer-Encoding
+    { "length", { "POST /echo HTTP/1.1\r\n" KA "Content-Length: 5\r\n\r\nhello" }, 200, "hello", NULL, 1, false },
+    { "length/duplicate-same", { "POST /echo HTTP/1.1\r\n" KA "Content-Length: 5\r\nContent-Length: 5\r\n\r\nhello" }, 200, "hello", NULL, 1, false },
+    { "length/duplicate-differ", { "POST /echo HTTP/1.1\r\n" KA "Content-Length: 0\r\nContent-Length: 5\r\n\r\nhello" }, 400, NULL, NULL, 1, true },
+    { "length/not-number", { "POST /echo HTTP/1.1\r\n" KA "Content-Length: 5x\r\n\r\nhello" }, 400, NULL, NULL, 1, true },
+    { "length+chunked", { "POST /echo HTTP/1.1\r\n" KA "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n" },
+      400, NULL, NULL, 1, true },
+    { "length0+chunked", { "POST /echo HTTP/1.1\r\n" KA "Content-Length: 0\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n" },
+      400, NULL, NULL, 1, true },
+    { "te/unsupported", { "POST /echo HTTP/1.1\r\n" KA "Transfer-Encoding: gzip\r\n\r\nhello" }, 400, NULL, NULL, 1, true },
+
+    // 路径规范化
+    { "url/dot-dot", { "GET /r/a/../static HTTP/1.1\r\n" KA "\r\n" }, 200, "static", NULL, 1, false },
+    { "url/escaped-dot-dot", { "GET /r/x/%2e%2E/static HTTP/1.1\r\n" KA "\r\n" }, 200, "static", NULL, 1, false },
+    { "url/escaped-dot", { "GET /r/./%2e/static HTTP/1.1\r\n" KA "\r\n" }, 200, "static", NULL, 1, false },
+    { "url/escaped-slash", { "GET /r/%2fstatic HTTP/1.1\r\n" KA "\r\n" }, 200, "static", NULL, 1, false },
+    { "url/above-root", { "GET /r/../../etc/passwd HTTP/1.1\r\n" KA "\r\n" }, 400, NULL, NULL, 1, true },
+    { "url/escaped-above-root", { "GET /%2e%2e/etc/passwd HTTP/1.1\r\n" KA "\r\n" }, 400, NULL, NULL, 1, true },
+    { "url/bad-escape", { "GET /r/%zz HTTP/1.1\r\n" KA "\r\n" }, 400, NULL, NULL, 1, true },
+    { "url/escaped-nul", { "GET /r/a%00b HTTP/1.1\r\n" KA "\r\n" }, 400, NULL, NULL, 1, true },
+    { "url/query", { "GET /r/x/../static?a=/../b HTTP/1.1\r\n" KA "\r\n" }, 200, "static", NULL, 1, false },
+
+    // 路由优先级：静态段、:name、*name
+    { "route/static", { "GET /r/static HTTP/1.1\r\n" KA "\r\n" }, 200, "static", NULL, 1, false },
+    { "route/param", { "GET /r/abc HTTP/1.1\r\n" KA "\r\n" }, 200, "param:abc", NULL, 1, false },
+    { "route/static-prefix", { "GET /r/staticx HTTP/1.1\r\n" KA "\r\n" }, 200, "param:staticx", NULL, 1, false },
+    { "route/wild", { "GET /r/abc/def HTTP/1.1\r\n" KA "\r\n" }, 200, "wild:abc/def", NULL, 1, false },
+    { "route/static-under-wild", { "GET /r/static/x HTTP/1.1\r\n" KA "\r\n" }, 200, "wild:static/x", NULL, 1, false },
+    { "route/wild-empty", { "GET /r/ HTTP/1.1\r\n" KA "\r\n" }, 200, "wild:", NULL, 1, false },
+    { "route/head", { "HEAD /r/static HTTP/1.1\r\n" KA "\r\n" }, 200, "", "Content-length: 6\r\n", 1, false },
+
+    // 方法
+    { "method/delete", { "DELETE /r/static HTTP/1.1\r\n" KA "\r\n" }, 200, "deleted", NULL, 1, false },
+    { "method/405", { "POST /r/static HTTP/1.1\r\n" KA "Content-Length: 0\r\n\r\n" }, 405, NULL, "Allow: GET, HEAD, DELETE, OPTIONS\r\n", 1, false },
+    { "method/405-builtin", { "PUT /healthz HTTP/1.1\r\n" KA "\r\n" }, 405, NULL, "Allow: GET, HEAD, OPTIONS\r\n", 1, false },
+    { "method/405-body", { "POST /r/abc HTTP/1.1\r\n" KA "Content-Length: 5\r\n\r\nhello" }, 405, NULL, "Allow: GET, HEAD, OPTIONS\r\n", 1, true },
+    { "method/options", { "OPTIONS /r/static HTTP/1.1\r\n" KA "\r\n" }, 200, NULL, "Allow: GET, HEAD, DELETE, OPTIONS\r\n", 1, false },
+};
+
+// 事件模式与收发模式的组合，同 bench_eventloop
+struct loop_mode{
+    const char* m_name;
+    int m_actor;
+    int m_trig;
+    int m_max_read;
+    int m_read_eagain;
+    int m_max_write;
+};
+
+static const loop_mode modes[] = {
+    { "LT", 0, 0, 0, 0, 0 },
+    { "ET", 0, 3, 0, 0, 0 },
+    { "reactor", 1, 0, 0, 0, 0 },
+    { "ET/byte-reads", 0, 3, 1, 3, 0 },
+    { "LT/short-write", 0, 0, 0, 0, 7 },
+};
+
+struct response{
+    int m_status;
+    std::string m_header;
+    std::string m_body;
+};
+
+// 按 Content-length 切分应答，HEAD 请求的应答没有应答体
+static std::vector<response> split_responses(const std::string& out, bool head)
+{
+    std::vector<response> all;
+    size_t pos = 0;
+    while (pos < out.size())
+    {
+        size_t end = out.find("\r\n\r\n", pos);
+        if (end == std::string::npos) break;
+        response r;
+        r.m_header = out.substr(pos, end + 4 - pos);
+        r.m_status = r.m_header.size() > 12 ? atoi(r.m_header.c_str() + 9) : 0;
+        size_t cl = r.m_header.find("Content-length: ");
+        size_t len = cl == std::string::npos || head ? 0 : strtoul(r.m_header.c_str() + cl + 16, NULL, 10);
+        r.m_body = out.substr(end + 4, len);
+        pos = end + 4 + len;
+        all.push_back(r);
+    }
+    return all;
+}
+
+// 驱动事件循环直到条件满足，服务器停止响应时算作失败
+template <typename F>
+static bool run_until(Webserver* server, F done)
+{
+    for (int rounds = 0; !done(); ++rounds)
+    {
+        if (rounds > 300) return false;
+        server->run_once(10);
+    }
+    return true;
+}
+
+static bool run_case(Webserver* server, loopback_transport& lb, const http_case& t, std::string& why)
+{
+    loopback_transport::conn* c = lb.connect();
+    for (int i = 0; i < 4 && t.m_parts[i]; ++i)
+    {
+        lb.send(c, t.m_parts[i], strlen(t.m_parts[i]));
+        for (int n = 0; n < 4; ++n) server->run_once(0);
+    }
+    // 没有等到时由下面的检查报告原因
+    run_until(server, [&]() {
+        return lb.responses(c) >= (uint64_t)t.m_responses && (!t.m_close || lb.closed(c));
+    });
+    std::vector<response> all = split_responses(lb.output(c), strncmp(t.m_parts[0], "HEAD ", 5) == 0);
+    bool closed = lb.closed(c);
+    lb.shutdown(c);
+    run_until(server, [&]() { return lb.closed(c); });
+    lb.release(c);
+
+    char buf[128];
+    if ((int)all.size() != t.m_responses)
+    {
+        snprintf(buf, sizeof(buf), "got %d responses, want %d", (int)all.size(), t.m_responses);
+        why = buf;
+        return false;
+    }
+    const response& r = all.back();
+    if (r.m_status != t.m_status)
+    {
+        snprintf(buf, sizeof(buf), "status %d, want %d", r.m_status, t.m_status);
+        why = buf;
+        return false;
+    }
+    if (t.m_body && r.m_body != t.m_body)
+    {
+        why = "body \"" + r.m_body + "\", want \"" + t.m_body + "\"";
+        return false;
+    }
+    if (t.m_header && r.m_header.find(t.m_header) == std::string::npos)
+    {
+        why = "missing header " + std::string(t.m_header, strlen(t.m_header) - 2);
+        return false;
+    }
+    if (closed != t.m_close)
+    {
+        why = closed ? "connection closed" : "connection kept open";
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    add_routes();
+    int failed = 0;
+    int total = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+    {
+        const loop_mode& mode = modes[m];
+        loopback_transport lb;
+        loopback_pattern pattern;
+        pattern.m_max_read = mode.m_max_read;
+        pattern.m_read_eagain = mode.m_read_eagain;
+        pattern.m_max_write = mode.m_max_write;
+        pattern.m_keep_output = true;
+        lb.set_pattern(pattern);
+        transport::set_current(&lb);
+
+        Webserver* server = new Webserver();
+        server->init(0, mode.m_actor, mode.m_trig);
+        server->thread_pool();
+        if (!server->eventlisten())
+        {
+            fprintf(stderr, "eventlisten failed\n");
+            return 1;
+        }
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+        {
+            std::string why;
+            total++;
+            if (!run_case(server, lb, cases[i], why))
+            {
+                failed++;
+                printf("FAIL %s %s: %s\n", mode.m_name, cases[i].m_name, why.c_str());
+            }
+        }
+        delete server;
+        transport::set_current(socket_transport::get_instance());
+    }
+    printf("%d/%d cases passed\n", total - failed, total);
+    return failed == 0 ? 0 : 1;
+}
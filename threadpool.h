@@ -4,7 +4,13 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <list>
+#include <vector>
+#include <algorithm>
 #include "locker.h"
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probes.h"
 
 template <typename T> //定义模板类
 class threadpool{
@@ -12,6 +18,9 @@ public:
     threadpool(int actor_model = 0, int thread_number = 8, int max_work_number = 10000);
     ~threadpool();
     bool append(T* request);
+    // 调整工作线程数和队列长度，用于配置重新加载，只能在主线程调用
+    void resize(int thread_number);
+    void set_max_requests(int max_work_number);
 
 private:
     // 工作线程运行的函数，不断从工作队列中取出任务并执行之
@@ -20,16 +29,21 @@ private:
     // 若线程函数为类成员函数，则this指针会作为默认参数被传进函数中，和线程函数参数(void*)不能匹配，不能通过编译。
     static void* worker(void* arg);
     void run();
+    void shutdown();
+    void join_retired();
 
 private:
-    // 线程的数量
-    int m_thread_number; 
+    // 正在运行的线程，受 m_queuelocker 保护
+    std::vector<pthread_t> m_threads;
 
-    // 线程池数组，大小为 m_thread_number
-    pthread_t* m_threads;
+    // 缩容时已经退出、等待回收的线程，受 m_queuelocker 保护
+    std::vector<pthread_t> m_retired;
+
+    // 还需要退出的线程数，受 m_queuelocker 保护
+    int m_retire;
 
     // 最大请求数量
-    int m_max_work_number;
+    size_t m_max_work_number;
 
     // 请求队列
     std::list<T*> m_work_queue;
@@ -42,12 +56,15 @@ private:
 
     // 模型切换
     int m_actor_model;
+
+    // 线程池是否停止，析构时置位，受 m_queuelocker 保护
+    bool m_stop;
 };
 
 //创建线程池，分配线程池空间
 template <typename T>
 threadpool<T> :: threadpool(int actor_model, int thread_number, int max_work_number) :
-m_thread_number(thread_number), m_max_work_number(max_work_number), m_actor_model(actor_model), m_threads(NULL)
+m_retire(0), m_max_work_number(max_work_number), m_actor_model(actor_model), m_stop(false)
 {
     //如果申请的参数非法，抛出异常
     if (thread_number <= 0 || max_work_number <= 0) 
@@ -55,36 +72,110 @@ m_thread_number(thread_number), m_max_work_number(max_work_number), m_actor_mode
         throw std::exception();
     }
     
-    //创建线程数组，如果创建失败抛出异常
-    m_threads = new pthread_t[thread_number]; 
-    if (! m_threads)
-    {
-        throw std::exception();
-    }
-
-    //创建thread_number个线程，它们都去执行 worker 部分的代码，并设置线程分离自行销毁
+    //创建thread_number个线程，它们都去执行 worker 部分的代码，析构时统一回收
+    m_queuelocker.lock();
     for (int i = 0; i < thread_number; i++)
     {
-        printf( "create the %dth thread\n", i);
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0) //worker为静态，被所有线程共享
+        LOG_INFO( "create the %dth thread", i);
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, this) != 0) //worker为静态，被所有线程共享
         {
-            delete [] m_threads;
-            throw std::exception();
-        }
-
-        if (pthread_detach(m_threads[i]) != 0)
-        {
-            delete [] m_threads;
+            m_queuelocker.unlock();
+            shutdown();
             throw std::exception();
         }
+        m_threads.push_back(tid);
     }
-    
+    m_queuelocker.unlock();
 };
 
 //析构函数
 template< typename T >
 threadpool<T> :: ~threadpool(){
-    delete [] m_threads;
+    shutdown();
+}
+
+//通知所有工作线程退出并等待它们结束，队列中尚未处理的任务被丢弃
+template< typename T >
+void threadpool<T> :: shutdown(){
+    // 置位之后工作线程不会再修改 m_threads
+    m_queuelocker.lock();
+    m_stop = true;
+    std::vector<pthread_t> threads;
+    threads.swap(m_threads);
+    m_queuelocker.unlock();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        m_queuestat.post();
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    join_retired();
+}
+
+//回收缩容时退出的线程
+template< typename T >
+void threadpool<T> :: join_retired(){
+    m_queuelocker.lock();
+    std::vector<pthread_t> retired;
+    retired.swap(m_retired);
+    m_queuelocker.unlock();
+    for (size_t i = 0; i < retired.size(); i++)
+    {
+        pthread_join(retired[i], NULL);
+    }
+}
+
+//增加线程时先取消尚未生效的缩容；减少线程时唤醒相应数量的线程，让它们在取任务之前退出
+template< typename T >
+void threadpool<T> :: resize(int thread_number){
+    if (thread_number <= 0) return;
+    join_retired();
+
+    m_queuelocker.lock();
+    int current = m_threads.size() - m_retire;
+    if (thread_number > current)
+    {
+        int cancel = std::min(m_retire, thread_number - current);
+        m_retire -= cancel;
+        current += cancel;
+        // 持有锁创建线程，新线程在 m_threads 记录它之前不会开始取任务
+        for (; current < thread_number; current++)
+        {
+            pthread_t tid;
+            if (pthread_create(&tid, NULL, worker, this) != 0)
+            {
+                LOG_ERROR("create worker thread failed, pool keeps %d threads", current);
+                break;
+            }
+            m_threads.push_back(tid);
+        }
+        m_queuelocker.unlock();
+    }
+    else if (thread_number < current)
+    {
+        int retire = current - thread_number;
+        m_retire += retire;
+        m_queuelocker.unlock();
+        for (int i = 0; i < retire; i++)
+        {
+            m_queuestat.post();
+        }
+    }
+    else
+    {
+        m_queuelocker.unlock();
+    }
+}
+
+template< typename T >
+void threadpool<T> :: set_max_requests(int max_work_number){
+    if (max_work_number <= 0) return;
+    m_queuelocker.lock();
+    m_max_work_number = max_work_number;
+    m_queuelocker.unlock();
 }
 
 //append函数, 将工作添加到工作队列
@@ -101,8 +192,11 @@ bool threadpool<T> :: append( T* request ) //int state
         return false;
     }
 
-    //将任务放入任务队列
+    //将任务放入任务队列，记录入队时间
+    request->m_enqueue_ns = Metrics::now_ns();
     m_work_queue.push_back(request);
+    Metrics::set_gauge(GAUGE_QUEUE_DEPTH, m_work_queue.size());
+    WS_PROBE2(queue_enqueue, request, m_work_queue.size());
 
     //解锁
     m_queuelocker.unlock();
@@ -132,6 +226,21 @@ void threadpool<T> :: run()
         //访问共享资源，加锁
         m_queuelocker.lock();
 
+        if ( m_stop ) {
+            m_queuelocker.unlock();
+            break;
+        }
+
+        // 缩容：resize 额外 post 了相同次数，即使这次消耗的是某个任务的通知，任务也不会丢失
+        if ( m_retire > 0 ) {
+            m_retire--;
+            pthread_t self = pthread_self();
+            m_threads.erase(std::find(m_threads.begin(), m_threads.end(), self));
+            m_retired.push_back(self);
+            m_queuelocker.unlock();
+            break;
+        }
+
         if ( m_work_queue.empty() ) {
             m_queuelocker.unlock();
             continue;
@@ -140,13 +249,22 @@ void threadpool<T> :: run()
         //取出队列最前端的任务执行
         T* request = m_work_queue.front();
         m_work_queue.pop_front();
+        Metrics::set_gauge(GAUGE_QUEUE_DEPTH, m_work_queue.size());
+        WS_PROBE3(queue_dequeue, request, m_work_queue.size(), request ? request->m_enqueue_ns : 0);
         m_queuelocker.unlock();
 
         if (!request) continue;
+        uint64_t dequeue_ns = Metrics::now_ns();
+        Metrics::record(STAGE_QUEUE, dequeue_ns - request->m_enqueue_ns);
+        if (request->m_traced) Trace::span(TR_QUEUE, request->m_conn_id, request->m_enqueue_ns, dequeue_ns);
 
         if (m_actor_model == 1) // Reactor 模型
         {
-            if (request->m_state == 0)
+            if (request->m_state == 2)
+            {
+                request->process();
+            }
+            else if (request->m_state == 0)
             {
                 if (request->read())
                 {
@@ -155,20 +273,23 @@ void threadpool<T> :: run()
                 }
                 else
                 {
-                    request->m_finish = 1;
+                    // 先置 m_timerflag，主线程看到 m_finish 时一定能看到它
                     request->m_timerflag = 1;
+                    request->m_finish = 1;
                 }
             }
             else 
             {
                 if (request->write())
                 {
+                    // 流水线中的下一个请求由主线程取令牌后再放回队列（m_state == 2）
                     request->m_finish = 1;
                 }
                 else
                 {
-                    request->m_finish = 1;
+                    // 先置 m_timerflag，主线程看到 m_finish 时一定能看到它
                     request->m_timerflag = 1;
+                    request->m_finish = 1;
                 }
             }
         }
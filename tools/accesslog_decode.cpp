@@ -0,0 +1,131 @@
+// 把二进制访问日志解码为文本或 CSV
+// 用法: accesslog_decode [-c] file...
+//   -c  输出 CSV（带表头），默认输出每行一条的文本
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "../access_log.h"
+
+static const char* method_names[] = { "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT" };
+
+static const char* method_name(int method)
+{
+    if (method < 0 || method >= (int)(sizeof(method_names) / sizeof(method_names[0]))) return "-";
+    return method_names[method];
+}
+
+// CSV 字段中的双引号需要转义
+static void print_csv_string(const char* s, int len)
+{
+    putchar('"');
+    for (int i = 0; i < len; ++i)
+    {
+        if (s[i] == '"') putchar('"');
+        putchar(s[i]);
+    }
+    putchar('"');
+}
+
+static int decode(const char* path, bool csv)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return -1;
+    }
+
+    access_log_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.m_magic, ACCESS_LOG_MAGIC, 4) != 0)
+    {
+        fprintf(stderr, "%s: not an access log\n", path);
+        fclose(fp);
+        return -1;
+    }
+    if (header.m_version != ACCESS_LOG_VERSION)
+    {
+        fprintf(stderr, "%s: unsupported version %u\n", path, header.m_version);
+        fclose(fp);
+        return -1;
+    }
+
+    access_record rec;
+    char url[AccessLog::MAX_URL + 1];
+    long count = 0;
+    while (fread(&rec, sizeof(rec), 1, fp) == 1)
+    {
+        if (rec.m_url_len > AccessLog::MAX_URL || rec.m_size != sizeof(rec) + rec.m_url_len ||
+            fread(url, 1, rec.m_url_len, fp) != rec.m_url_len)
+        {
+            fprintf(stderr, "%s: truncated or corrupt record after %ld records\n", path, count);
+            fclose(fp);
+            return -1;
+        }
+        url[rec.m_url_len] = '\0';
+
+        char ip[INET_ADDRSTRLEN];
+        struct in_addr addr;
+        addr.s_addr = rec.m_client_ip;
+        inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+
+        if (csv)
+        {
+            printf("%llu,%s,%u,%llu,%s,", (unsigned long long)rec.m_ts_us, ip, ntohs(rec.m_client_port),
+                (unsigned long long)rec.m_conn_id, method_name(rec.m_method));
+            print_csv_string(url, rec.m_url_len);
+            printf(",%u,%llu,%u\n", rec.m_status, (unsigned long long)rec.m_bytes, rec.m_latency_us);
+        }
+        else
+        {
+            time_t sec = rec.m_ts_us / 1000000;
+            struct tm tm_ts;
+            gmtime_r(&sec, &tm_ts);
+            char when[32];
+            strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm_ts);
+            printf("%s.%06lluZ %s:%u conn=%llu %s %s %u %lluB %uus\n", when,
+                (unsigned long long)(rec.m_ts_us % 1000000), ip, ntohs(rec.m_client_port),
+                (unsigned long long)rec.m_conn_id, method_name(rec.m_method), url, rec.m_status,
+                (unsigned long long)rec.m_bytes, rec.m_latency_us);
+        }
+        ++count;
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    bool csv = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            csv = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c] file...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-c] file...\n", argv[0]);
+        return 1;
+    }
+
+    if (csv)
+    {
+        printf("ts_us,client_ip,client_port,conn_id,method,url,status,bytes,latency_us\n");
+    }
+    int ret = 0;
+    for (int i = optind; i < argc; ++i)
+    {
+        if (decode(argv[i], csv) != 0) ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,219 @@
+// 把文档根目录打包成服务器可以直接映射的资源包（格式见 bundle.h）
+// 用法: mkbundle doc_root output
+// 只打包 others 可读的普通文件（服务器对其余文件返回 403），符号链接指向普通文件时打包其内容。
+// 先写入 output.tmp，完成后再改名，服务器不会读到写了一半的文件
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../bundle.h"
+
+struct file_item{
+    std::string m_path;     // 请求路径，以 '/' 开头
+    std::string m_file;     // 文件系统中的路径
+    uint64_t m_size;
+    bundle_entry m_entry;
+};
+
+static bool path_less(const file_item& a, const file_item& b)
+{
+    // 与 Bundle::find 相同的顺序：按字节比较，前缀较短的在前
+    return a.m_path < b.m_path;
+}
+
+static const char* content_type(const std::string& path)
+{
+    static const char* types[][2] = {
+        { ".html", "text/html" }, { ".htm", "text/html" },
+        { ".css", "text/css" }, { ".js", "application/javascript" },
+        { ".json", "application/json" }, { ".txt", "text/plain" },
+        { ".xml", "application/xml" }, { ".svg", "image/svg+xml" },
+        { ".png", "image/png" }, { ".jpg", "image/jpeg" }, { ".jpeg", "image/jpeg" },
+        { ".gif", "image/gif" }, { ".ico", "image/x-icon" }, { ".webp", "image/webp" },
+        { ".mp4", "video/mp4" }, { ".woff", "font/woff" }, { ".woff2", "font/woff2" },
+    };
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+    {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+        {
+            if (strcasecmp(path.c_str() + dot, types[i][0]) == 0) return types[i][1];
+        }
+    }
+    // 与服务器从文档根目录发送时的默认值一致
+    return "text/html";
+}
+
+static bool collect(const std::string& dir, const std::string& prefix, std::vector<file_item>& items)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+    {
+        fprintf(stderr, "cannot open directory %s: %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    struct dirent* ent;
+    while (ok && (ent = readdir(d)) != NULL)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        std::string file = dir + "/" + ent->d_name;
+        std::string path = prefix + "/" + ent->d_name;
+        struct stat st;
+        if (lstat(file.c_str(), &st) < 0) continue;
+        // 目录只在不是符号链接时递归，避免循环
+        if (S_ISDIR(st.st_mode))
+        {
+            ok = collect(file, path, items);
+            continue;
+        }
+        if (S_ISLNK(st.st_mode) && stat(file.c_str(), &st) < 0) continue;
+        if (!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)) continue;
+        file_item item;
+        item.m_path = path;
+        item.m_file = file;
+        item.m_size = st.st_size;
+        memset(&item.m_entry, 0, sizeof(item.m_entry));
+        items.push_back(item);
+    }
+    closedir(d);
+    return ok;
+}
+
+// FNV-1a，作为 ETag
+static bool hash_file(const file_item& item, uint64_t& hash)
+{
+    FILE* fp = fopen(item.m_file.c_str(), "rb");
+    if (!fp) return false;
+    hash = 14695981039346656037ull;
+    char buf[64 * 1024];
+    size_t n;
+    uint64_t total = 0;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ull;
+        }
+        total += n;
+    }
+    fclose(fp);
+    return total == item.m_size;
+}
+
+static bool copy_file(const file_item& item, FILE* out)
+{
+    FILE* fp = fopen(item.m_file.c_str(), "rb");
+    if (!fp) return false;
+    char buf[64 * 1024];
+    size_t n;
+    uint64_t total = 0;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        if (fwrite(buf, 1, n, out) != n) break;
+        total += n;
+    }
+    fclose(fp);
+    return total == item.m_size;
+}
+
+static uint64_t align_up(uint64_t off)
+{
+    return (off + BUNDLE_ALIGN - 1) / BUNDLE_ALIGN * BUNDLE_ALIGN;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s doc_root output\n", argv[0]);
+        return 2;
+    }
+    std::string root = argv[1];
+    while (root.size() > 1 && root[root.size() - 1] == '/') root.erase(root.size() - 1);
+
+    std::vector<file_item> items;
+    if (!collect(root, "", items)) return 1;
+    std::sort(items.begin(), items.end(), path_less);
+
+    // 字符串区紧跟在索引后面，文件内容从其后第一个对齐的位置开始
+    std::string strings;
+    uint64_t strings_off = sizeof(bundle_header) + items.size() * sizeof(bundle_entry);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        file_item& item = items[i];
+        uint64_t hash;
+        if (!hash_file(item, hash))
+        {
+            fprintf(stderr, "cannot read %s (changed while packing?)\n", item.m_file.c_str());
+            return 1;
+        }
+        char etag[32];
+        snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)hash);
+        char head[256];
+        snprintf(head, sizeof(head), "Content-Length: %llu\r\nContent-Type: %s\r\nETag: %s\r\n",
+            (unsigned long long)item.m_size, content_type(item.m_path), etag);
+
+        bundle_entry& e = item.m_entry;
+        e.m_data_len = item.m_size;
+        e.m_path_off = strings_off + strings.size();
+        e.m_path_len = item.m_path.size();
+        strings += item.m_path;
+        e.m_head_off = strings_off + strings.size();
+        e.m_head_len = strlen(head);
+        strings += head;
+        e.m_etag_off = strings_off + strings.size();
+        e.m_etag_len = strlen(etag);
+        strings += etag;
+    }
+    uint64_t off = align_up(strings_off + strings.size());
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        items[i].m_entry.m_data_off = off;
+        off = align_up(off + items[i].m_size);
+    }
+    uint64_t total = items.empty() ? strings_off + strings.size()
+        : items.back().m_entry.m_data_off + items.back().m_size;
+
+    std::string tmp = std::string(argv[2]) + ".tmp";
+    FILE* out = fopen(tmp.c_str(), "wb");
+    if (!out)
+    {
+        fprintf(stderr, "cannot create %s: %s\n", tmp.c_str(), strerror(errno));
+        return 1;
+    }
+    bundle_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, BUNDLE_MAGIC, 4);
+    header.m_version = BUNDLE_VERSION;
+    header.m_count = items.size();
+    header.m_size = total;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (size_t i = 0; ok && i < items.size(); ++i)
+    {
+        ok = fwrite(&items[i].m_entry, sizeof(bundle_entry), 1, out) == 1;
+    }
+    ok = ok && fwrite(strings.data(), 1, strings.size(), out) == strings.size();
+    for (size_t i = 0; ok && i < items.size(); ++i)
+    {
+        // 对齐用的空洞直接 seek 过去
+        ok = fseeko(out, items[i].m_entry.m_data_off, SEEK_SET) == 0 && copy_file(items[i], out);
+        if (!ok) fprintf(stderr, "cannot copy %s (changed while packing?)\n", items[i].m_file.c_str());
+    }
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), argv[2]) != 0)
+    {
+        fprintf(stderr, "write %s failed\n", argv[2]);
+        unlink(tmp.c_str());
+        return 1;
+    }
+    printf("packed %zu files, %llu bytes into %s\n", items.size(), (unsigned long long)total, argv[2]);
+    return 0;
+}
@@ -0,0 +1,697 @@
+// 回放服务器用 -C 录制的流量，比较一个或两个目标的吞吐和延迟分布
+//
+// 每个录制的连接按原来的时间间隔重新建立，收到的每一段数据按原来的边界发送，
+// 所以请求路径、头部大小、keep-alive 和流水线的模式都与录制时相同。
+// 录制时客户端在收到某些应答后才发送下一段数据，回放时同样要等到这些应答返回才发送，
+// 延迟从"本应发送的时间"开始计算，服务器变慢时不会被掩盖（修正协调遗漏）
+//
+// 用法: replay [-s speed] [-c conns] [-T ms] [-i] capture_file host:port [host:port]
+//   -s speed   回放速度，1 为原速（默认），2 为两倍速，0 为尽快发送（只保留应答依赖）
+//   -c conns   同时打开的最大连接数（默认 1024），超出的连接整体顺延
+//   -T ms      超过该时间没有任何进展则放弃剩余连接（默认 10000）
+//   -i         只打印录制文件的概况
+// 给出两个目标时依次回放，并列输出两者的结果和差异
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <queue>
+#include <algorithm>
+#include "../capture.h"
+#include "../message_framer.h"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 一次 recv 收到的数据
+struct cap_chunk{
+    uint64_t m_at_ns;     // 相对录制开始的时间
+    std::string m_data;
+    int m_requests;       // 在这一段中结束的完整请求数
+    int m_deps;           // 发送前已经完成的应答数
+};
+
+struct cap_conn{
+    uint64_t m_id;
+    uint64_t m_open_ns;
+    uint64_t m_close_ns;
+    std::vector<cap_chunk> m_chunks;
+    std::vector<int> m_status; // 录制时每个应答的状态码
+    std::vector<bool> m_head;  // 每个请求是否是 HEAD，它的应答没有消息体
+    int m_requests;
+};
+
+struct capture_file{
+    std::vector<cap_conn> m_conns; // 按建立时间排序
+    int m_broken;                  // 记录不完整而跳过的连接
+    uint64_t m_duration_ns;
+};
+
+// 把连接上收到的字节流切分成请求（Content-Length 或 chunked 请求体），记录每个请求在哪一段数据中结束
+static void count_requests(cap_conn& c)
+{
+    message_framer fr;
+    c.m_requests = 0;
+    c.m_head.clear();
+    for (size_t i = 0; i < c.m_chunks.size(); ++i)
+    {
+        const char* data = c.m_chunks[i].m_data.data();
+        size_t len = c.m_chunks[i].m_data.size();
+        while (len > 0)
+        {
+            size_t used = fr.feed(data, len);
+            data += used;
+            len -= used;
+            if (fr.m_state == message_framer::FR_HEADER_DONE)
+            {
+                c.m_head.push_back(fr.head_request());
+                fr.start_body(false);
+            }
+            if (fr.m_state == message_framer::FR_DONE)
+            {
+                c.m_chunks[i].m_requests++;
+                c.m_requests++;
+                fr.reset();
+            }
+        }
+    }
+    // 最后一个请求不完整时没有应答可等
+    c.m_head.resize(c.m_requests);
+}
+
+struct raw_record{
+    capture_record m_rec;
+    std::string m_data;
+    bool operator<(const raw_record& other) const { return m_rec.m_seq < other.m_rec.m_seq; }
+};
+
+static bool load_capture(const char* path, capture_file& out)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    capture_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.m_magic, CAPTURE_MAGIC, 4) != 0)
+    {
+        fprintf(stderr, "%s is not a capture file\n", path);
+        fclose(fp);
+        return false;
+    }
+    if (header.m_version != CAPTURE_VERSION)
+    {
+        fprintf(stderr, "%s: unsupported version %u\n", path, header.m_version);
+        fclose(fp);
+        return false;
+    }
+
+    std::map<uint64_t, std::vector<raw_record> > by_conn;
+    raw_record r;
+    while (fread(&r.m_rec, sizeof(r.m_rec), 1, fp) == 1)
+    {
+        if (r.m_rec.m_size < sizeof(r.m_rec))
+        {
+            fprintf(stderr, "%s: corrupt record\n", path);
+            break;
+        }
+        r.m_data.resize(r.m_rec.m_size - sizeof(r.m_rec));
+        if (!r.m_data.empty() && fread(&r.m_data[0], r.m_data.size(), 1, fp) != 1)
+        {
+            fprintf(stderr, "%s: truncated record\n", path);
+            break;
+        }
+        by_conn[r.m_rec.m_conn_id].push_back(r);
+    }
+    fclose(fp);
+
+    out.m_conns.clear();
+    out.m_broken = 0;
+    out.m_duration_ns = 0;
+    for (std::map<uint64_t, std::vector<raw_record> >::iterator it = by_conn.begin(); it != by_conn.end(); ++it)
+    {
+        std::vector<raw_record>& recs = it->second;
+        std::sort(recs.begin(), recs.end());
+        bool ok = recs[0].m_rec.m_type == CAP_OPEN;
+        for (size_t i = 0; ok && i < recs.size(); ++i) ok = recs[i].m_rec.m_seq == i;
+        if (!ok)
+        {
+            out.m_broken++;
+            continue;
+        }
+
+        cap_conn c;
+        c.m_id = it->first;
+        c.m_open_ns = recs[0].m_rec.m_ts_ns - header.m_start_ns;
+        c.m_close_ns = recs.back().m_rec.m_ts_ns - header.m_start_ns;
+        int responses = 0;
+        for (size_t i = 1; i < recs.size(); ++i)
+        {
+            const capture_record& rec = recs[i].m_rec;
+            if (rec.m_type == CAP_DATA)
+            {
+                cap_chunk ch;
+                ch.m_at_ns = rec.m_ts_ns - header.m_start_ns;
+                ch.m_data = recs[i].m_data;
+                ch.m_requests = 0;
+                ch.m_deps = responses;
+                c.m_chunks.push_back(ch);
+            }
+            else if (rec.m_type == CAP_RESPONSE)
+            {
+                c.m_status.push_back(rec.m_status);
+                responses++;
+            }
+        }
+        count_requests(c);
+        out.m_duration_ns = std::max(out.m_duration_ns, c.m_close_ns);
+        out.m_conns.push_back(c);
+    }
+
+    struct by_open{
+        bool operator()(const cap_conn& a, const cap_conn& b) const { return a.m_open_ns < b.m_open_ns; }
+    };
+    std::stable_sort(out.m_conns.begin(), out.m_conns.end(), by_open());
+    return true;
+}
+
+static bool resolve(const char* target, sockaddr_in& addr)
+{
+    std::string s(target);
+    size_t colon = s.rfind(':');
+    if (colon == std::string::npos) return false;
+    std::string host = s.substr(0, colon);
+    int port = atoi(s.c_str() + colon + 1);
+    if (port <= 0) return false;
+
+    addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), NULL, &hints, &res) != 0) return false;
+    addr = *(sockaddr_in*)res->ai_addr;
+    addr.sin_port = htons(port);
+    freeaddrinfo(res);
+    return true;
+}
+
+struct replay_options{
+    double speed;
+    int max_conns;
+    int timeout_ms;
+};
+
+// 回放过程中的一个连接
+struct replay_conn{
+    const cap_conn* m_cap;
+    int m_fd;
+    bool m_connected;
+    bool m_done;
+    uint64_t m_base_ns;          // 实际建立连接的时间
+    uint64_t m_last_response_ns;
+    size_t m_next;               // 下一段要发送的数据
+    std::string m_out;
+    size_t m_out_off;
+    std::deque<uint64_t> m_inflight; // 每个未完成请求的开始时间
+    size_t m_sent;               // 已经发出的请求数，也是下一个请求在 m_cap->m_head 中的下标
+    message_framer m_framer;     // 应答的解析状态
+    int m_status;
+    int m_responses;
+};
+
+struct replay_result{
+    uint64_t m_requests;
+    uint64_t m_bytes;
+    uint64_t m_status[6];        // 0 为其他，1..5 为 1xx..5xx
+    uint64_t m_mismatch;         // 状态码与录制时不同
+    uint64_t m_incomplete;       // 没有收到应答的请求
+    uint64_t m_conn_errors;
+    double m_duration_s;
+    std::vector<uint64_t> m_latency_ns;
+
+    double percentile(double p) const
+    {
+        if (m_latency_ns.empty()) return 0;
+        size_t idx = (size_t)(p / 100.0 * (m_latency_ns.size() - 1) + 0.5);
+        return m_latency_ns[idx] / 1e3;
+    }
+};
+
+class replayer{
+public:
+    replayer(const capture_file& cap, const sockaddr_in& addr, const replay_options& opt)
+        : m_cap(cap), m_addr(addr), m_opt(opt), m_epollfd(-1), m_timerfd(-1), m_active(0), m_next_open(0), m_finished(0) {}
+
+    bool run(replay_result& res);
+
+private:
+    // 录制时间 t 对应的回放时间
+    uint64_t scaled(uint64_t t) const { return m_opt.speed > 0 ? (uint64_t)(t / m_opt.speed) : 0; }
+    void open_conn(int idx);
+    void finish(replay_conn& c);
+    void advance(int idx);
+    bool flush_out(replay_conn& c);
+    bool parse_responses(replay_conn& c, const char* data, size_t len);
+    void on_event(int idx, uint32_t events);
+    void update_events(replay_conn& c);
+
+private:
+    static const uint32_t TIMER_ID = 0xffffffff; // epoll 事件中代表 timerfd
+
+    const capture_file& m_cap;
+    sockaddr_in m_addr;
+    replay_options m_opt;
+    int m_epollfd;
+    int m_timerfd;
+    uint64_t m_start_ns;
+    uint64_t m_last_progress_ns;
+    std::vector<replay_conn> m_conns;
+    int m_active;
+    size_t m_next_open;
+    size_t m_finished;
+    std::priority_queue<std::pair<uint64_t, int>, std::vector<std::pair<uint64_t, int> >,
+                        std::greater<std::pair<uint64_t, int> > > m_wakeups;
+    replay_result* m_res;
+};
+
+void replayer::update_events(replay_conn& c)
+{
+    epoll_event ev;
+    ev.data.u32 = &c - &m_conns[0];
+    ev.events = EPOLLIN;
+    if (!c.m_connected || c.m_out_off < c.m_out.size()) ev.events |= EPOLLOUT;
+    epoll_ctl(m_epollfd, EPOLL_CTL_MOD, c.m_fd, &ev);
+}
+
+void replayer::open_conn(int idx)
+{
+    replay_conn& c = m_conns[idx];
+    c.m_base_ns = now_ns();
+    c.m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(c.m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    m_active++;
+    if (c.m_fd < 0 || (connect(c.m_fd, (sockaddr*)&m_addr, sizeof(m_addr)) < 0 && errno != EINPROGRESS))
+    {
+        m_res->m_conn_errors++;
+        finish(c);
+        return;
+    }
+    epoll_event ev;
+    ev.data.u32 = idx;
+    ev.events = EPOLLIN | EPOLLOUT;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, c.m_fd, &ev);
+}
+
+// 连接结束，尚未发送或尚未收到应答的请求都记为未完成
+void replayer::finish(replay_conn& c)
+{
+    if (c.m_done) return;
+    uint64_t unsent = 0;
+    for (size_t i = c.m_next; i < c.m_cap->m_chunks.size(); ++i) unsent += c.m_cap->m_chunks[i].m_requests;
+    m_res->m_incomplete += c.m_inflight.size() + unsent;
+    if (c.m_fd >= 0) close(c.m_fd);
+    c.m_fd = -1;
+    c.m_done = true;
+    m_active--;
+    m_finished++;
+}
+
+bool replayer::flush_out(replay_conn& c)
+{
+    while (c.m_out_off < c.m_out.size())
+    {
+        ssize_t n = send(c.m_fd, c.m_out.data() + c.m_out_off, c.m_out.size() - c.m_out_off, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        c.m_out_off += n;
+    }
+    if (c.m_out_off == c.m_out.size())
+    {
+        c.m_out.clear();
+        c.m_out_off = 0;
+    }
+    update_events(c);
+    return true;
+}
+
+// 发送所有已经满足条件的数据段，全部完成后按录制的时间关闭连接
+void replayer::advance(int idx)
+{
+    replay_conn& c = m_conns[idx];
+    if (c.m_done || !c.m_connected) return;
+    const cap_conn& cap = *c.m_cap;
+    uint64_t now = now_ns();
+    bool queued = false;
+    while (c.m_next < cap.m_chunks.size())
+    {
+        const cap_chunk& ch = cap.m_chunks[c.m_next];
+        if (c.m_responses < ch.m_deps) break; // 等待应答
+        uint64_t due = c.m_base_ns + scaled(ch.m_at_ns - cap.m_open_ns);
+        if (due > now)
+        {
+            m_wakeups.push(std::make_pair(due, idx));
+            break;
+        }
+        // 请求本应在 due 发出；如果要等应答，则从应答返回的时间算起
+        uint64_t start = std::max(due, ch.m_deps > 0 ? c.m_last_response_ns : c.m_base_ns);
+        for (int k = 0; k < ch.m_requests; ++k) c.m_inflight.push_back(start);
+        c.m_sent += ch.m_requests;
+        c.m_out += ch.m_data;
+        c.m_next++;
+        queued = true;
+    }
+    if (queued && !flush_out(c))
+    {
+        finish(c);
+        return;
+    }
+    if (c.m_next == cap.m_chunks.size() && c.m_inflight.empty() && c.m_out.empty())
+    {
+        uint64_t due = c.m_base_ns + scaled(cap.m_close_ns - cap.m_open_ns);
+        if (due > now) m_wakeups.push(std::make_pair(due, idx));
+        else finish(c);
+    }
+}
+
+// 解析收到的应答，返回 false 表示需要关闭连接。HEAD 请求和 1xx/204/304 的应答没有消息体，1xx 不是最终应答
+bool replayer::parse_responses(replay_conn& c, const char* data, size_t len)
+{
+    message_framer& fr = c.m_framer;
+    while (len > 0)
+    {
+        size_t used = fr.feed(data, len);
+        data += used;
+        len -= used;
+        if (fr.m_state == message_framer::FR_HEADER_DONE)
+        {
+            c.m_status = fr.status();
+            if (c.m_status == 0 || c.m_inflight.empty()) return false;
+            bool interim = c.m_status < 200;
+            // 第一个未完成请求的下标
+            size_t req = c.m_sent - c.m_inflight.size();
+            bool head = req < c.m_cap->m_head.size() && c.m_cap->m_head[req];
+            fr.start_body(interim || head || c.m_status == 204 || c.m_status == 304);
+            if (interim)
+            {
+                fr.reset();
+                continue;
+            }
+        }
+        if (fr.m_state != message_framer::FR_DONE) continue;
+        fr.reset();
+
+        uint64_t now = now_ns();
+        m_res->m_latency_ns.push_back(now - c.m_inflight.front());
+        c.m_inflight.pop_front();
+        m_res->m_requests++;
+        int cls = c.m_status / 100;
+        m_res->m_status[(cls >= 1 && cls <= 5) ? cls : 0]++;
+        if ((size_t)c.m_responses < c.m_cap->m_status.size() && c.m_cap->m_status[c.m_responses] != c.m_status)
+        {
+            m_res->m_mismatch++;
+        }
+        c.m_responses++;
+        c.m_last_response_ns = now;
+        m_last_progress_ns = now;
+    }
+    return true;
+}
+
+void replayer::on_event(int idx, uint32_t events)
+{
+    replay_conn& c = m_conns[idx];
+    if (c.m_done) return;
+    if (!c.m_connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c.m_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            m_res->m_conn_errors++;
+            finish(c);
+            return;
+        }
+        c.m_connected = true;
+        m_last_progress_ns = now_ns();
+        update_events(c);
+        advance(idx);
+        return;
+    }
+    if ((events & EPOLLOUT) && !flush_out(c))
+    {
+        finish(c);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+        char buf[65536];
+        while (true)
+        {
+            ssize_t n = recv(c.m_fd, buf, sizeof(buf), 0);
+            if (n > 0)
+            {
+                m_res->m_bytes += n;
+                if (!parse_responses(c, buf, n))
+                {
+                    finish(c);
+                    return;
+                }
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                finish(c);
+                return;
+            }
+            break;
+        }
+    }
+    advance(idx);
+}
+
+bool replayer::run(replay_result& res)
+{
+    m_res = &res;
+    res.m_requests = res.m_bytes = res.m_mismatch = res.m_incomplete = res.m_conn_errors = 0;
+    memset(res.m_status, 0, sizeof(res.m_status));
+    res.m_latency_ns.clear();
+
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_epollfd < 0 || m_timerfd < 0) return false;
+    epoll_event tev;
+    tev.data.u32 = TIMER_ID;
+    tev.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_timerfd, &tev);
+    m_conns.assign(m_cap.m_conns.size(), replay_conn());
+    for (size_t i = 0; i < m_conns.size(); ++i)
+    {
+        replay_conn& c = m_conns[i];
+        c.m_cap = &m_cap.m_conns[i];
+        c.m_fd = -1;
+        c.m_connected = c.m_done = false;
+        c.m_base_ns = c.m_last_response_ns = 0;
+        c.m_next = c.m_out_off = c.m_sent = 0;
+        c.m_status = c.m_responses = 0;
+    }
+
+    m_start_ns = m_last_progress_ns = now_ns();
+    epoll_event events[1024];
+    while (m_finished < m_conns.size())
+    {
+        uint64_t now = now_ns();
+        // 按录制的时间建立连接，超出并发上限时顺延
+        while (m_next_open < m_conns.size() && m_active < m_opt.max_conns &&
+               m_start_ns + scaled(m_cap.m_conns[m_next_open].m_open_ns) <= now)
+        {
+            open_conn(m_next_open++);
+        }
+        while (!m_wakeups.empty() && m_wakeups.top().first <= now)
+        {
+            int idx = m_wakeups.top().second;
+            m_wakeups.pop();
+            advance(idx);
+        }
+        if (now - m_last_progress_ns > (uint64_t)m_opt.timeout_ms * 1000000)
+        {
+            fprintf(stderr, "no progress for %d ms, giving up\n", m_opt.timeout_ms);
+            for (size_t i = 0; i < m_conns.size(); ++i)
+            {
+                finish(m_conns[i]);
+            }
+            break;
+        }
+
+        uint64_t next = now + 100000000; // 至少每 100ms 检查一次超时
+        if (m_next_open < m_conns.size() && m_active < m_opt.max_conns)
+        {
+            next = std::min(next, m_start_ns + scaled(m_cap.m_conns[m_next_open].m_open_ns));
+        }
+        if (!m_wakeups.empty()) next = std::min(next, m_wakeups.top().first);
+        // epoll_wait 的超时只能精确到毫秒，用 timerfd 按纳秒唤醒，避免把相邻的连接和请求攒成一批发出
+        itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = next / 1000000000;
+        its.it_value.tv_nsec = next % 1000000000;
+        timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+
+        int n = epoll_wait(m_epollfd, events, 1024, -1);
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.u32 == TIMER_ID)
+            {
+                uint64_t expirations;
+                ssize_t ret = read(m_timerfd, &expirations, sizeof(expirations));
+                (void)ret;
+                continue;
+            }
+            on_event(events[i].data.u32, events[i].events);
+        }
+    }
+    res.m_duration_s = (now_ns() - m_start_ns) / 1e9;
+    std::sort(res.m_latency_ns.begin(), res.m_latency_ns.end());
+    close(m_timerfd);
+    close(m_epollfd);
+    return true;
+}
+
+static void print_summary(const char* path, const capture_file& cap)
+{
+    uint64_t requests = 0, chunks = 0, bytes = 0, pipelined = 0;
+    for (size_t i = 0; i < cap.m_conns.size(); ++i)
+    {
+        const cap_conn& c = cap.m_conns[i];
+        requests += c.m_requests;
+        chunks += c.m_chunks.size();
+        for (size_t k = 0; k < c.m_chunks.size(); ++k)
+        {
+            bytes += c.m_chunks[k].m_data.size();
+            if (c.m_chunks[k].m_requests > 1) pipelined += c.m_chunks[k].m_requests;
+        }
+    }
+    printf("capture     %s\n", path);
+    printf("duration    %.3f s\n", cap.m_duration_ns / 1e9);
+    printf("conns       %zu (%d skipped: incomplete records)\n", cap.m_conns.size(), cap.m_broken);
+    printf("requests    %llu (%llu pipelined)\n", (unsigned long long)requests, (unsigned long long)pipelined);
+    printf("segments    %llu, %llu bytes\n", (unsigned long long)chunks, (unsigned long long)bytes);
+}
+
+static void print_results(const char** targets, const replay_result* res, int n)
+{
+    static const double pcts[] = { 50, 90, 99, 99.9, 100 };
+    static const char* pct_names[] = { "p50 (us)", "p90 (us)", "p99 (us)", "p99.9 (us)", "max (us)" };
+
+    printf("\n%-14s", "");
+    for (int i = 0; i < n; ++i) printf(" %16s", targets[i]);
+    if (n == 2) printf(" %9s", "delta");
+    printf("\n");
+
+    double values[12][2];
+    const char* names[12];
+    int rows = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        const replay_result& r = res[i];
+        int k = 0;
+        names[k] = "requests"; values[k++][i] = r.m_requests;
+        names[k] = "req/s"; values[k++][i] = r.m_duration_s > 0 ? r.m_requests / r.m_duration_s : 0;
+        names[k] = "duration (s)"; values[k++][i] = r.m_duration_s;
+        for (int p = 0; p < 5; ++p)
+        {
+            names[k] = pct_names[p];
+            values[k++][i] = r.percentile(pcts[p]);
+        }
+        names[k] = "incomplete"; values[k++][i] = r.m_incomplete;
+        names[k] = "conn errors"; values[k++][i] = r.m_conn_errors;
+        names[k] = "status diff"; values[k++][i] = r.m_mismatch;
+        names[k] = "non-2xx"; values[k++][i] = r.m_requests - r.m_status[2];
+        rows = k;
+    }
+    for (int k = 0; k < rows; ++k)
+    {
+        printf("%-14s", names[k]);
+        for (int i = 0; i < n; ++i) printf(" %16.1f", values[k][i]);
+        if (n == 2 && values[k][0] > 0) printf(" %+8.1f%%", (values[k][1] - values[k][0]) * 100 / values[k][0]);
+        printf("\n");
+    }
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-s speed] [-c conns] [-T ms] [-i] capture_file host:port [host:port]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    replay_options opt;
+    opt.speed = 1;
+    opt.max_conns = 1024;
+    opt.timeout_ms = 10000;
+    bool info = false;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "s:c:T:i")) != -1)
+    {
+        switch (ch)
+        {
+            case 's': opt.speed = atof(optarg); break;
+            case 'c': opt.max_conns = atoi(optarg); break;
+            case 'T': opt.timeout_ms = atoi(optarg); break;
+            case 'i': info = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    int nargs = argc - optind;
+    if (opt.speed < 0 || opt.max_conns <= 0 || opt.timeout_ms <= 0) usage(argv[0]);
+    if (nargs < 1 || (!info && (nargs < 2 || nargs > 3))) usage(argv[0]);
+
+    capture_file cap;
+    if (!load_capture(argv[optind], cap)) return 1;
+    print_summary(argv[optind], cap);
+    if (info) return 0;
+
+    const char* targets[2];
+    replay_result res[2];
+    int n = nargs - 1;
+    for (int i = 0; i < n; ++i)
+    {
+        targets[i] = argv[optind + 1 + i];
+        sockaddr_in addr;
+        if (!resolve(targets[i], addr))
+        {
+            fprintf(stderr, "bad target %s\n", targets[i]);
+            return 1;
+        }
+        fprintf(stderr, "replaying against %s ...\n", targets[i]);
+        replayer r(cap, addr, opt);
+        if (!r.run(res[i])) return 1;
+    }
+    print_results(targets, res, n);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "metrics.h"
+
+trace_span* Trace::m_spans = NULL;
+uint64_t Trace::m_mask = 0;
+std::atomic<uint64_t> Trace::m_pos(0);
+int Trace::m_sample_rate = 0;
+uint64_t Trace::m_sample_counter = 0;
+
+static __thread uint32_t t_tid = 0;
+
+static const char* event_names[TR_NUM] = {
+    "accept", "read", "queue", "parse", "do_request", "writev", "close", "timeout"
+};
+
+bool Trace::init(int sample_rate, uint32_t capacity)
+{
+    if (sample_rate <= 0 || m_spans) return false;
+    uint64_t size = 1;
+    while (size < capacity) size <<= 1;
+    m_spans = new trace_span[size];
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        m_spans[i].m_seq.store(0, std::memory_order_relaxed);
+    }
+    m_mask = size - 1;
+    m_sample_rate = sample_rate;
+    return true;
+}
+
+void Trace::span(TRACE_EVENT event, uint64_t conn_id, uint64_t start_ns, uint64_t end_ns, int64_t arg)
+{
+    if (!m_spans) return;
+    if (t_tid == 0) t_tid = syscall(SYS_gettid);
+
+    // 多个线程通过原子递增的位置各自占用一个槽位，写入期间 m_seq 置 0，导出时跳过
+    uint64_t pos = m_pos.fetch_add(1, std::memory_order_relaxed);
+    trace_span& s = m_spans[pos & m_mask];
+    s.m_seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.m_start_ns = start_ns;
+    s.m_dur_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    s.m_conn_id = conn_id;
+    s.m_arg = arg;
+    s.m_tid = t_tid;
+    s.m_event = event;
+    s.m_seq.store(pos + 1, std::memory_order_release);
+}
+
+void Trace::instant(TRACE_EVENT event, uint64_t conn_id, int64_t arg)
+{
+    uint64_t now = Metrics::now_ns();
+    span(event, conn_id, now, now, arg);
+}
+
+// 第一项是进程名的元数据事件，之后的每条记录都以 ",\n" 开头，分段导出时不需要记住是否已经写过记录
+void Trace::dump_begin(std::string& out, uint64_t& begin, uint64_t& end)
+{
+    char line[128];
+    snprintf(line, sizeof(line),
+        "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"webserver\"}}", getpid());
+    out.append(line);
+    end = m_spans ? m_pos.load(std::memory_order_acquire) : 0;
+    begin = end > m_mask + 1 ? end - (m_mask + 1) : 0;
+}
+
+uint64_t Trace::dump_records(std::string& out, uint64_t pos, uint64_t end, size_t budget)
+{
+    if (!m_spans) return end;
+    char line[256];
+    int pid = getpid();
+    size_t limit = out.size() + budget;
+    // 已经被覆盖的位置直接跳到缓冲区中最旧的记录
+    uint64_t oldest = m_pos.load(std::memory_order_acquire);
+    oldest = oldest > m_mask + 1 ? oldest - (m_mask + 1) : 0;
+    if (pos < oldest) pos = oldest;
+    for (; pos < end && out.size() < limit; ++pos)
+    {
+        trace_span& s = m_spans[pos & m_mask];
+        if (s.m_seq.load(std::memory_order_acquire) != pos + 1) continue;
+        uint64_t start_ns = s.m_start_ns, dur_ns = s.m_dur_ns, conn_id = s.m_conn_id;
+        int64_t arg = s.m_arg;
+        uint32_t tid = s.m_tid, event = s.m_event;
+        // 拷贝期间被覆盖的记录丢弃
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.m_seq.load(std::memory_order_relaxed) != pos + 1 || event >= TR_NUM) continue;
+
+        int len;
+        if (event == TR_CLOSE || event == TR_TIMEOUT)
+        {
+            len = snprintf(line, sizeof(line),
+                ",\n{\"name\":\"%s\",\"cat\":\"conn\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                "\"args\":{\"conn\":%llu}}",
+                event_names[event], start_ns / 1000.0, pid, tid,
+                (unsigned long long)conn_id);
+        }
+        else
+        {
+            len = snprintf(line, sizeof(line),
+                ",\n{\"name\":\"%s\",\"cat\":\"conn\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                "\"args\":{\"conn\":%llu,\"arg\":%lld}}",
+                event_names[event], start_ns / 1000.0, dur_ns / 1000.0, pid, tid,
+                (unsigned long long)conn_id, (long long)arg);
+        }
+        if (len > 0 && len < (int)sizeof(line))
+        {
+            out.append(line, len);
+        }
+    }
+    return pos;
+}
+
+void Trace::dump_end(std::string& out)
+{
+    out.append("\n]}\n");
+}
+
+void Trace::dump(std::string& out)
+{
+    uint64_t begin, end;
+    dump_begin(out, begin, end);
+    dump_records(out, begin, end, (size_t)-1 - out.size());
+    dump_end(out);
+}
+
+bool Trace::dump(const char* path)
+{
+    std::string out;
+    dump(out);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    const char* p = out.data();
+    size_t left = out.size();
+    while (left > 0)
+    {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0)
+        {
+            close(fd);
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    close(fd);
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// 请求生命周期中的事件
+enum TRACE_EVENT {
+    TR_ACCEPT = 0,  // accept + 初始化连接
+    TR_READ,        // 一次 recv
+    TR_QUEUE,       // 在线程池队列中等待
+    TR_PARSE,       // process_read()，包含 do_request
+    TR_REQUEST,     // do_request()
+    TR_WRITEV,      // 一次 writev
+    TR_CLOSE,       // 关闭连接（瞬时事件）
+    TR_TIMEOUT,     // 定时器到期（瞬时事件）
+    TR_NUM
+};
+
+// 环形缓冲区中的一条记录，m_seq 为 0 表示正在写入
+struct trace_span{
+    std::atomic<uint64_t> m_seq;
+    uint64_t m_start_ns;
+    uint64_t m_dur_ns;
+    uint64_t m_conn_id;
+    int64_t m_arg;      // 读写的字节数等附加信息
+    uint32_t m_tid;
+    uint32_t m_event;
+};
+
+// 采样的请求追踪：被采样的连接把各阶段的耗时写入预先分配的环形缓冲区（覆盖最旧的记录），
+// 需要时导出为 Chrome trace-event JSON，可以直接用 Perfetto / chrome://tracing 打开
+class Trace{
+public:
+    // sample_rate 为 N 表示每 N 个连接追踪一个，0 表示关闭；capacity 会向上取整为 2 的幂
+    static bool init(int sample_rate, uint32_t capacity = 1 << 16);
+    static bool enabled() { return m_spans != NULL; }
+
+    // 新连接建立时调用，决定是否追踪该连接。只在主线程中调用
+    static bool sample()
+    {
+        if (!m_spans) return false;
+        return (m_sample_counter++ % m_sample_rate) == 0;
+    }
+
+    static void span(TRACE_EVENT event, uint64_t conn_id, uint64_t start_ns, uint64_t end_ns, int64_t arg = 0);
+    static void instant(TRACE_EVENT event, uint64_t conn_id, int64_t arg = 0);
+
+    // 导出当前缓冲区中的所有记录
+    static void dump(std::string& out);
+    static bool dump(const char* path);
+    // 分段导出，用于流式应答：dump_begin 写入开头并给出当前记录的范围 [begin, end)，
+    // dump_records 从 pos 开始追加记录，超过 budget 字节或到达 end 时停下并返回下一个位置，
+    // 最后由 dump_end 写入结尾。分段之间被覆盖的记录跳过
+    static void dump_begin(std::string& out, uint64_t& begin, uint64_t& end);
+    static uint64_t dump_records(std::string& out, uint64_t pos, uint64_t end, size_t budget);
+    static void dump_end(std::string& out);
+
+private:
+    static trace_span* m_spans;
+    static uint64_t m_mask;
+    static std::atomic<uint64_t> m_pos;
+    static int m_sample_rate;
+    static uint64_t m_sample_counter;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include "transport.h"
+#include "log.h"
+
+transport* transport::m_current = socket_transport::get_instance();
+
+socket_transport* socket_transport::get_instance()
+{
+    static socket_transport instance;
+    return &instance;
+}
+
+int socket_transport::listen(int port, const listen_options& opt)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY); //绑定本机的所有IP地址
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // 这两项只是优化，内核不支持时照常监听
+    if (opt.m_defer_accept > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opt.m_defer_accept, sizeof(opt.m_defer_accept)) < 0)
+    {
+        LOG_WARN("set TCP_DEFER_ACCEPT failed, errno is %d", errno);
+    }
+    if (opt.m_fastopen > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &opt.m_fastopen, sizeof(opt.m_fastopen)) < 0)
+    {
+        LOG_WARN("set TCP_FASTOPEN failed, errno is %d", errno);
+    }
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, opt.m_backlog) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int socket_transport::accept(int listenfd, sockaddr_in* addr)
+{
+    socklen_t len = sizeof(*addr);
+    // 一次系统调用同时设置非阻塞和 close-on-exec，不需要再 fcntl
+    return ::accept4(listenfd, (sockaddr*)addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+ssize_t socket_transport::recv(int fd, void* buf, size_t len)
+{
+    return ::recv(fd, buf, len, 0);
+}
+
+ssize_t socket_transport::writev(int fd, const struct iovec* iov, int iovcnt)
+{
+    return ::writev(fd, iov, iovcnt);
+}
+
+int socket_transport::close(int fd)
+{
+    return ::close(fd);
+}
+
+int socket_transport::poll_create()
+{
+    return epoll_create(5);
+}
+
+int socket_transport::poll_ctl(int epollfd, int op, int fd, epoll_event* event)
+{
+    return epoll_ctl(epollfd, op, fd, event);
+}
+
+int socket_transport::poll_wait(int epollfd, epoll_event* events, int maxevents, int timeout_ms)
+{
+    return epoll_wait(epollfd, events, maxevents, timeout_ms);
+}
+
+// 对监听 socket，tcpi_unacked 是全连接队列的当前长度，tcpi_sacked 是队列上限
+bool socket_transport::listen_stats(int listenfd, int* queued, int* backlog)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(listenfd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) return false;
+    *queued = info.tcpi_unacked;
+    *backlog = info.tcpi_sacked;
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+// 服务器与内核网络接口之间的一层抽象：监听、accept、收发数据和 epoll 都经过当前的 transport。
+// 默认是直接调用系统调用的 socket_transport；基准测试和问题复现可以换成 loopback_transport，
+// 在进程内模拟连接，不经过内核协议栈。
+// 所有函数的返回值和 errno 与对应的系统调用一致
+
+// 监听 socket 的参数
+struct listen_options{
+    int m_backlog;       // 全连接队列长度，实际上限受 net.core.somaxconn 限制
+    int m_defer_accept;  // TCP_DEFER_ACCEPT 秒数，连接收到数据后才出现在 accept 队列中，0 表示关闭
+    int m_fastopen;      // TCP Fast Open 的队列长度，0 表示关闭
+
+    listen_options() : m_backlog(1024), m_defer_accept(0), m_fastopen(0) {}
+};
+
+class transport{
+public:
+    virtual ~transport() {}
+
+    virtual int listen(int port, const listen_options& opt) = 0;
+    // 返回的描述符已经是非阻塞的
+    virtual int accept(int listenfd, sockaddr_in* addr) = 0;
+    virtual ssize_t recv(int fd, void* buf, size_t len) = 0;
+    virtual ssize_t writev(int fd, const struct iovec* iov, int iovcnt) = 0;
+    virtual int close(int fd) = 0;
+
+    virtual int poll_create() = 0;
+    virtual int poll_ctl(int epollfd, int op, int fd, epoll_event* event) = 0;
+    virtual int poll_wait(int epollfd, epoll_event* events, int maxevents, int timeout_ms) = 0;
+
+    // 监听 socket 全连接队列的当前长度和上限
+    virtual bool listen_stats(int listenfd, int* queued, int* backlog) = 0;
+
+    static transport* current() { return m_current; }
+    // 必须在 Webserver::eventlisten() 之前设置，服务器运行中不能切换
+    static void set_current(transport* t) { m_current = t; }
+
+private:
+    static transport* m_current;
+};
+
+class socket_transport : public transport{
+public:
+    static socket_transport* get_instance();
+
+    virtual int listen(int port, const listen_options& opt);
+    virtual int accept(int listenfd, sockaddr_in* addr);
+    virtual ssize_t recv(int fd, void* buf, size_t len);
+    virtual ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+    virtual int close(int fd);
+
+    virtual int poll_create();
+    virtual int poll_ctl(int epollfd, int op, int fd, epoll_event* event);
+    virtual int poll_wait(int epollfd, epoll_event* events, int maxevents, int timeout_ms);
+
+    virtual bool listen_stats(int listenfd, int* queued, int* backlog);
+
+private:
+    socket_transport() {}
+};
+
+#endif
@@ -1,8 +1,21 @@
 #include"webserver.h"
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probes.h"
+#include "transport.h"
+#include "handoff.h"
+#include "rate_limit.h"
+#include "io_pool.h"
+#include "bundle.h"
+#include "path_index.h"
+#include "micro_cache.h"
+#include "capture.h"
 
 
 extern void addfd( int epollfd, int fd, bool one_shot, int TRIGMODE );
 extern void removefd( int epollfd, int fd );
+extern void modfd( int epollfd, int fd, int ev, int TRIGMode );
 extern void setnonblocking( int fd );
 
 static int pipefd[2];
@@ -23,25 +36,43 @@ void addsig(int signum, void (handler)(int))
     sig_act.sa_handler = handler;
     sig_act.sa_flags = 0;
     sigemptyset(&sig_act.sa_mask);
-    assert( sigaction( signum, &sig_act, NULL ) != -1 );
+    int ret = sigaction( signum, &sig_act, NULL );
+    assert( ret != -1 );
+    (void)ret;
 }
 
-void cb_func( http_conn* user_data ){
+// 关闭超时的连接
+static void close_expired( http_conn* user_data ){
+    if (user_data->m_traced) Trace::instant(TR_TIMEOUT, user_data->m_conn_id);
+    WS_PROBE1(timer_expire, user_data->m_conn_id);
     user_data -> close_conn();
-    printf("close connection for timeout\n");
+    LOG_DEBUG("close connection for timeout");
+}
+
+// 定时器到期的回调函数，定时器链表中的连接都处在某个请求阶段，按阶段分别统计
+void cb_func( http_conn* user_data ){
+    Metrics::inc((METRIC_COUNTER)(CNT_DEADLINE_HEAD + user_data->m_phase));
+    close_expired(user_data);
 }
 
-Webserver::Webserver(){
-    m_users = new http_conn[ MAX_FD ];
+Webserver::Webserver() : m_pool(NULL), m_io_pool(NULL), m_users(NULL), m_idle_count(0), m_timeout(false), m_stopserver(false), m_dumptrace(false), m_reload(false),
+    m_upgradefd(-1), m_draining(false), m_drain_deadline(0){
 }
 
 Webserver::~Webserver(){
     close(pipefd[0]);
     close(pipefd[1]);
-    close(m_epollfd);
-    close(m_listenfd);
+    transport::current()->close(m_epollfd);
+    transport::current()->close(m_listenfd);
+    if (m_upgradefd != -1){
+        close(m_upgradefd);
+        unlink(m_config.UpgradeSocket);
+    }
+    delete m_pool; // 先等工作线程退出，再释放它们可能访问的连接
+    PathIndex::shutdown();
+    if (http_conn::m_io_pool == m_io_pool) http_conn::m_io_pool = NULL;
+    delete m_io_pool;
     delete[] m_users;
-    delete[] m_pool;
 }
 
 void Webserver::initTrigMode(){
@@ -78,126 +109,374 @@ void Webserver::init(int port, int ActorMode, int TrigMode){
     initTrigMode();
 }
 
+void Webserver::init(const Config& config){
+    m_config = config;
+    init(config.PORT, config.ActorMode, config.TrigMode);
+}
+
 void Webserver::thread_pool(){
-    m_pool = new threadpool<http_conn>(m_ActorMode);
+    m_pool = new threadpool<http_conn>(m_ActorMode, m_config.ThreadNum, m_config.MaxRequests);
+    if (m_config.IoThreads > 0){
+        m_io_pool = new io_pool(m_config.IoThreads, m_config.MaxRequests);
+    }
 }
 
-void Webserver::eventlisten(){
-    // 监听流程
-    m_listenfd = socket(AF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+// 配置中的限流参数
+static rate_limits limits_of(const Config& config){
+    rate_limits limits;
+    limits.m_ip_rate = config.IpRate;
+    limits.m_ip_burst = config.IpBurst;
+    limits.m_ip_max_conns = config.IpMaxConns;
+    limits.m_subnet_rate = config.SubnetRate;
+    limits.m_subnet_burst = config.SubnetBurst;
+    limits.m_subnet_max_conns = config.SubnetMaxConns;
+    return limits;
+}
 
-    struct sockaddr_in addr;
-    int ret = 0;
-    bzero(&addr, sizeof(addr)); //将m_addr清0
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(m_port);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY); //绑定本机的所有IP地址
-
-    int opt = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    ret = bind(m_listenfd, (struct sockaddr *) &addr, sizeof(struct sockaddr));
-    assert(ret >= 0);
-    ret = listen(m_listenfd, 5); // 第二个参数为backlog，代表全连接队列最大长度
-    assert(ret >= 0);
+bool Webserver::eventlisten(){
+    m_users = new http_conn[ m_config.MaxConns ];
+    RateLimit::init(m_config.RateTableBits, m_config.SubnetPrefix);
+    RateLimit::set_limits(limits_of(m_config));
+    m_events.resize(m_config.MaxEvents);
+    http_conn::set_buffer_size(m_config.ReadBufferSize, m_config.WriteBufferSize, m_config.StreamChunkSize);
+    http_conn::set_doc_root(m_config.DocRoot);
+    http_conn::set_body_limits(m_config.MaxBodySize, m_config.SpoolDir);
+    MicroCache::set_limits(m_config.MicroCacheEntries, m_config.MicroCacheStaleMs);
+    http_conn::init_routes(m_config.MetricsCacheMs);
+    if (m_config.BundleFile[0] != '\0'){
+        if (Bundle::open(m_config.BundleFile, m_config.BundlePopulate, m_config.BundleHugePages)){
+            LOG_INFO("loaded bundle %s, %u files", m_config.BundleFile, Bundle::count());
+        }
+        else{
+            LOG_ERROR("load bundle %s failed, serve from doc_root only", m_config.BundleFile);
+        }
+    }
+
+    // 监听流程
+    // 有正在运行的旧进程时接管它的监听 socket，全连接队列中的连接不会丢失
+    m_listenfd = -1;
+    listen_options opt;
+    opt.m_backlog = m_config.Backlog;
+    opt.m_defer_accept = m_config.DeferAccept;
+    opt.m_fastopen = m_config.FastOpen;
+    if (m_config.UpgradeSocket[0] != '\0'){
+        m_listenfd = Handoff::receive_listener(m_config.UpgradeSocket);
+        if (m_listenfd >= 0) LOG_INFO("took over listening socket from %s", m_config.UpgradeSocket);
+    }
+    if (m_listenfd < 0){
+        m_listenfd = transport::current()->listen(m_port, opt);
+    }
+    // 这几步失败时服务器无法工作，Release 构建中 assert 不生效，必须显式检查
+    if (m_listenfd < 0){
+        LOG_ERROR("listen on port %d failed, errno is %d", m_port, errno);
+        return false;
+    }
 
     // 利用工具包设置epoll
-    m_epollfd = epoll_create(5);
-    assert(m_epollfd >= 0);
+    m_epollfd = transport::current()->poll_create();
+    if (m_epollfd < 0){
+        LOG_ERROR("create epoll failed, errno is %d", errno);
+        return false;
+    }
     addfd(m_epollfd, m_listenfd, false, m_ListenTrigMode);
     http_conn::m_epollfd = m_epollfd;
 
     // 创建管道，pipefd[0]是读，pipefd[1]是写
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert( ret != -1 );
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd) == -1){
+        LOG_ERROR("create signal pipe failed, errno is %d", errno);
+        return false;
+    }
+    setnonblocking( pipefd[0] );
     setnonblocking( pipefd[1] );
     addfd( m_epollfd, pipefd[0], false, 0);
 
+    // 预读完成的通知。进程内模拟的 transport 不监听真实的描述符，这时不预读
+    if (m_io_pool && transport::current() == socket_transport::get_instance()){
+        addfd(m_epollfd, m_io_pool->event_fd(), false, 0);
+        http_conn::m_io_pool = m_io_pool;
+    }
+    // splice 同样需要真实的套接字。splice 的数据不经过 read()，录制中看不到，录制时不使用
+    http_conn::m_splice_body_enabled = m_config.BodySplice && transport::current() == socket_transport::get_instance() &&
+        !Capture::get_instance()->enabled();
+    if (m_config.BodySplice && Capture::get_instance()->enabled()){
+        LOG_INFO("%s", "capture is on, body_splice disabled");
+    }
+    // 文件树索引同样需要监听真实的 inotify 描述符
+    if (m_config.PathIndex && transport::current() == socket_transport::get_instance()){
+        PathIndex::build(m_config.DocRoot, m_config.PathIndexMax);
+        if (PathIndex::watch_fd() >= 0) addfd(m_epollfd, PathIndex::watch_fd(), false, 0);
+    }
+
+    // 等待下一次升级的新进程连接
+    if (m_config.UpgradeSocket[0] != '\0'){
+        m_upgradefd = Handoff::open_control(m_config.UpgradeSocket);
+        if (m_upgradefd >= 0) addfd(m_epollfd, m_upgradefd, false, 0);
+    }
+
     // 设置信号处理函数
     addsig(SIGPIPE, SIG_IGN);
     addsig(SIGALRM, sig_handler);
     addsig(SIGTERM, sig_handler);
+    addsig(SIGUSR1, sig_handler);
+    addsig(SIGHUP, sig_handler);
 
     // 发送alarm信号
-    alarm(TIMESLOT);
+    alarm(m_config.Timeslot);
+    return true;
 }
 
 void Webserver::init_timer( int connfd, const sockaddr_in& saddr ){
-    printf("connecting %d\n", connfd);
+    LOG_DEBUG("connecting %d", connfd);
+    Metrics::inc(CNT_CONN_ACCEPTED);
     // 初始化客户端，设置定时器放入定时器链表
     m_users[connfd].init( connfd, saddr, m_ConnTrigMode );
     util_timer* timer = new util_timer();
     timer->m_user_data = &m_users[connfd];
     timer->m_cbfunc = cb_func;
     time_t cur = time(NULL);
-    timer->m_expire = cur + 3 * TIMESLOT;
+    // 新连接必须在 HeaderTimeout 内发完第一个请求头
+    m_users[connfd].m_phase = http_conn::PHASE_HEAD;
+    m_users[connfd].m_phase_start = cur;
+    timer->m_expire = cur + m_config.HeaderTimeout;
     m_users[connfd].m_timer = timer;
-    m_timer_lst.push_back( timer );
+    m_users[connfd].m_in_idle_lst = false;
+    m_timer_lst.add_timer( timer );
 }
 
-void Webserver::adjust_timer(util_timer* timer){
-    if (timer){
-        time_t cur = time(NULL);
-        timer -> m_expire = cur + 3*TIMESLOT;
+// 按连接所处的阶段计算绝对期限，阶段变化或 restart 时从现在开始计时。同一阶段内，
+// 请求头的期限固定不变，请求体和应答的期限只随已传输的字节数推后，涓流式发送无法无限延长。
+// 速率为 0 时不检查速率，每次有进展都从现在重新计算
+void Webserver::adjust_timer(int sockfd, http_conn::PHASE phase, bool restart){
+    http_conn& conn = m_users[sockfd];
+    util_timer* timer = conn.m_timer;
+    time_t cur = time(NULL);
+    if (restart || phase != conn.m_phase){
+        conn.m_phase = phase;
+        conn.m_phase_start = cur;
+    }
+    time_t expire = conn.m_phase_start;
+    switch (phase){
+        case http_conn::PHASE_HEAD:{
+            expire += m_config.HeaderTimeout;
+            break;
+        }
+        case http_conn::PHASE_BODY:{
+            if (m_config.MinBodyRate > 0)
+                expire += m_config.BodyTimeout + conn.body_received() / m_config.MinBodyRate;
+            else
+                expire = cur + m_config.BodyTimeout;
+            break;
+        }
+        case http_conn::PHASE_SEND:{
+            if (m_config.MinSendRate > 0)
+                expire += m_config.SendTimeout + conn.bytes_sent() / m_config.MinSendRate;
+            else
+                expire = cur + m_config.SendTimeout;
+            break;
+        }
+    }
+    // 空闲连接上来了新请求，回到定时器链表
+    if (conn.m_in_idle_lst){
+        leave_idle(sockfd);
+        timer->m_expire = expire;
+        m_timer_lst.add_timer(timer);
+    }
+    else if (timer->m_expire != expire){
+        timer->m_expire = expire;
         m_timer_lst.adjust_timer(timer);
-
-        printf("adjust timer once\n");
     }
+    LOG_DEBUG("adjust timer once");
 }
 
 void Webserver::del_timer(util_timer* timer, int sockfd){
-    timer -> m_cbfunc(&m_users[sockfd]); // 回调函数，关闭客户端连接
+    m_users[sockfd].close_conn(); // 关闭客户端连接
     if (timer){
-        m_timer_lst.del_timer(timer);
+        if (m_users[sockfd].m_in_idle_lst){
+            leave_idle(sockfd);
+        }
+        else{
+            m_timer_lst.del_timer(timer);
+        }
+    }
+    LOG_DEBUG("close fd: %d", sockfd);
+}
+
+// 应答已经发完、等待下一个请求的连接移入空闲链表，超时时间从现在开始重新计算
+void Webserver::mark_idle(int sockfd){
+    if (m_users[sockfd].m_in_idle_lst) return;
+    util_timer* timer = m_users[sockfd].m_timer;
+    m_timer_lst.del_timer(timer);
+    timer->m_expire = time(NULL) + m_config.ConnTimeout;
+    m_idle_lst.push_back(timer);
+    m_users[sockfd].m_in_idle_lst = true;
+    ++m_idle_count;
+    trim_idle();
+    Metrics::set_gauge(GAUGE_IDLE_CONNS, m_idle_count);
+}
+
+// 从空闲链表中取下，调用者负责把定时器放回定时器链表或关闭连接
+void Webserver::leave_idle(int sockfd){
+    m_idle_lst.del_timer(m_users[sockfd].m_timer);
+    m_users[sockfd].m_in_idle_lst = false;
+    --m_idle_count;
+    Metrics::set_gauge(GAUGE_IDLE_CONNS, m_idle_count);
+}
+
+// 关闭空闲最久的连接，没有空闲连接时返回 false。
+// keep-alive 连接在两个请求之间随时可能被服务器关闭，客户端会重新建立连接
+bool Webserver::evict_idle(){
+    util_timer* timer = m_idle_lst.front();
+    if (!timer) return false;
+    int sockfd = timer->m_user_data - m_users;
+    del_timer(timer, sockfd);
+    Metrics::inc(CNT_CONN_EVICTED);
+    LOG_DEBUG("evict idle connection %d", sockfd);
+    return true;
+}
+
+// 关闭空闲超时的连接，返回关闭的个数。空闲链表按进入空闲的先后排列，从表头检查即可
+int Webserver::expire_idle(){
+    int expired = 0;
+    time_t cur = time(NULL);
+    util_timer* timer;
+    while ((timer = m_idle_lst.front()) && cur >= timer->m_expire){
+        close_expired(timer->m_user_data);
+        leave_idle(timer->m_user_data - m_users);
+        ++expired;
+    }
+    return expired;
+}
+
+// 空闲连接数超过 m_config.MaxIdleConns 时关闭多出来的
+void Webserver::trim_idle(){
+    while (m_config.MaxIdleConns > 0 && m_idle_count > m_config.MaxIdleConns && evict_idle()){
+    }
+}
+
+// 记录一次 accept 的耗时
+void Webserver::trace_accept(int connfd, uint64_t start_ns){
+    uint64_t end = Metrics::now_ns();
+    Metrics::record(STAGE_ACCEPT, end - start_ns);
+    if (m_users[connfd].m_traced){
+        Trace::span(TR_ACCEPT, m_users[connfd].m_conn_id, start_ns, end, connfd);
     }
-    printf("close fd: %d\n", sockfd);
 }
 
+// 连接数已满，告知客户端后直接关闭
+void Webserver::reject_busy(int connfd){
+    char message[] = "Internel server busy";
+    struct iovec iv = { message, strlen(message) };
+    transport::current()->writev(connfd, &iv, 1);
+    transport::current()->close(connfd);
+}
+
+// 超过单个客户端或子网的限制，告知客户端后由调用者关闭连接
+static void send_too_many(int fd){
+    static const char message[] = "HTTP/1.1 429 Too Many Requests\r\nContent-Length: 0\r\n"
+        "Retry-After: 1\r\nConnection: close\r\n\r\n";
+    struct iovec iv = { (void*)message, sizeof(message) - 1 };
+    transport::current()->writev(fd, &iv, 1);
+}
+
+// 每次唤醒最多 accept m_config.AcceptBatch 个连接，LT 和 ET 相同，避免连接风暴时事件循环长时间停在 accept 上
 void Webserver::dealwithclient(){
+    // 监听 socket 已经交给新进程，这是同一批事件中剩下的
+    if (m_draining) return;
+    Metrics::inc(CNT_ACCEPT_WAKEUPS);
     // 接收新的客户端连接
     struct sockaddr_in saddr;
-    socklen_t saddrlen = sizeof(saddr);
-    if (m_ListenTrigMode == 0){ // LT
-        int connfd = accept( m_listenfd, (sockaddr*)&saddr, &saddrlen );
-        if ( connfd == -1 ){
-            printf("errno is %d, accept error\n", errno);
-            return;
+    for (int i = 0; i < m_config.AcceptBatch; ++i){
+        uint64_t start = Metrics::now_ns();
+        int connfd = transport::current()->accept(m_listenfd, &saddr);
+        if (connfd == -1){
+            // 描述符或内存不足：关闭一个空闲连接后重试，新来的客户端优先于空闲的连接
+            if ((errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) && evict_idle())
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_ERROR("errno is %d, accept error", errno);
+            return; // 队列已经取空
         }
-        if ( http_conn::m_user_count >= MAX_FD ){
-            const char* message = "Internel server busys";
-            send(connfd, message, strlen(message), 0);
-            close(connfd);
-            return;
+        // 先检查客户端自己的连接数，超限时不必为它关闭空闲连接
+        if (!RateLimit::acquire_conn(saddr.sin_addr.s_addr)){
+            send_too_many(connfd);
+            transport::current()->close(connfd);
+            Metrics::inc(CNT_CONN_LIMITED);
+            continue;
+        }
+        // 描述符编号就是 m_users 的下标，超出范围的无法接纳
+        if (connfd >= m_config.MaxConns ||
+            (http_conn::m_user_count >= m_config.MaxConns && !evict_idle())){
+            RateLimit::release_conn(saddr.sin_addr.s_addr);
+            reject_busy(connfd);
+            Metrics::inc(CNT_CONN_REJECTED);
+            continue;
         }
         init_timer( connfd, saddr );
+        trace_accept( connfd, start );
     }
-    else{ // ET
-        while(1){ // 读完返回值为-1, 且errno为EAGIN
-            int connfd = accept(m_listenfd, (sockaddr*)&saddr, &saddrlen);
-            if (connfd == -1){
-                if (errno != EAGAIN || errno != EWOULDBLOCK)
-                    printf("errno is %d, accept error\n", errno);
-                return;
-            }
-            if (http_conn::m_user_count >= MAX_FD){
-                const char* message = "Internel server busy";
-                send(connfd, message, strlen(message), 0);
-                close(connfd);
-                return;
-            }
-            init_timer( connfd, saddr );
-        }
+    // 达到单次上限，队列中可能还有连接。LT 下次 epoll_wait 会再报告；
+    // ET 不会再有新的边沿，重新注册一次，队列不为空时内核会立即产生事件
+    Metrics::inc(CNT_ACCEPT_BATCH_FULL);
+    if (m_ListenTrigMode == 1){
+        epoll_event event;
+        event.data.fd = m_listenfd;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        transport::current()->poll_ctl(m_epollfd, EPOLL_CTL_MOD, m_listenfd, &event);
+    }
+}
+
+// 定时采样监听队列的长度
+void Webserver::sample_listen_queue(){
+    int queued = 0, backlog = 0;
+    if (m_listenfd < 0 || !transport::current()->listen_stats(m_listenfd, &queued, &backlog)) return;
+    Metrics::set_gauge(GAUGE_ACCEPT_QUEUE, queued);
+    Metrics::set_gauge(GAUGE_ACCEPT_BACKLOG, backlog);
+}
+
+// 连接上开始一个新请求时取一个令牌，超限的请求在主线程中直接返回 429，不进入工作队列
+bool Webserver::allow_request(int sockfd){
+    if (RateLimit::allow_request(m_users[sockfd].client_ip())) return true;
+    Metrics::inc(CNT_REQ_LIMITED);
+    send_too_many(sockfd);
+    del_timer(m_users[sockfd].m_timer, sockfd);
+    return false;
+}
+
+// 应答发完后缓冲区中已经有流水线的下一个请求：与新请求一样先取令牌，再交给工作线程直接处理，不需要再读
+void Webserver::dispatch_pending(int sockfd){
+    if (!allow_request(sockfd)) return;
+    adjust_timer(sockfd, http_conn::PHASE_HEAD, true);
+    m_users[sockfd].m_state = 2;
+    if (!m_pool -> append(&m_users[sockfd])){
+        Metrics::inc(CNT_QUEUE_DROPPED);
+        del_timer(m_users[sockfd].m_timer, sockfd);
     }
-    return;
+}
+
+// 请求头收全之前处在 PHASE_HEAD，之后处在 PHASE_BODY，以工作线程最近一次解析的结果为准
+http_conn::PHASE Webserver::read_phase(int sockfd){
+    return m_users[sockfd].in_body() ? http_conn::PHASE_BODY : http_conn::PHASE_HEAD;
 }
 
 void Webserver::dealwithread(int sockfd){
     util_timer* timer = m_users[sockfd].m_timer;
+    // 读之前缓冲区为空，这次读到的是一个新请求的开头
+    bool new_request = m_users[sockfd].idle();
     if (m_ActorMode == 0){
         // Proactor 
         if (m_users[sockfd].read()){ 
-            adjust_timer(timer);
-            m_pool -> append(&m_users[sockfd]);
+            if (new_request && !allow_request(sockfd)) return;
+            adjust_timer(sockfd, read_phase(sockfd), new_request);
+            // 请求还没有收全时不唤醒工作线程，慢速客户端只占用主线程的一次读
+            if (m_users[sockfd].request_incomplete()){
+                modfd(m_epollfd, sockfd, EPOLLIN, m_ConnTrigMode);
+                return;
+            }
+            if (!m_pool -> append(&m_users[sockfd])){
+                // 工作队列已满，关闭连接而不是让它一直挂起
+                Metrics::inc(CNT_QUEUE_DROPPED);
+                del_timer(timer, sockfd);
+            }
         }
         else{
             del_timer(timer, sockfd);
@@ -205,8 +484,14 @@ void Webserver::dealwithread(int sockfd){
     }
     else{
         // Reactor: 等工作线程读完判断是否成功，如果没有成功则删除定时器
-        adjust_timer(timer);
-        m_pool -> append(&m_users[sockfd]);
+        if (new_request && !allow_request(sockfd)) return;
+        adjust_timer(sockfd, read_phase(sockfd), new_request);
+        m_users[sockfd].m_state = 0;
+        if (!m_pool -> append(&m_users[sockfd])){
+            Metrics::inc(CNT_QUEUE_DROPPED);
+            del_timer(timer, sockfd);
+            return;
+        }
         while(1){
             if (m_users[sockfd].m_finish == 1){
                 if (m_users[sockfd].m_timerflag == 1){
@@ -225,7 +510,16 @@ void Webserver::dealwithwrite(int sockfd){
     if (m_ActorMode == 0){
         // Proactor 
         if (m_users[sockfd].write()){
-            adjust_timer(timer);
+            if (m_users[sockfd].m_wait_next){
+                mark_idle(sockfd);
+                return;
+            }
+            // 流水线中的下一个请求已经在缓冲区里，直接交给工作线程
+            if (m_users[sockfd].has_pending()){
+                dispatch_pending(sockfd);
+                return;
+            }
+            adjust_timer(sockfd, http_conn::PHASE_SEND);
         }
         else{
             del_timer(timer, sockfd);
@@ -233,14 +527,28 @@ void Webserver::dealwithwrite(int sockfd){
     }
     else{
         // Reactor: 等工作线程写完判断是否成功，如果没有成功则删除定时器
-        adjust_timer(timer);
-        m_pool -> append(&m_users[sockfd]);
+        adjust_timer(sockfd, http_conn::PHASE_SEND);
+        m_users[sockfd].m_state = 1;
+        if (!m_pool -> append(&m_users[sockfd])){
+            Metrics::inc(CNT_QUEUE_DROPPED);
+            del_timer(timer, sockfd);
+            return;
+        }
         while(1){
             if (m_users[sockfd].m_finish == 1){
                 if (m_users[sockfd].m_timerflag == 1){
                     del_timer(timer, sockfd);
                     m_users[sockfd].m_timerflag = 0;
                 }
+                // 工作线程在置 m_finish 之前写好 m_wait_next 和读缓冲区
+                else if (m_users[sockfd].m_wait_next){
+                    mark_idle(sockfd);
+                }
+                else if (m_users[sockfd].has_pending()){
+                    m_users[sockfd].m_finish = 0;
+                    dispatch_pending(sockfd);
+                    break;
+                }
                 m_users[sockfd].m_finish = 0;
                 break;
             }
@@ -248,24 +556,32 @@ void Webserver::dealwithwrite(int sockfd){
     }
 }   
 
-void Webserver::dealwithsignal(bool& timeout, bool& stopserver){
+void Webserver::dealwithsignal(){
 
     int ret = 0;
     char signals[1024];
     ret = recv(pipefd[0], signals, sizeof(signals) , 0);
     if (ret <= 0){
-        printf("errno is %d, signal recv error\n", errno); 
+        LOG_ERROR("errno is %d, signal recv error", errno);
         return;
     }
     else{
         for (int i = 0; i < ret; ++i){
             switch(signals[i]){
                 case SIGALRM:{
-                    timeout = true;
+                    m_timeout = true;
                     break;
                 }
                 case SIGTERM:{
-                    stopserver = true;
+                    m_stopserver = true;
+                    break;
+                }
+                case SIGUSR1:{
+                    m_dumptrace = true;
+                    break;
+                }
+                case SIGHUP:{
+                    m_reload = true;
                     break;
                 }
             }
@@ -273,41 +589,191 @@ void Webserver::dealwithsignal(bool& timeout, bool& stopserver){
     }
 }
 
-void Webserver::eventloop(){
-    bool timeout = false;
-    bool stopserver = false;
-
-    while( !stopserver ){
-        int eventnum = epoll_wait(m_epollfd, m_events, MAX_EVENT_NUMBER, -1);
-        if (eventnum < 0 && errno != EINTR)
-        {
-            printf("%s", "epoll failure");
-            break;
+// 冷文件已经读入页缓存，为仍然打开的连接注册 EPOLLOUT 开始发送。
+// 预读期间连接可能已经超时关闭，描述符还可能被新连接复用，用连接编号区分
+void Webserver::dealwithprefault(){
+    m_io_pool->take_done(m_io_done);
+    for (size_t i = 0; i < m_io_done.size(); i++){
+        const io_pool::job& j = m_io_done[i];
+        Metrics::record_since(STAGE_PREFAULT, j.m_submit_ns);
+        http_conn& conn = m_users[j.m_sockfd];
+        if (conn.closed() || conn.m_conn_id != j.m_conn_id) continue;
+        modfd(m_epollfd, j.m_sockfd, EPOLLOUT, m_ConnTrigMode);
+    }
+}
+
+// 收到 SIGUSR1 时把追踪记录导出到文件
+void Webserver::dump_trace(){
+    if (!Trace::enabled()){
+        LOG_WARN("tracing is disabled, start with -t <sample rate>");
+        return;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/webserver-trace.%d.json", getpid());
+    if (Trace::dump(path)){
+        LOG_INFO("trace dumped to %s", path);
+    }
+    else{
+        LOG_ERROR("dump trace to %s failed", path);
+    }
+}
+
+// 处理一轮事件，timeout_ms 与 epoll_wait 相同。返回 false 表示服务器应当退出
+bool Webserver::run_once(int timeout_ms){
+    int eventnum = transport::current()->poll_wait(m_epollfd, m_events.data(), m_events.size(), timeout_ms);
+    if (eventnum < 0 && errno != EINTR)
+    {
+        LOG_ERROR("%s", "epoll failure");
+        return false;
+    }
+    for (int i = 0; i < eventnum; i++){
+        int sockfd = m_events[i].data.fd;
+        if (sockfd == m_listenfd){
+            dealwithclient();
         }
-        for (int i = 0; i < eventnum; i++){
-            int sockfd = m_events[i].data.fd;
-            if (sockfd == m_listenfd){
-                dealwithclient();
-            }
-            else if (sockfd == pipefd[0] && (m_events[i].events & EPOLLIN)){
-                dealwithsignal(timeout, stopserver);
-            }
-            else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
-                util_timer* timer = m_users[sockfd].m_timer;
-                del_timer(timer, sockfd);
-            }
-            else if (m_events[i].events & EPOLLIN){
-                dealwithread(sockfd);
-            }
-            else if (m_events[i].events & EPOLLOUT){
-                dealwithwrite(sockfd);
-            }
-            if (timeout){
-                m_timer_lst.tick();
-                printf("timer tick\n");
-                alarm(TIMESLOT);
-                timeout = false;
-            }
+        else if (sockfd == pipefd[0] && (m_events[i].events & EPOLLIN)){
+            dealwithsignal();
+        }
+        else if (sockfd == m_upgradefd){
+            dealwithupgrade();
+        }
+        else if (m_io_pool && sockfd == m_io_pool->event_fd()){
+            dealwithprefault();
+        }
+        else if (sockfd == PathIndex::watch_fd()){
+            PathIndex::handle_events();
+        }
+        else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+            util_timer* timer = m_users[sockfd].m_timer;
+            del_timer(timer, sockfd);
+        }
+        else if (m_events[i].events & EPOLLIN){
+            dealwithread(sockfd);
+        }
+        else if (m_events[i].events & EPOLLOUT){
+            dealwithwrite(sockfd);
+        }
+        if (m_timeout){
+            Metrics::inc(CNT_TIMER_EXPIRED, m_timer_lst.tick() + expire_idle());
+            sample_listen_queue();
+            LOG_DEBUG("timer tick");
+            alarm(m_config.Timeslot);
+            m_timeout = false;
+        }
+        if (m_dumptrace){
+            dump_trace();
+            m_dumptrace = false;
+        }
+        if (m_reload){
+            reload_config();
+            m_reload = false;
+        }
+    }
+    // 这一批事件处理完之后才清除，避免同一批中监听 socket 的事件被当成客户端连接
+    if (m_draining) m_listenfd = -1;
+    // 排空结束：所有连接都已关闭或超过了等待时间
+    if (m_draining && (http_conn::m_user_count == 0 || time(NULL) >= m_drain_deadline)){
+        LOG_INFO("drain finished, %d connections left, exiting", http_conn::m_user_count);
+        m_stopserver = true;
+    }
+    return !m_stopserver;
+}
+
+// 新进程连接到控制 socket：交出监听 socket，然后开始排空
+void Webserver::dealwithupgrade(){
+    if (!Handoff::send_listener(m_upgradefd, m_listenfd)){
+        return;
+    }
+    // 路径已经属于新进程，退出时不能删除
+    removefd(m_epollfd, m_upgradefd);
+    m_upgradefd = -1;
+    start_drain();
+}
+
+// 停止 accept，关闭空闲的 keep-alive 连接；进行中的请求发完应答后带 Connection: close 关闭
+void Webserver::start_drain(){
+    removefd(m_epollfd, m_listenfd);
+    http_conn::m_draining = true;
+    m_draining = true;
+    m_drain_deadline = time(NULL) + m_config.DrainTimeout;
+
+    int idle = 0;
+    for (int fd = 0; fd < m_config.MaxConns; ++fd){
+        if (m_users[fd].idle()){
+            del_timer(m_users[fd].m_timer, fd);
+            ++idle;
         }
     }
+    LOG_INFO("listening socket handed over, closed %d idle connections, draining %d",
+        idle, http_conn::m_user_count);
+}
+
+// 只在启动时生效的项：新值与当前值不同时提示需要重启，并保留当前值
+static void keep_startup_value(int& next, int current, const char* name){
+    if (next == current) return;
+    LOG_WARN("%s changed from %d to %d, it takes effect after restart", name, current, next);
+    next = current;
+}
+
+static void keep_startup_value(char (&next)[256], const char (&current)[256], const char* name){
+    if (strcmp(next, current) == 0) return;
+    LOG_WARN("%s changed from '%s' to '%s', it takes effect after restart", name, current, next);
+    memcpy(next, current, sizeof(next));
+}
+
+// 收到 SIGHUP 时重新读取配置文件。已有连接不受影响：线程池增减线程，
+// 超时和队列长度立即生效，缓冲区大小对之后建立的连接生效
+void Webserver::reload_config(){
+    Config next = m_config;
+    if (!next.reload()){
+        LOG_ERROR("reload config failed: %s, keep the current config", next.error());
+        return;
+    }
+    keep_startup_value(next.PORT, m_config.PORT, "port");
+    keep_startup_value(next.ActorMode, m_config.ActorMode, "actor_mode");
+    keep_startup_value(next.TrigMode, m_config.TrigMode, "trig_mode");
+    keep_startup_value(next.TraceSample, m_config.TraceSample, "trace_sample");
+    keep_startup_value(next.MaxConns, m_config.MaxConns, "max_conns");
+    keep_startup_value(next.IoThreads, m_config.IoThreads, "io_threads");
+    keep_startup_value(next.MaxEvents, m_config.MaxEvents, "max_events");
+    keep_startup_value(next.Backlog, m_config.Backlog, "backlog");
+    keep_startup_value(next.DeferAccept, m_config.DeferAccept, "defer_accept");
+    keep_startup_value(next.FastOpen, m_config.FastOpen, "fastopen");
+    keep_startup_value(next.LogFile, m_config.LogFile, "log_file");
+    keep_startup_value(next.AccessLogFile, m_config.AccessLogFile, "access_log");
+    keep_startup_value(next.CaptureFile, m_config.CaptureFile, "capture_file");
+    keep_startup_value(next.SubnetPrefix, m_config.SubnetPrefix, "subnet_prefix");
+    keep_startup_value(next.RateTableBits, m_config.RateTableBits, "rate_table_bits");
+    keep_startup_value(next.PathIndex, m_config.PathIndex, "path_index");
+    keep_startup_value(next.PathIndexMax, m_config.PathIndexMax, "path_index_max");
+    keep_startup_value(next.BundleFile, m_config.BundleFile, "bundle_file");
+    keep_startup_value(next.BundlePopulate, m_config.BundlePopulate, "bundle_populate");
+    keep_startup_value(next.BundleHugePages, m_config.BundleHugePages, "bundle_hugepages");
+    keep_startup_value(next.BodySplice, m_config.BodySplice, "body_splice");
+    keep_startup_value(next.MetricsCacheMs, m_config.MetricsCacheMs, "metrics_cache_ms");
+
+    Log::get_instance()->set_level(next.LogLevel);
+    m_pool->resize(next.ThreadNum);
+    m_pool->set_max_requests(next.MaxRequests);
+    http_conn::set_buffer_size(next.ReadBufferSize, next.WriteBufferSize, next.StreamChunkSize);
+    http_conn::set_doc_root(next.DocRoot);
+    http_conn::set_body_limits(next.MaxBodySize, next.SpoolDir);
+    MicroCache::set_limits(next.MicroCacheEntries, next.MicroCacheStaleMs);
+    if (PathIndex::watch_fd() >= 0 && strcmp(next.DocRoot, m_config.DocRoot) != 0){
+        PathIndex::build(next.DocRoot, next.PathIndexMax);
+    }
+    RateLimit::set_limits(limits_of(next));
+    if (next.Timeslot != m_config.Timeslot){
+        alarm(next.Timeslot);
+    }
+    m_config = next;
+    trim_idle();
+    LOG_INFO("config reloaded: thread_num %d, max_requests %d, max_idle_conns %d, timeslot %d, conn_timeout %d, buffers %d/%d, doc_root %s",
+        m_config.ThreadNum, m_config.MaxRequests, m_config.MaxIdleConns, m_config.Timeslot, m_config.ConnTimeout,
+        m_config.ReadBufferSize, m_config.WriteBufferSize, m_config.DocRoot);
+}
+
+void Webserver::eventloop(){
+    while( run_once(-1) ){
+    }
 }
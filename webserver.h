@@ -4,10 +4,9 @@
 #include "http_conn.h"
 #include "threadpool.h"
 #include "lst_timer.h"
-
-#define MAX_FD 65536 //最多可以链接进来的客户端数
-#define MAX_EVENT_NUMBER 10000 //最大的监听事件数
-#define TIMESLOT 5
+#include "config.h"
+#include "io_pool.h"
+#include <vector>
 
 class Webserver{
 private:
@@ -17,15 +16,26 @@ private:
     threadpool<http_conn> *m_pool;
     // int m_threadnum;
 
-    // 客户端数组
+    // 冷文件预读线程池，io_threads 为 0 时为空
+    io_pool *m_io_pool;
+    std::vector<io_pool::job> m_io_done;
+
+    // 客户端数组，大小为 m_config.MaxConns
     http_conn* m_users;
 
+    // 当前生效的配置，SIGHUP 时重新加载
+    Config m_config;
+
     // 定时器相关
     sort_timer_lst m_timer_lst;
+    // 空闲的 keep-alive 连接的定时器不在 m_timer_lst 中，而是按进入空闲的先后放在这里，
+    // 表头是空闲最久的连接，需要腾出位置时先关闭它
+    sort_timer_lst m_idle_lst;
+    int m_idle_count;
 
     // epoll相关
     int m_listenfd;
-    epoll_event m_events[ MAX_EVENT_NUMBER ];
+    std::vector<epoll_event> m_events;
     int m_epollfd;
 
     int m_TrigMode;
@@ -33,25 +43,56 @@ private:
     int m_ConnTrigMode;
     int m_ActorMode;
 
+    // 信号处理的结果，在 run_once 之间保持
+    bool m_timeout;
+    bool m_stopserver;
+    bool m_dumptrace;
+    bool m_reload;
+
+    // 不停机升级：控制 socket，以及交出监听 socket 之后的排空状态
+    int m_upgradefd;
+    bool m_draining;
+    time_t m_drain_deadline;
+
 public:
     Webserver();
     ~Webserver();
 
     void init(int port, int ActorMode, int TrigMode);
+    // 使用完整的配置，需要在 thread_pool() 和 eventlisten() 之前调用
+    void init(const Config& config);
     void initTrigMode();
 
     void thread_pool();
 
-    void eventlisten();
+    // 建立监听 socket 和 epoll，失败时记录日志并返回 false
+    bool eventlisten();
 
     void init_timer(int connfd, const sockaddr_in& saddr);
-    void adjust_timer(util_timer* timer);
+    void adjust_timer(int sockfd, http_conn::PHASE phase, bool restart = false);
+    http_conn::PHASE read_phase(int sockfd);
     void del_timer(util_timer* timer, int sockfd);
-
+    void mark_idle(int sockfd);
+    void leave_idle(int sockfd);
+    bool evict_idle();
+    int expire_idle();
+    void trim_idle();
+
+    bool allow_request(int sockfd);
+    void dispatch_pending(int sockfd);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
     void dealwithclient();
-    void dealwithsignal(bool& timeout, bool& stopserver);
+    void reject_busy(int connfd);
+    void sample_listen_queue();
+    void trace_accept(int connfd, uint64_t start_ns);
+    void dealwithsignal();
+    void dealwithprefault();
+    void dump_trace();
+    void reload_config();
+    void dealwithupgrade();
+    void start_drain();
+    bool run_once(int timeout_ms);
     void eventloop();
 
 };